@@ -229,6 +229,7 @@ function build_wordgrinder_binary(exe, luapackage, frontend, buildstyle)
     srcfile("src/c/utils.c")
     srcfile("src/c/filesystem.c")
     srcfile("src/c/zip.c")
+    srcfile("src/c/xml.c")
     srcfile("src/c/main.c")
     srcfile("src/c/lua.c")
     srcfile("src/c/word.c")
@@ -408,6 +409,8 @@ function run_wordgrinder_tests(exe, luapackage, frontend, buildstyle, noauto)
     for _, test in ipairs({
         "tests/apply-markup.lua",
         "tests/argument-parser.lua",
+        "tests/autosave-background.lua",
+        "tests/bulk-paragraph-changes.lua",
         "tests/change-paragraph-style.lua",
         "tests/clipboard.lua",
         "tests/delete-selection.lua",
@@ -419,18 +422,26 @@ function run_wordgrinder_tests(exe, luapackage, frontend, buildstyle, noauto)
         "tests/export-to-text.lua",
         "tests/export-to-troff.lua",
         "tests/filesystem.lua",
+        "tests/file-writer.lua",
         "tests/find-and-replace.lua",
         "tests/get-style-from-word.lua",
         "tests/immutable-paragraphs.lua",
+        "tests/import-from-doc.lua",
         "tests/import-from-html.lua",
         "tests/import-from-opendocument.lua",
+        "tests/import-from-rtf.lua",
         "tests/import-from-text.lua",
         "tests/import-from-markdown.lua",
+        "tests/incremental-renumber.lua",
+        "tests/insert-block.lua",
         "tests/insert-space-with-style-hint.lua",
         "tests/io-open-enoent.lua",
+        "tests/line-index.lua",
         "tests/line-down-into-style.lua",
         "tests/line-up.lua",
         "tests/line-wrapping.lua",
+        "tests/line-wrapping-cache.lua",
+        "tests/line-wrapping-justified.lua",
         "tests/load-0.1.lua",
         "tests/load-0.2.lua",
         "tests/load-0.3.3.lua",
@@ -443,13 +454,16 @@ function run_wordgrinder_tests(exe, luapackage, frontend, buildstyle, noauto)
         "tests/move-while-selected.lua",
         "tests/numbered-lists.lua",
         "tests/parse-string-into-words.lua",
+        "tests/save-format-binary.lua",
         "tests/save-format-escaped-strings.lua",
+        "tests/save-incremental.lua",
         "tests/simple-editing.lua",
         "tests/smartquotes-selection.lua",
         "tests/smartquotes-typing.lua",
         "tests/spellchecker.lua",
         "tests/tableio.lua",
         "tests/type-while-selected.lua",
+        "tests/undo-paragraph-changes.lua",
         "tests/undo.lua",
         "tests/utf8.lua",
         "tests/utils.lua",
@@ -470,7 +484,9 @@ function run_wordgrinder_tests(exe, luapackage, frontend, buildstyle, noauto)
         "tests/weirdness-word-left-from-end-of-line.lua",
         "tests/weirdness-word-right-to-last-word-in-doc.lua",
         "tests/windows-installdir.lua",
+        "tests/xml-parser.lua",
         "tests/xpattern.lua",
+        "tests/zip-reader.lua",
     }) do
         --local stampfile = OBJDIR.."/"..name.."/"..test..".stamp"
         --alltests[#alltests+1] = stampfile
@@ -614,6 +630,7 @@ emit("build ", OBJDIR.."/luascripts.c: luascripts ", table.concat({
     "src/lua/navigate.lua",
     "src/lua/addons/goto.lua",
     "src/lua/addons/autosave.lua",
+    "src/lua/addons/fileformat.lua",
     "src/lua/addons/pageconfig.lua",
     "src/lua/addons/docsetman.lua",
     "src/lua/addons/scrapbook.lua",
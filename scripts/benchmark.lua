@@ -1,3 +1,4 @@
+#!/usr/bin/env -S wordgrinder --lua
 --[[--
 File              : benchmark.lua
 Author            : Igor V. Sementsov <ig.kuzm@gmail.com>
@@ -5,7 +6,6 @@ Date              : 01.01.2024
 Last Modified Date: 01.01.2024
 Last Modified By  : Igor V. Sementsov <ig.kuzm@gmail.com>
 --]]--
-#!/usr/bin/env -S wordgrinder --lua
 
 -- © 2015 David Given.
 -- WordGrinder is licensed under the MIT open source license. See the COPYING
@@ -83,8 +83,93 @@ local function getfilesize(filename)
 	return size
 end
 
-time("Save .wg file", function() Cmd.SaveCurrentDocumentAs("/tmp/temp.wg") end)
+-- Compare the native line breaker with the pure-Lua one it replaced.
+
+local GetStringWidth = wg.getstringwidth
+
+local function luawrap(paragraph, width)
+	local lines = {}
+	local line = {wn = 1}
+	local w = 0
+	local xs = {}
+	local sentences = {}
+	local issentence = true
+
+	width = width - paragraph:getIndentOfLine(1)
+	for wn, word in ipairs(paragraph) do
+		if issentence then
+			sentences[wn] = true
+		end
+		issentence = word:find("%.$")
+
+		local ww = GetStringWidth(word) + 1
+		xs[wn] = w
+		w = w + ww
+		if (w >= width) then
+			lines[#lines+1] = line
+			if #lines == 1 then
+				width = width + paragraph:getIndentOfLine(1) -
+					paragraph:getIndentOfLine(2)
+			end
+			line = {wn = wn}
+			w = ww
+			xs[wn] = 0
+		end
+
+		line[#line+1] = wn
+	end
+
+	if (#line > 0) then
+		lines[#lines+1] = line
+	end
+	return lines, xs, sentences
+end
+
+time("Rewrap document (Lua)", function()
+	for _, p in ipairs(Document) do
+		luawrap(p, 80)
+	end
+end)
+time("Rewrap document (native)", function()
+	for _, p in ipairs(Document) do
+		p:touch()
+		p:wrap(80)
+	end
+end)
+
+-- Typing into a single huge paragraph (like an imported .txt file with no
+-- line breaks).
+
+do
+	local long = {}
+	for i = 1, 10000 do
+		long[i] = words[(i % #words) + 1]
+	end
+	Document:insertParagraphBefore(CreateParagraph("P", long), 1)
+	Document.cp = 1
+	Document.cw = 5000
+	Document.co = 1
+
+	-- The event loop checkpoints before every key, so this does too.
+	time("Type 1000 characters into a 10000 word paragraph", function()
+		for i = 1, 1000 do
+			Cmd.Checkpoint()
+			Cmd.InsertStringIntoWord("x")
+		end
+	end)
+	Document:deleteParagraphAt(1)
+	Document.cw = 1
+end
+
+DocumentSet.addons.fileformat.textformat = true
+time("Save .wg file (text)", function() Cmd.SaveCurrentDocumentAs("/tmp/temp.wg") end)
+print("(size of file: "..getfilesize("/tmp/temp.wg")..")")
+time("Load .wg file (text)", function() Cmd.LoadDocumentSet("/tmp/temp.wg") end)
+DocumentSet.addons.fileformat.textformat = false
+time("Save .wg file (binary)", function() Cmd.SaveCurrentDocumentAs("/tmp/temp.wg") end)
 print("(size of file: "..getfilesize("/tmp/temp.wg")..")")
+time("Load .wg file (binary)", function() Cmd.LoadDocumentSet("/tmp/temp.wg") end)
+time("Save .wg file (binary, unchanged)", function() Cmd.SaveCurrentDocument() end)
 time("Save .html file", function() Cmd.ExportHTMLFile("/tmp/temp.html") end)
 time("Save .odt file", function() Cmd.ExportODTFile("/tmp/temp.odt") end)
 time("Save .txt file", function() Cmd.ExportTextFile("/tmp/temp.txt") end)
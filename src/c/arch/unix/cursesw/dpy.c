@@ -11,6 +11,15 @@
 #include <time.h>
 
 #define KEY_TIMEOUT (KEY_MAX + 1)
+#define KEY_PASTE (KEY_MAX + 2)
+#define KEY_PASTE_END (KEY_MAX + 3)
+
+/* How long to wait for the rest of a paste before giving up, in ms. */
+#define PASTE_TIMEOUT 1000
+
+static char* pastebuffer = NULL;
+static size_t pastelen = 0;
+static size_t pastesize = 0;
 
 #if defined A_ITALIC
 static bool has_italics = false;
@@ -37,10 +46,24 @@ void dpy_start(void)
 	#if defined A_ITALIC
 		has_italics = !!tigetstr("sitm");
 	#endif
+
+	/* Ask the terminal to bracket pasted text, so that it can be inserted
+	 * in one go rather than typed a key at a time. */
+
+	#if defined NCURSES_VERSION
+		define_key("\033[200~", KEY_PASTE);
+		define_key("\033[201~", KEY_PASTE_END);
+		fputs("\033[?2004h", stdout);
+		fflush(stdout);
+	#endif
 }
 
 void dpy_shutdown(void)
 {
+	#if defined NCURSES_VERSION
+		fputs("\033[?2004l", stdout);
+		fflush(stdout);
+	#endif
 	endwin();
 }
 
@@ -67,6 +90,7 @@ void dpy_setcursor(int x, int y, bool shown)
 void dpy_setattr(int andmask, int ormask)
 {
 	static int attr = 0;
+	static int oldcattr = -1;
 	attr &= andmask;
 	attr |= ormask;
 
@@ -91,7 +115,11 @@ void dpy_setattr(int andmask, int ormask)
 	if (attr & DPY_REVERSE)
 		cattr |= A_REVERSE;
 
-	attrset(cattr);
+	if (cattr != oldcattr)
+	{
+		attrset(cattr);
+		oldcattr = cattr;
+	}
 }
 
 void dpy_writechar(int x, int y, uni_t c)
@@ -104,13 +132,132 @@ void dpy_writechar(int x, int y, uni_t c)
 	mvaddstr(y, x, buffer);
 }
 
+/* Spans of single-width characters go out as strings; anything else is
+ * placed a character at a time, so that we don't depend on curses agreeing
+ * with emu_wcwidth() about how wide things are. */
+
+#define SPANCHUNK 256
+
+void dpy_writespan(int x, int y, const uni_t* s, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		if (emu_wcwidth(s[i]) != 1)
+		{
+			for (i = 0; i < n; i++)
+			{
+				dpy_writechar(x, y, s[i]);
+				x += emu_wcwidth(s[i]);
+			}
+			return;
+		}
+	}
+
+	/* Clip to the screen; unlike single characters, curses would wrap the
+	 * end of a string onto the next row. */
+
+	if (x < 0)
+	{
+		s -= x;
+		n += x;
+		x = 0;
+	}
+	if (n > (COLS - x))
+		n = COLS - x;
+
+	char buffer[SPANCHUNK*4 + 1];
+	while (n > 0)
+	{
+		int chunk = (n > SPANCHUNK) ? SPANCHUNK : n;
+		char* p = buffer;
+		for (int i = 0; i < chunk; i++)
+			writeu8(&p, s[i]);
+		mvaddnstr(y, x, buffer, p - buffer);
+
+		s += chunk;
+		n -= chunk;
+		x += chunk;
+	}
+}
+
+/* Rows which are cleared to the right hand edge with no attributes set are
+ * done with clrtoeol(); otherwise, the area is filled with spaces in the
+ * current attributes (which is how the status bar gets its background). */
+
 void dpy_cleararea(int x1, int y1, int x2, int y2)
 {
-	char cc = ' ';
+	int w, h;
+	getmaxyx(stdscr, h, w);
+	(void) h;
+
+	attr_t attrs;
+	short pair;
+	attr_get(&attrs, &pair, NULL);
 
 	for (int y = y1; y <= y2; y++)
-		for (int x = x1; x <= x2; x++)
-			mvaddnstr(y, x, &cc, 1);
+	{
+		if ((x2 >= (w-1)) && !attrs)
+		{
+			move(y, x1);
+			clrtoeol();
+		}
+		else
+			mvhline(y, x1, ' ' | attrs, x2 - x1 + 1);
+	}
+}
+
+void dpy_getglyphcachestats(struct glyphcachestats* stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+
+static void read_paste(void)
+{
+	bool full = false;
+	pastelen = 0;
+	timeout(PASTE_TIMEOUT);
+	for (;;)
+	{
+		wint_t c;
+		int r = get_wch(&c);
+		if (r == ERR)
+			break;
+		if (r == KEY_CODE_YES)
+		{
+			if (c == KEY_PASTE_END)
+				break;
+			continue;
+		}
+
+		/* If we run out of memory, keep what we've got but carry on
+		 * reading to the end of the paste, so that the rest of it doesn't
+		 * turn up as keystrokes. */
+
+		if (full)
+			continue;
+		if ((pastelen + 8) > pastesize)
+		{
+			size_t newsize = (pastesize * 2) + 256;
+			char* newbuffer = realloc(pastebuffer, newsize);
+			if (!newbuffer)
+			{
+				full = true;
+				continue;
+			}
+			pastebuffer = newbuffer;
+			pastesize = newsize;
+		}
+
+		char* p = pastebuffer + pastelen;
+		writeu8(&p, c);
+		pastelen = p - pastebuffer;
+	}
+}
+
+const char* dpy_getpaste(size_t* len)
+{
+	*len = pastelen;
+	return pastebuffer ? pastebuffer : "";
 }
 
 uni_t dpy_getchar(double timeout)
@@ -128,8 +275,10 @@ uni_t dpy_getchar(double timeout)
 			gettimeofday(&now, NULL);
 			u_int64_t nowms = (now.tv_usec/1000) + ((u_int64_t) now.tv_sec*1000);
 
-			int delay = ((u_int64_t) (timeout*1000)) + nowms - thenms;
-			if (delay <= 0)
+			/* A delay of zero still checks for a key without waiting. */
+
+			int delay = ((u_int64_t) (timeout*1000)) - (nowms - thenms);
+			if (delay < 0)
 				return -KEY_TIMEOUT;
 
 			timeout(delay);
@@ -143,6 +292,12 @@ uni_t dpy_getchar(double timeout)
 		if (r == ERR) /* timeout */
 			return -KEY_TIMEOUT;
 
+		if ((r == KEY_CODE_YES) && (c == KEY_PASTE))
+		{
+			read_paste();
+			return -KEY_PASTE;
+		}
+
 		if ((r == KEY_CODE_YES) || !iswprint(c)) /* function key */
 			return -c;
 
@@ -192,6 +347,7 @@ const char* dpy_getkeyname(uni_t k)
 			return "KEY_BACKSPACE";
 
 		case KEY_TIMEOUT: return "KEY_TIMEOUT";
+		case KEY_PASTE: return "KEY_PASTE";
 		case KEY_DOWN: return "KEY_DOWN";
 		case KEY_UP: return "KEY_UP";
 		case KEY_LEFT: return "KEY_LEFT";
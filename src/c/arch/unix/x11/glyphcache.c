@@ -13,25 +13,29 @@ enum
 	BOLD = (1<<1),
 };
 
+/* The glyph images themselves live on the server, where Xft bounds them to
+ * GLYPH_CACHE_SIZE bytes (see load_fonts()). Our entries are just a font and
+ * a glyph index, so they're bounded by number instead: MAX_GLYPHS of them,
+ * one per character per font style. uthash keeps items in insertion order,
+ * so moving a glyph to the end whenever it's used keeps the least recently
+ * used glyph at the front, ready to be evicted. */
+
+#define DEFAULT_CACHE_SIZE (4*1024*1024)
+#define MAX_GLYPHS 4096
+
 static struct glyph* glyphs;
 static XftFont* fonts[4];
+static struct glyphcachestats stats;
 
 static struct glyph* create_struct_glyph(void)
 {
 	return calloc(1, sizeof(struct glyph));
 }
 
-#if 0
 static void delete_struct_glyph(struct glyph* glyph)
 {
-	if (!glyph)
-		return;
-
-	if (glyph->pixmap)
-		XFreePixmap(display, glyph->pixmap);
 	free(glyph);
 }
-#endif
 
 static void check_font(XftFont* font, const char* name)
 {
@@ -42,7 +46,7 @@ static void check_font(XftFont* font, const char* name)
 	}
 }
 
-static void load_fonts(void)
+static void load_fonts(size_t servermemory)
 {
 	lua_getglobal(L, "X11_BOLD_MODIFIER");
 	const char* bold = lua_tostring(L, -1);
@@ -58,20 +62,29 @@ static void load_fonts(void)
 	const char* normalfont = lua_tostring(L, -1);
 	if (!normalfont)
 		normalfont = "monospace";
-	char buffer[strlen(normalfont) + strlen(bold) + strlen(italic)];
 
-	fonts[REGULAR] = XftFontOpenName(display, DefaultScreen(display), normalfont);
-	check_font(fonts[REGULAR], normalfont);
+	/* Xft evicts glyph images itself once a font uses more than its
+	 * maxglyphmemory, so share the budget out between the four fonts. */
+
+	char limit[48];
+	sprintf(limit, ":" XFT_MAX_GLYPH_MEMORY "=%lu",
+		(unsigned long) (servermemory / 4));
+	char buffer[strlen(normalfont) + strlen(bold) + strlen(italic)
+		+ strlen(limit) + 1];
+
+	sprintf(buffer, "%s%s", normalfont, limit);
+	fonts[REGULAR] = XftFontOpenName(display, DefaultScreen(display), buffer);
+	check_font(fonts[REGULAR], buffer);
 
-	sprintf(buffer, "%s%s", normalfont, bold);
+	sprintf(buffer, "%s%s%s", normalfont, bold, limit);
 	fonts[BOLD] = XftFontOpenName(display, DefaultScreen(display), buffer);
 	check_font(fonts[BOLD], buffer);
 
-	sprintf(buffer, "%s%s", normalfont, italic);
+	sprintf(buffer, "%s%s%s", normalfont, italic, limit);
 	fonts[ITALIC] = XftFontOpenName(display, DefaultScreen(display), buffer);
 	check_font(fonts[ITALIC], buffer);
 
-	sprintf(buffer, "%s%s%s", normalfont, bold, italic);
+	sprintf(buffer, "%s%s%s%s", normalfont, bold, italic, limit);
 	fonts[BOLD|ITALIC] = XftFontOpenName(display, DefaultScreen(display), buffer);
 	check_font(fonts[BOLD|ITALIC], buffer);
 
@@ -86,9 +99,25 @@ static void load_fonts(void)
 
 }
 
+static void prewarm(void);
+
 void glyphcache_init(void)
 {
-	load_fonts();
+	lua_getglobal(L, "GLYPH_CACHE_SIZE");
+	size_t servermemory = lua_isnumber(L, -1) ? lua_tointeger(L, -1) : DEFAULT_CACHE_SIZE;
+	lua_pop(L, 1);
+
+	load_fonts(servermemory);
+	prewarm();
+}
+
+/* The stats describe our cache entries, not the server's glyph images. */
+
+void glyphcache_getstats(struct glyphcachestats* s)
+{
+	*s = stats;
+	s->size = stats.count * sizeof(struct glyph);
+	s->budget = MAX_GLYPHS * sizeof(struct glyph);
 }
 
 static struct glyph* create_glyph(unsigned int id)
@@ -102,116 +131,153 @@ static struct glyph* create_glyph(unsigned int id)
 	int wcw = emu_wcwidth(c);
 	if (wcw < 1)
 		wcw = 1;
-
-	glyph->width = fontwidth * wcw;
-	glyph->pixmap = XCreatePixmap(display, window,
-		glyph->width, fontheight,
-		DefaultDepth(display, DefaultScreen(display)));
-
-	XftDraw* draw = XftDrawCreate(display, glyph->pixmap,
-		DefaultVisual(display, DefaultScreen(display)),
-		DefaultColormap(display, DefaultScreen(display)));
-
-	XftColor* fg;
-	XftColor* bg;
-
-	if (attrs & DPY_BRIGHT)
-		fg = &colours[COLOUR_BRIGHT];
-	else if (attrs & DPY_DIM)
-		fg = &colours[COLOUR_DIM];
-	else
-		fg = &colours[COLOUR_NORMAL];
-
-	if (attrs & DPY_REVERSE)
-	{
-		bg = fg;
-		fg = &colours[COLOUR_BLACK];
-	}
-	else
-		bg = &colours[COLOUR_BLACK];
+	glyph->width = wcw;
 
 	int style = REGULAR;
 	if (attrs & DPY_BOLD)
 		style |= BOLD;
 	if (attrs & DPY_ITALIC)
 		style |= ITALIC;
-
-	int w = (glyph->width+1) & ~1;
-	int w2 = w/2;
-	int h = (fontheight+1) & ~1;
-	int h2 = h/2;
-
-	XftDrawRect(draw, bg, 0, 0, w, h);
+	glyph->font = fonts[style];
 
 	switch (c)
 	{
 		case 32:
 		case 160: /* Non-breaking space */
+			glyph->special = SPECIAL_BLANK;
 			break;
 
+		case 0x2500: case 0x2501: case 0x2502: case 0x2503:
+		case 0x250c: case 0x250d: case 0x250e: case 0x250f:
+		case 0x2510: case 0x2511: case 0x2512: case 0x2513:
+		case 0x2514: case 0x2515: case 0x2516: case 0x2517:
+		case 0x2518: case 0x2519: case 0x251a: case 0x251b:
+		case 0x2551: case 0x2594:
+			glyph->special = SPECIAL_BOX;
+			break;
+
+		default:
+			glyph->index = XftCharIndex(display, glyph->font, c);
+			break;
+	}
+
+	return glyph;
+}
+
+/* Draws a box drawing character into the cell at (x, y), in pixels. */
+
+void glyphcache_drawbox(XftDraw* draw, XftColor* fg, uni_t c, int x, int y)
+{
+	int w = (fontwidth+1) & ~1;
+	int w2 = w/2;
+	int h = (fontheight+1) & ~1;
+	int h2 = h/2;
+
+	switch (c)
+	{
 		case 0x2500: /* ─ */
 		case 0x2501: /* ━ */
-			XftDrawRect(draw, fg, 0, h2, w, 1);
+			XftDrawRect(draw, fg, x, y+h2, w, 1);
 			break;
 
 		case 0x2502: /* │ */
 		case 0x2503: /* ┃ */
-			XftDrawRect(draw, fg, w2, 0, 1, h);
+			XftDrawRect(draw, fg, x+w2, y, 1, h);
 			break;
 
 		case 0x250c: /* ┌ */
 		case 0x250d: /* ┍ */
 		case 0x250e: /* ┎ */
 		case 0x250f: /* ┏ */
-			XftDrawRect(draw, fg, w2, h2, 1, h2);
-			XftDrawRect(draw, fg, w2, h2, w2, 1);
+			XftDrawRect(draw, fg, x+w2, y+h2, 1, h2);
+			XftDrawRect(draw, fg, x+w2, y+h2, w2, 1);
 			break;
 
 		case 0x2510: /* ┐ */
 		case 0x2511: /* ┑ */
 		case 0x2512: /* ┒ */
 		case 0x2513: /* ┓ */
-			XftDrawRect(draw, fg, w2, h2, 1, h2);
-			XftDrawRect(draw, fg, 0, h2, w2, 1);
+			XftDrawRect(draw, fg, x+w2, y+h2, 1, h2);
+			XftDrawRect(draw, fg, x, y+h2, w2, 1);
 			break;
 
 		case 0x2514: /* └ */
 		case 0x2515: /* ┕ */
 		case 0x2516: /* ┖ */
 		case 0x2517: /* ┗ */
-			XftDrawRect(draw, fg, w2, 0, 1, h2);
-			XftDrawRect(draw, fg, w2, h2, w2, 1);
+			XftDrawRect(draw, fg, x+w2, y, 1, h2);
+			XftDrawRect(draw, fg, x+w2, y+h2, w2, 1);
 			break;
 
 		case 0x2518: /* ┘ */
 		case 0x2519: /* ┙ */
 		case 0x251a: /* ┚ */
 		case 0x251b: /* ┛ */
-			XftDrawRect(draw, fg, w2, 0, 1, h2);
-			XftDrawRect(draw, fg, 0, h2, w2+1, 1);
+			XftDrawRect(draw, fg, x+w2, y, 1, h2);
+			XftDrawRect(draw, fg, x, y+h2, w2+1, 1);
 			break;
 
 		case 0x2551: /* ║ */
-			XftDrawRect(draw, fg, w2-1, 0, 1, h);
-			XftDrawRect(draw, fg, w2+1, 0, 1, h);
+			XftDrawRect(draw, fg, x+w2-1, y, 1, h);
+			XftDrawRect(draw, fg, x+w2+1, y, 1, h);
 			break;
 
 		case 0x2594: /* ▔ */
-			XftDrawRect(draw, fg, 0, 2, w, 1);
-			break;
-	
-		default:
-			XftDrawString32(draw, fg, fonts[style], 0, fontascent, &c, 1);
+			XftDrawRect(draw, fg, x, y+2, w, 1);
 			break;
 	}
+}
+
+static void evict(struct glyph* keep)
+{
+	while ((stats.count > MAX_GLYPHS) && (glyphs != keep))
+	{
+		struct glyph* glyph = glyphs;
+		HASH_DEL(glyphs, glyph);
+		stats.count--;
+		stats.evictions++;
+		delete_struct_glyph(glyph);
+	}
+}
 
-	if (attrs & DPY_UNDERLINE)
-		XftDrawRect(draw, fg, 0, fontascent + 2, fontwidth, 1);
-	
-	XftDrawDestroy(draw);
+static struct glyph* add_glyph(unsigned int id)
+{
+	struct glyph* glyph = create_glyph(id);
+	if (glyph)
+	{
+		HASH_ADD_INT(glyphs, id, glyph);
+		stats.count++;
+		evict(glyph);
+	}
 	return glyph;
 }
 
+/* Only bold and italic change how a character is drawn; everything else is
+ * colour and underlining, which the caller does. */
+
+#define STYLE_ATTRS (DPY_BOLD | DPY_ITALIC)
+
+/* Loads printable ASCII in each font style, as that's nearly everything
+ * that ever gets drawn. This also uploads the glyph images to the server
+ * now rather than while the user is typing. */
+
+static void prewarm(void)
+{
+	static const int styleattrs[4] =
+		{ 0, DPY_ITALIC, DPY_BOLD, DPY_BOLD|DPY_ITALIC };
+
+	for (int style = 0; style < 4; style++)
+	{
+		FT_UInt indices[127 - 32];
+		for (int c = 32; c < 127; c++)
+		{
+			add_glyph(glyphcache_id(c, styleattrs[style]));
+			indices[c - 32] = XftCharIndex(display, fonts[style], c);
+		}
+		XftFontLoadGlyphs(display, fonts[style], FcTrue, indices, 127 - 32);
+	}
+}
+
 struct glyph* glyphcache_getglyph(unsigned int id)
 {
 	struct glyph* glyph;
@@ -220,17 +286,26 @@ struct glyph* glyphcache_getglyph(unsigned int id)
 
 	if (id == 0)
 		return NULL;
+	id &= ~0xff | STYLE_ATTRS;
 
-	/* Attempt to find the glyph in the cache. */
+	/* Attempt to find the glyph in the cache. If it's there, move it to
+	 * the most recently used end. */
 
     HASH_FIND_INT(glyphs, &id, glyph);
-    if (!glyph)
+    if (glyph)
 	{
-		glyph = create_glyph(id);
-		if (glyph)
+		stats.hits++;
+		if (glyph->hh.next)
+		{
+			HASH_DEL(glyphs, glyph);
 			HASH_ADD_INT(glyphs, id, glyph);
+		}
+	}
+	else
+	{
+		stats.misses++;
+		glyph = add_glyph(id);
     }
 
     return glyph;
 }
-
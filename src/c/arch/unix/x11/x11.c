@@ -10,6 +10,7 @@
 #include <time.h>
 #include <ctype.h>
 #include <poll.h>
+#include <X11/Xatom.h>
 #include "x11.h"
 
 #define VKM_SHIFT     0x02000000
@@ -19,6 +20,7 @@
 #define VK_RESIZE     0x10000000
 #define VK_TIMEOUT    0x20000000
 #define VK_REDRAW     0x30000000
+#define VK_PASTE      0x40000000
 
 struct gg
 {
@@ -42,6 +44,10 @@ static XIC xic;
 static XIM xim;
 static XftDraw* draw;
 static GC gc;
+static Atom utf8_string;
+static Atom paste_property;
+static char* pastebuffer = NULL;
+static size_t pastelen = 0;
 
 static int screenwidth, screenheight;
 static int cursorx, cursory;
@@ -125,7 +131,8 @@ void dpy_start(void)
 	XSetClassHint(display, window,
 		&((XClassHint) { "WordGrinder", "WordGrinder" }));
 	XSelectInput(display, window,
-		StructureNotifyMask | ExposureMask | KeyPressMask | KeymapStateMask);
+		StructureNotifyMask | ExposureMask | KeyPressMask | KeymapStateMask |
+		ButtonPressMask);
 	XMapWindow(display, window);
 
 	glyphcache_init();
@@ -153,12 +160,15 @@ void dpy_start(void)
 	{
 		XGCValues gcv =
 		{
-			.graphics_exposures = false
+			.graphics_exposures = true
 		};
 
 		gc = XCreateGC(display, window, GCGraphicsExposures, &gcv);
 	}
 
+	utf8_string = XInternAtom(display, "UTF8_STRING", False);
+	paste_property = XInternAtom(display, "WORDGRINDER_PASTE", False);
+
 	screenwidth = screenheight = 0;
 	cursorx = cursory = 0;
 	cursorshown = true;
@@ -186,7 +196,10 @@ void dpy_sync(void)
 	redraw();
 }
 
-void dpy_setcursor(int x, int y, bool shown)
+/* Marks the cells under the caret as needing redrawing, so it gets
+ * erased. */
+
+static void invalidate_cursor(void)
 {
 	if (frontbuffer)
 	{
@@ -194,6 +207,11 @@ void dpy_setcursor(int x, int y, bool shown)
 			for (int yy=(cursory-1); yy<=(cursory+1); yy++)
 				sput(frontbuffer, xx, yy, 0);
 	}
+}
+
+void dpy_setcursor(int x, int y, bool shown)
+{
+	invalidate_cursor();
 
 	cursorx = x;
 	cursory = y;
@@ -214,6 +232,15 @@ void dpy_writechar(int x, int y, uni_t c)
 		sput(backbuffer, x+1, y, 0);
 }
 
+void dpy_writespan(int x, int y, const uni_t* s, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		dpy_writechar(x, y, s[i]);
+		x += emu_wcwidth(s[i]);
+	}
+}
+
 void dpy_cleararea(int x1, int y1, int x2, int y2)
 {
 	for (int y=y1; y<=y2; y++)
@@ -221,13 +248,218 @@ void dpy_cleararea(int x1, int y1, int x2, int y2)
 			sput(backbuffer, x, y, glyphcache_id(' ' , defaultattr));
 }
 
-static void render_glyph(unsigned int id, int x, int y)
+void dpy_getglyphcachestats(struct glyphcachestats* stats)
+{
+	glyphcache_getstats(stats);
+}
+
+static void get_colours(int attrs, XftColor** fg, XftColor** bg)
 {
-	struct glyph* glyph = glyphcache_getglyph(id);
-	if (glyph && glyph->pixmap)
-		XCopyArea(display, glyph->pixmap, window, gc,
-			0, 0, glyph->width, fontheight,
-			x*fontwidth, y*fontheight);
+	if (attrs & DPY_BRIGHT)
+		*fg = &colours[COLOUR_BRIGHT];
+	else if (attrs & DPY_DIM)
+		*fg = &colours[COLOUR_DIM];
+	else
+		*fg = &colours[COLOUR_NORMAL];
+
+	if (attrs & DPY_REVERSE)
+	{
+		*bg = *fg;
+		*fg = &colours[COLOUR_BLACK];
+	}
+	else
+		*bg = &colours[COLOUR_BLACK];
+}
+
+/* Redraws cells x1 to x2 inclusive of row y from the frontbuffer. This is
+ * done in passes: first the backgrounds, as one rectangle per run of cells
+ * with the same background colour; then all the text in each colour with
+ * one request; then anything which needs drawing by hand. */
+
+static void draw_row(int y, int x1, int x2)
+{
+	unsigned int* p = &frontbuffer[y * screenwidth];
+	int py = y * fontheight;
+
+	/* Clip to the cells being redrawn, so that glyphs which overhang their
+	 * cell (italics, mostly) don't scribble over their unchanged
+	 * neighbours. */
+
+	XRectangle clip =
+	{
+		.x = x1 * fontwidth,
+		.y = py,
+		.width = (x2 - x1 + 1) * fontwidth,
+		.height = fontheight
+	};
+	XftDrawSetClipRectangles(draw, 0, 0, &clip, 1);
+
+	/* Backgrounds. Continuation cells of wide characters (id 0) inherit the
+	 * background of the character to their left. */
+
+	{
+		XftColor* runbg = NULL;
+		int runx = x1;
+		XftColor* bg = &colours[COLOUR_BLACK];
+		for (int x = x1; x <= x2+1; x++)
+		{
+			if (x <= x2)
+			{
+				if (p[x])
+				{
+					XftColor* fg;
+					get_colours(p[x] & 0xff, &fg, &bg);
+				}
+				if (bg == runbg)
+					continue;
+			}
+
+			if (runbg)
+				XftDrawRect(draw, runbg, runx * fontwidth, py,
+					(x - runx) * fontwidth, fontheight);
+			runbg = bg;
+			runx = x;
+		}
+	}
+
+	/* Text, batched by colour. */
+
+	XftGlyphFontSpec specs[x2 - x1 + 1];
+	for (int colour = 0; colour < NUM_COLOURS; colour++)
+	{
+		int count = 0;
+		for (int x = x1; x <= x2; x++)
+		{
+			unsigned int id = p[x];
+			if (!id)
+				continue;
+
+			XftColor* fg;
+			XftColor* bg;
+			get_colours(id & 0xff, &fg, &bg);
+			if (fg != &colours[colour])
+				continue;
+
+			struct glyph* glyph = glyphcache_getglyph(id);
+			if (glyph->special)
+				continue;
+
+			specs[count++] = (XftGlyphFontSpec)
+			{
+				.font = glyph->font,
+				.glyph = glyph->index,
+				.x = x * fontwidth,
+				.y = py + fontascent
+			};
+		}
+
+		if (count)
+			XftDrawGlyphFontSpec(draw, &colours[colour], specs, count);
+	}
+
+	/* Box drawing characters and underlines. */
+
+	for (int x = x1; x <= x2; x++)
+	{
+		unsigned int id = p[x];
+		if (!id)
+			continue;
+
+		int attrs = id & 0xff;
+		XftColor* fg;
+		XftColor* bg;
+		get_colours(attrs, &fg, &bg);
+
+		struct glyph* glyph = glyphcache_getglyph(id);
+		if (glyph->special == SPECIAL_BOX)
+			glyphcache_drawbox(draw, fg, id >> 8, x * fontwidth, py);
+
+		if (attrs & DPY_UNDERLINE)
+			XftDrawRect(draw, fg, x * fontwidth, py + fontascent + 2,
+				fontwidth, 1);
+	}
+
+	XftDrawSetClip(draw, 0);
+}
+
+static unsigned int hash_row(unsigned int* p)
+{
+	/* FNV-1a */
+	unsigned int h = 2166136261u;
+	for (int x = 0; x < screenwidth; x++)
+	{
+		h ^= p[x];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/* Looks for a block of rows which has moved up or down since the last
+ * redraw (because the document has scrolled) and moves it on screen with
+ * a single XCopyArea, so that only the rows which have been uncovered need
+ * drawing. The frontbuffer is moved to match, which means that getting it
+ * wrong only costs time: any rows which didn't really move get redrawn
+ * afterwards. */
+
+static void scroll(void)
+{
+	unsigned int fronthash[screenheight];
+	unsigned int backhash[screenheight];
+	for (int y = 0; y < screenheight; y++)
+	{
+		fronthash[y] = hash_row(&frontbuffer[y * screenwidth]);
+		backhash[y] = hash_row(&backbuffer[y * screenwidth]);
+	}
+
+	/* For each possible distance, find the block of rows for which moving
+	 * them saves the most redrawing: each row which would then be right
+	 * scores one, and each row which is right already but would no longer
+	 * be loses one. */
+
+	int bestgain = 0;
+	int bestd = 0, besty1 = 0, besty2 = 0;
+	for (int d = 1-screenheight; d < screenheight; d++)
+	{
+		if (!d)
+			continue;
+
+		int gain = 0;
+		int y1 = 0;
+		for (int y = MAX(0, -d); y < MIN(screenheight, screenheight-d); y++)
+		{
+			if (gain <= 0)
+			{
+				gain = 0;
+				y1 = y;
+			}
+			gain += (backhash[y] == fronthash[y+d])
+				- (backhash[y] == fronthash[y]);
+
+			if (gain > bestgain)
+			{
+				bestgain = gain;
+				bestd = d;
+				besty1 = y1;
+				besty2 = y;
+			}
+		}
+	}
+
+	if (!bestgain)
+		return;
+
+	/* The caret gets copied too, so make sure it's erased afterwards. */
+
+	invalidate_cursor();
+
+	int rows = besty2 - besty1 + 1;
+	XCopyArea(display, window, window, gc,
+		0, (besty1+bestd) * fontheight,
+		screenwidth * fontwidth, rows * fontheight,
+		0, besty1 * fontheight);
+	memmove(&frontbuffer[besty1 * screenwidth],
+		&frontbuffer[(besty1+bestd) * screenwidth],
+		rows * screenwidth * sizeof(unsigned int));
 }
 
 static void redraw(void)
@@ -235,18 +467,32 @@ static void redraw(void)
 	if (!frontbuffer || !backbuffer)
 		return;
 
+	scroll();
+
 	for (int y = 0; y<screenheight; y++)
 	{
 		unsigned int* frontp = &frontbuffer[y * screenwidth];
 		unsigned int* backp = &backbuffer[y * screenwidth];
-		for (int x = 0; x<screenwidth; x++)
-		{
-			if (frontp[x] != backp[x])
-			{
-				frontp[x] = backp[x];
-				render_glyph(frontp[x], x, y);
-			}
-		}
+
+		int x1 = 0;
+		while ((x1 < screenwidth) && (frontp[x1] == backp[x1]))
+			x1++;
+		if (x1 == screenwidth)
+			continue;
+
+		int x2 = screenwidth - 1;
+		while (frontp[x2] == backp[x2])
+			x2--;
+
+		/* Don't start or finish halfway through a wide character. */
+
+		while ((x1 > 0) && !backp[x1])
+			x1--;
+		while ((x2 < (screenwidth-1)) && !backp[x2+1])
+			x2++;
+
+		memcpy(&frontp[x1], &backp[x1], (x2 - x1 + 1) * sizeof(unsigned int));
+		draw_row(y, x1, x2);
 	}
 
 	/* Draw a caret where the cursor should be. */
@@ -267,6 +513,46 @@ static void redraw(void)
 	}
 }
 
+/* The middle button pastes the primary selection. We ask its owner to
+ * put it in a property on our window, and it arrives as a SelectionNotify
+ * event. (Selections big enough to need the INCR protocol are ignored.) */
+
+static void read_paste(XSelectionEvent* xse)
+{
+	if (xse->property == None)
+		return;
+
+	Atom type;
+	int format;
+	unsigned long nitems, bytesafter;
+	unsigned char* data = NULL;
+	if ((XGetWindowProperty(display, window, paste_property, 0, LONG_MAX/4,
+			True, AnyPropertyType, &type, &format, &nitems, &bytesafter,
+			&data) == Success) &&
+		(type == utf8_string) && (format == 8) && (nitems > 0))
+	{
+		/* If there isn't room, the paste is dropped. */
+
+		char* newbuffer = realloc(pastebuffer, nitems);
+		if (newbuffer)
+		{
+			pastebuffer = newbuffer;
+			memcpy(pastebuffer, data, nitems);
+			pastelen = nitems;
+			push_key(-VK_PASTE);
+		}
+	}
+
+	if (data)
+		XFree(data);
+}
+
+const char* dpy_getpaste(size_t* len)
+{
+	*len = pastelen;
+	return pastebuffer ? pastebuffer : "";
+}
+
 uni_t dpy_getchar(double timeout)
 {
 	while (numqueued == 0)
@@ -299,8 +585,11 @@ uni_t dpy_getchar(double timeout)
 				break;
 
 			case Expose:
+			case GraphicsExpose:
 			{
-				/* Mark some of the screen as needing redrawing. */
+				/* Mark some of the screen as needing redrawing. (A
+				 * GraphicsExpose means that a scroll copied from somewhere
+				 * which was obscured.) */
 
 				if (frontbuffer)
 				{
@@ -338,6 +627,16 @@ uni_t dpy_getchar(double timeout)
 				break;
 			}
 
+			case ButtonPress:
+				if (e.xbutton.button == Button2)
+					XConvertSelection(display, XA_PRIMARY, utf8_string,
+						paste_property, window, e.xbutton.time);
+				break;
+
+			case SelectionNotify:
+				read_paste(&e.xselection);
+				break;
+
 			case MappingNotify:
 			case KeymapNotify:
 				XRefreshKeyboardMapping(&e.xmapping);
@@ -402,6 +701,7 @@ const char* dpy_getkeyname(uni_t k)
 		case VK_RESIZE:      return "KEY_RESIZE";
 		case VK_TIMEOUT:     return "KEY_TIMEOUT";
 		case VK_REDRAW:      return "KEY_REDRAW";
+		case VK_PASTE:       return "KEY_PASTE";
 	}
 
 	int key = -k & ~VKM__MASK;
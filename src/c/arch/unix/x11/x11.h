@@ -20,6 +20,7 @@
 #define VK_RESIZE     0x10000000
 #define VK_TIMEOUT    0x20000000
 #define VK_REDRAW     0x30000000
+#define VK_PASTE      0x40000000
 
 enum
 {
@@ -32,14 +33,28 @@ enum
 };
 
 
+/* Glyphs aren't rendered by us; Xft keeps the rendered glyphs in glyph sets
+ * on the server, which act as our glyph atlas, and whole rows are drawn
+ * from them at once. All we cache is how to draw each (character,
+ * attribute) pair. */
+
 struct glyph
 {
 	unsigned int id;              /* id of this glyph */
-	Pixmap pixmap;                /* glyph storage */
-	int width;                    /* width of this cell */
+	XftFont* font;                /* font to draw it with */
+	FT_UInt index;                /* glyph in that font, if drawn as text */
+	int special;                  /* if nonzero, drawn by hand (see below) */
+	int width;                    /* width of this cell, in cells */
 	UT_hash_handle hh;
 };
 
+enum
+{
+	SPECIAL_NONE = 0,
+	SPECIAL_BLANK,                /* nothing but background */
+	SPECIAL_BOX,                  /* box drawing character, drawn with rectangles */
+};
+
 #define glyphcache_id(c, a) ((c<<8) | a)
 
 extern void glyphcache_init(void);
@@ -48,6 +63,8 @@ extern void glyphcache_getfontsize(int* w, int* h);
 
 extern void glyphcache_flush(void);
 extern struct glyph* glyphcache_getglyph(unsigned int id);
+extern void glyphcache_getstats(struct glyphcachestats* stats);
+extern void glyphcache_drawbox(XftDraw* draw, XftColor* fg, uni_t c, int x, int y);
 
 extern Display* display;
 extern Window window;
@@ -161,6 +161,15 @@ void dpy_writechar(int x, int y, uni_t c)
 	buffer[y*screenwidth + x].Char.UnicodeChar = c;
 }
 
+void dpy_writespan(int x, int y, const uni_t* s, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		dpy_writechar(x, y, s[i]);
+		x += emu_wcwidth(s[i]);
+	}
+}
+
 void dpy_cleararea(int x1, int y1, int x2, int y2)
 {
 	for (int y = y1; y <= y2; y++)
@@ -168,6 +177,17 @@ void dpy_cleararea(int x1, int y1, int x2, int y2)
 			buffer[y*screenwidth + x] = defaultChar;
 }
 
+void dpy_getglyphcachestats(struct glyphcachestats* stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+
+const char* dpy_getpaste(size_t* len)
+{
+	*len = 0;
+	return "";
+}
+
 static bool get_key_code(KEY_EVENT_RECORD* event, uni_t* r1, uni_t* r2)
 {
 	if (!event->bKeyDown)
@@ -882,6 +882,15 @@ void dpy_writechar(int x, int y, uni_t c)
 	backbuffer[y*screenwidth + x] = (c<<8) | defaultattr;
 }
 
+void dpy_writespan(int x, int y, const uni_t* s, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		dpy_writechar(x, y, s[i]);
+		x += emu_wcwidth(s[i]);
+	}
+}
+
 void dpy_cleararea(int x1, int y1, int x2, int y2)
 {
 	for (int y = y1; y <= y2; y++)
@@ -889,6 +898,17 @@ void dpy_cleararea(int x1, int y1, int x2, int y2)
 			dpy_writechar(x, y, (' '<<8) | defaultattr);
 }
 
+void dpy_getglyphcachestats(struct glyphcachestats* stats)
+{
+	glyphcache_getstats(stats);
+}
+
+const char* dpy_getpaste(size_t* len)
+{
+	*len = 0;
+	return "";
+}
+
 const char* dpy_getkeyname(uni_t k)
 {
 	switch (-k)
@@ -37,6 +37,7 @@ extern void glyphcache_getfontsize(int* w, int* h);
 
 extern void glyphcache_flush(void);
 extern struct glyph* glyphcache_getglyph(unsigned int id, HDC dc);
+extern void glyphcache_getstats(struct glyphcachestats* stats);
 
 extern void dpy_queuekey(uni_t key);
 extern void dpy_flushkeys(void);
@@ -11,7 +11,16 @@
 #include <windows.h>
 #include "gdi.h"
 
+/* The cache is bounded by GLYPH_CACHE_SIZE bytes. uthash keeps items in
+ * insertion order, so moving a glyph to the end whenever it's used keeps
+ * the least recently used glyph at the front, ready to be evicted. Each
+ * glyph also costs two GDI handles, which are a limited resource, so the
+ * default is kept fairly small. */
+
+#define DEFAULT_CACHE_SIZE (1024*1024)
+
 static struct glyph* glyphs;
+static struct glyphcachestats stats;
 static int fontwidth = 0;
 static int fontheight = 0;
 
@@ -49,6 +58,13 @@ static void delete_struct_glyph(struct glyph* glyph)
 	free(glyph);
 }
 
+/* Assumes a 32-bit display, which is near enough. */
+
+static size_t sizeof_glyph(struct glyph* glyph)
+{
+	return sizeof(struct glyph) + (glyph->realwidth * glyph->realheight * 4);
+}
+
 static int CALLBACK font_counter_cb(
 		ENUMLOGFONTEX* fontex,
 		NEWTEXTMETRICEX* metrics,
@@ -176,8 +192,14 @@ static int font_sorter_cb(const void* p1, const void* p2)
 	return 1;
 }
 
+static void prewarm(HDC dc);
+
 void glyphcache_init(HDC dc, LOGFONT* defaultfont)
 {
+	lua_getglobal(L, "GLYPH_CACHE_SIZE");
+	stats.budget = lua_isnumber(L, -1) ? lua_tointeger(L, -1) : DEFAULT_CACHE_SIZE;
+	lua_pop(L, 1);
+
 	HFONT defaultfonthandle = CreateFontIndirect(defaultfont);
 	int state = SaveDC(dc);
 	SelectObject(dc, defaultfonthandle);
@@ -252,6 +274,8 @@ void glyphcache_init(HDC dc, LOGFONT* defaultfont)
 	DeleteObject(defaultfonthandle);
 
 	RestoreDC(dc, state);
+
+	prewarm(dc);
 }
 
 void glyphcache_deinit(void)
@@ -288,6 +312,13 @@ void glyphcache_flush(void)
 		HASH_DEL(glyphs, glyph);
 		delete_struct_glyph(glyph);
 	}
+	stats.size = 0;
+	stats.count = 0;
+}
+
+void glyphcache_getstats(struct glyphcachestats* s)
+{
+	*s = stats;
 }
 
 static void unicode_to_utf16(uni_t unicode, WCHAR* string, int* slen)
@@ -602,6 +633,57 @@ error:
 	goto exit;
 }
 
+static void evict(struct glyph* keep)
+{
+	while ((stats.size > stats.budget) && (glyphs != keep))
+	{
+		struct glyph* glyph = glyphs;
+		HASH_DEL(glyphs, glyph);
+		stats.size -= sizeof_glyph(glyph);
+		stats.count--;
+		stats.evictions++;
+		delete_struct_glyph(glyph);
+	}
+}
+
+static struct glyph* add_glyph(unsigned int id, HDC dc)
+{
+	struct glyph* glyph = create_glyph(id, dc);
+	if (glyph)
+	{
+		HASH_ADD_INT(glyphs, id, glyph);
+		stats.size += sizeof_glyph(glyph);
+		stats.count++;
+		evict(glyph);
+	}
+	return glyph;
+}
+
+/* Loads printable ASCII in every combination of attributes, as that's
+ * nearly everything that ever gets drawn; the most common combinations
+ * (i.e. the ones with fewest attributes) go first in case the budget runs
+ * out. */
+
+static void prewarm(HDC dc)
+{
+	for (int n = 0; n <= 6; n++)
+	{
+		for (int attrs = 0; attrs < 0x40; attrs++)
+		{
+			if (__builtin_popcount(attrs) != n)
+				continue;
+
+			for (uni_t c = 32; c < 127; c++)
+			{
+				if ((stats.size + sizeof(struct glyph)
+						+ (fontwidth * fontheight * 4)) > stats.budget)
+					return;
+				add_glyph((c<<8) | attrs, dc);
+			}
+		}
+	}
+}
+
 struct glyph* glyphcache_getglyph(unsigned int id, HDC dc)
 {
 	struct glyph* glyph;
@@ -611,14 +693,23 @@ struct glyph* glyphcache_getglyph(unsigned int id, HDC dc)
 	if (id == 0)
 		return NULL;
 
-	/* Attempt to find the glyph in the cache. */
+	/* Attempt to find the glyph in the cache. If it's there, move it to
+	 * the most recently used end. */
 
     HASH_FIND_INT(glyphs, &id, glyph);
-    if (!glyph)
+    if (glyph)
 	{
-		glyph = create_glyph(id, dc);
-		if (glyph)
+		stats.hits++;
+		if (glyph->hh.next)
+		{
+			HASH_DEL(glyphs, glyph);
 			HASH_ADD_INT(glyphs, id, glyph);
+		}
+	}
+	else
+	{
+		stats.misses++;
+		glyph = add_glyph(id, dc);
     }
 
     return glyph;
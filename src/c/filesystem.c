@@ -3,6 +3,9 @@
  * file in this distribution for the full text.
  */
 
+/* Make off_t (and so fseeko) 64 bits wide on 32-bit Unix targets. */
+#define _FILE_OFFSET_BITS 64
+
 #include "globals.h"
 #include <sys/time.h>
 #include <sys/stat.h>
@@ -10,6 +13,12 @@
 #include <string.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <zlib.h>
+#if defined WIN32
+#include <io.h>
+#else
+#include <sys/wait.h>
+#endif
 
 static int pusherrno(lua_State* L)
 {
@@ -154,8 +163,309 @@ static int access_cb(lua_State* L)
 	return 1;
 }
 
+/* Buffered file writer, used for saving documents. Data is accumulated in a
+ * fixed size buffer and written out when it fills, so saving never needs
+ * more memory than this no matter how big the document is. Errors are
+ * sticky and reported by close(), which also makes sure the data has hit
+ * the disk (so that it's safe to rename the file over the old one). A CRC
+ * of what's been written is kept, so that ranges copied out of the file
+ * later can be checked against it.
+ */
+
+#define WRITER_METATABLE "wg.writer"
+#define WRITER_BUFFER_SIZE 65536
+
+struct writer
+{
+	FILE* fp;
+	size_t used;
+	double written;
+	uLong crc;
+	int error;
+	char buffer[WRITER_BUFFER_SIZE];
+};
+
+static void writer_flush(struct writer* w)
+{
+	if (w->used && !w->error)
+	{
+		if (fwrite(w->buffer, 1, w->used, w->fp) != w->used)
+			w->error = errno ? errno : EIO;
+	}
+	w->used = 0;
+}
+
+void writer_write(struct writer* w, const char* data, size_t size)
+{
+	if (!w->fp)
+		return;
+	w->written += size;
+	w->crc = crc32(w->crc, (const Bytef*) data, size);
+
+	if ((w->used + size) > WRITER_BUFFER_SIZE)
+	{
+		writer_flush(w);
+		if (size > WRITER_BUFFER_SIZE)
+		{
+			if (!w->error && (fwrite(data, 1, size, w->fp) != size))
+				w->error = errno ? errno : EIO;
+			return;
+		}
+	}
+
+	memcpy(w->buffer + w->used, data, size);
+	w->used += size;
+}
+
+struct writer* checkwriter(lua_State* L, int index)
+{
+	struct writer* w = luaL_checkudata(L, index, WRITER_METATABLE);
+	if (!w->fp)
+		luaL_error(L, "writer is closed");
+	return w;
+}
+
+static int openwriter_cb(lua_State* L)
+{
+	const char* filename = luaL_checklstring(L, 1, NULL);
+
+	#if defined WIN32
+		FILE* fp = _wfopen(utf8_to_wide(L, filename), L"wb");
+	#else
+		FILE* fp = fopen(filename, "wb");
+	#endif
+	if (!fp)
+		return pusherrno(L);
+	setvbuf(fp, NULL, _IONBF, 0);
+
+	struct writer* w = lua_newuserdata(L, sizeof(struct writer));
+	w->fp = fp;
+	w->used = 0;
+	w->written = 0;
+	w->crc = crc32(0, NULL, 0);
+	w->error = 0;
+	luaL_getmetatable(L, WRITER_METATABLE);
+	lua_setmetatable(L, -2);
+	return 1;
+}
+
+/* writer:write(...): writes all the supplied strings (or numbers). */
+
+static int writer_write_cb(lua_State* L)
+{
+	struct writer* w = checkwriter(L, 1);
+	int top = lua_gettop(L);
+
+	for (int i = 2; i <= top; i++)
+	{
+		size_t size;
+		const char* s = luaL_checklstring(L, i, &size);
+		writer_write(w, s, size);
+	}
+
+	lua_settop(L, 1);
+	return 1;
+}
+
+/* writer:tell(): returns the number of bytes written so far. */
+
+static int writer_tell_cb(lua_State* L)
+{
+	struct writer* w = checkwriter(L, 1);
+	lua_pushnumber(L, w->written);
+	return 1;
+}
+
+/* writer:checksum(): returns the CRC32 of everything written since the
+ * last call (or since the writer was opened). */
+
+static int writer_checksum_cb(lua_State* L)
+{
+	struct writer* w = checkwriter(L, 1);
+	lua_pushnumber(L, w->crc);
+	w->crc = crc32(0, NULL, 0);
+	return 1;
+}
+
+/* Seeks to an absolute offset. fseek() takes a long, which is only 32 bits
+ * on Windows and 32-bit Unix targets, so it can't reach past 2GB there. */
+
+static int seekto(FILE* fp, double offset)
+{
+	#if defined WIN32
+		return _fseeki64(fp, (__int64) offset, SEEK_SET);
+	#else
+		return fseeko(fp, (off_t) offset, SEEK_SET);
+	#endif
+}
+
+/* writer:copy(file, offset, size, [checksum]): copies a range of bytes from
+ * an open Lua file. If the range can't be read, the writer fails (and
+ * close() will report it). If the copied bytes don't match checksum, which
+ * means the file has changed since it was written, this returns false;
+ * the writer's output is then wrong, and should be thrown away. */
+
+static int writer_copy_cb(lua_State* L)
+{
+	struct writer* w = checkwriter(L, 1);
+	FILE* fp = *(FILE**) luaL_checkudata(L, 2, LUA_FILEHANDLE);
+	double offset = forcedouble(L, 3);
+	size_t size = (size_t) forcedouble(L, 4);
+	bool check = !lua_isnoneornil(L, 5);
+	uLong expected = check ? (uLong) forcedouble(L, 5) : 0;
+	uLong crc = crc32(0, NULL, 0);
+
+	if (!fp || (seekto(fp, offset) != 0))
+	{
+		w->error = errno ? errno : EIO;
+		errno = w->error;
+		return pusherrno(L);
+	}
+
+	writer_flush(w);
+	while (size)
+	{
+		size_t chunk = WRITER_BUFFER_SIZE - w->used;
+		if (chunk > size)
+			chunk = size;
+
+		size_t got = fread(w->buffer + w->used, 1, chunk, fp);
+		crc = crc32(crc, (const Bytef*) w->buffer + w->used, got);
+		w->crc = crc32(w->crc, (const Bytef*) w->buffer + w->used, got);
+		w->used += got;
+		w->written += got;
+		size -= got;
+		if (got != chunk)
+		{
+			w->error = ferror(fp) ? errno : EIO;
+			errno = w->error;
+			return pusherrno(L);
+		}
+		if (w->used == WRITER_BUFFER_SIZE)
+			writer_flush(w);
+	}
+
+	lua_pushboolean(L, !check || (crc == expected));
+	return 1;
+}
+
+/* writer:close(): flushes, syncs and closes the file. Returns true, or nil
+ * and an error message. */
+
+static int writer_close_cb(lua_State* L)
+{
+	struct writer* w = checkwriter(L, 1);
+
+	writer_flush(w);
+	if (!w->error && (fflush(w->fp) != 0))
+		w->error = errno;
+	#if defined WIN32
+		if (!w->error && (_commit(_fileno(w->fp)) != 0))
+			w->error = errno;
+	#else
+		if (!w->error && (fsync(fileno(w->fp)) != 0))
+			w->error = errno;
+	#endif
+	if ((fclose(w->fp) != 0) && !w->error)
+		w->error = errno;
+	w->fp = NULL;
+
+	if (w->error)
+	{
+		errno = w->error;
+		return pusherrno(L);
+	}
+
+	lua_pushboolean(L, true);
+	return 1;
+}
+
+static int writer_gc_cb(lua_State* L)
+{
+	struct writer* w = luaL_checkudata(L, 1, WRITER_METATABLE);
+	if (w->fp)
+	{
+		fclose(w->fp);
+		w->fp = NULL;
+	}
+	return 0;
+}
+
+/* Slow background work (such as autosaving) is done in a forked child, which
+ * gets a copy-on-write snapshot of the whole Lua state for free. fork()
+ * returns the child's pid in the parent and 0 in the child, or nil and an
+ * error where that's not possible. */
+
+static int fork_cb(lua_State* L)
+{
+	#if defined WIN32
+		errno = ENOSYS;
+		return pusherrno(L);
+	#else
+		pid_t pid = fork();
+		if (pid == -1)
+			return pusherrno(L);
+
+		lua_pushinteger(L, pid);
+		return 1;
+	#endif
+}
+
+/* waitchild(pid): returns false if the child is still running, or its exit
+ * status once it's finished. Never blocks. */
+
+static int waitchild_cb(lua_State* L)
+{
+	#if defined WIN32
+		errno = ENOSYS;
+		return pusherrno(L);
+	#else
+		pid_t pid = forceinteger(L, 1);
+		int status;
+		pid_t r = waitpid(pid, &status, WNOHANG);
+		if (r == -1)
+			return pusherrno(L);
+		if (r == 0)
+		{
+			lua_pushboolean(L, false);
+			return 1;
+		}
+
+		lua_pushinteger(L, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+		return 1;
+	#endif
+}
+
+/* exitchild(status): terminates a forked child immediately. This skips the
+ * atexit handlers, so the child doesn't reset the terminal or close the
+ * display connection it shares with the parent. */
+
+static int exitchild_cb(lua_State* L)
+{
+	_exit(forceinteger(L, 1));
+	return 0;
+}
+
 void filesystem_init(void)
 {
+	const static luaL_Reg writer_funcs[] =
+	{
+		{ "write",                     writer_write_cb },
+		{ "tell",                      writer_tell_cb },
+		{ "checksum",                  writer_checksum_cb },
+		{ "copy",                      writer_copy_cb },
+		{ "close",                     writer_close_cb },
+		{ NULL,                        NULL }
+	};
+
+	luaL_newmetatable(L, WRITER_METATABLE);
+	lua_newtable(L);
+	luaL_setfuncs(L, writer_funcs, 0);
+	lua_setfield(L, -2, "__index");
+	lua_pushcfunction(L, writer_gc_cb);
+	lua_setfield(L, -2, "__gc");
+	lua_pop(L, 1);
+
 	const static luaL_Reg funcs[] =
 	{
 		{ "chdir",                     chdir_cb },
@@ -164,6 +474,10 @@ void filesystem_init(void)
 		{ "readdir",                   readdir_cb },
 		{ "stat",                      stat_cb },
 		{ "access",                    access_cb },
+		{ "openwriter",                openwriter_cb },
+		{ "fork",                      fork_cb },
+		{ "waitchild",                 waitchild_cb },
+		{ "exitchild",                 exitchild_cb },
 		{ NULL,                        NULL }
 	};
 
@@ -76,6 +76,7 @@ extern void script_run(const char* argv[]);
 #if !defined LUA_VERSION_NUM || LUA_VERSION_NUM==501
 extern void luaL_setfuncs(lua_State *L, const luaL_Reg *l, int nup);
 #define lua_pushglobaltable(L) lua_pushvalue(L, LUA_GLOBALSINDEX)
+#define lua_rawlen(L, index) lua_objlen(L, index)
 #endif
 
 #define forceinteger(L, offset) (int)lua_tonumber(L, offset)
@@ -94,6 +95,10 @@ extern void word_init(void);
 
 extern void zip_init(void);
 
+/* --- XML tokenising ---------------------------------------------------- */
+
+extern void xml_init(void);
+
 /* UNRTF */
 extern void unrtf_init(void);
 
@@ -115,6 +120,10 @@ extern void writeu8(char** ptr, uni_t value);
 extern void utils_init(void);
 extern void filesystem_init(void);
 
+struct writer;
+extern struct writer* checkwriter(lua_State* L, int index);
+extern void writer_write(struct writer* w, const char* data, size_t size);
+
 /* --- Display layer ----------------------------------------------------- */
 
 enum
@@ -136,6 +145,7 @@ extern void dpy_shutdown(void);
 
 extern void dpy_setattr(int andmask, int ormask);
 extern void dpy_writechar(int x, int y, uni_t c);
+extern void dpy_writespan(int x, int y, const uni_t* s, int n);
 extern void dpy_setcursor(int x, int y, bool shown);
 extern void dpy_clearscreen(void);
 extern void dpy_sync(void);
@@ -144,4 +154,18 @@ extern void dpy_getscreensize(int* x, int* y);
 extern uni_t dpy_getchar(double timeout);
 extern const char* dpy_getkeyname(uni_t key);
 
+/* Returns the text which arrived with the last KEY_PASTE. */
+extern const char* dpy_getpaste(size_t* len);
+
+struct glyphcachestats
+{
+	unsigned long hits, misses, evictions;
+	unsigned long count;         /* number of glyphs cached */
+	size_t size;                 /* bytes used by cached glyphs */
+	size_t budget;               /* maximum bytes to use */
+};
+
+/* Backends without a glyph cache report zeroes. */
+extern void dpy_getglyphcachestats(struct glyphcachestats* stats);
+
 #endif
@@ -3764,16 +3764,29 @@ static void papxFkp_init(
 		struct PapxFkp *papxFkp, BYTE buf[512],
 		FILE *fp, ULONG offset)
 {
+	// on error leave an empty PapxFkp, so that every fc is
+	// outside it
 	memset(buf, 0, 512);
+	papxFkp->cpara = 0;
+	papxFkp->rgfc = (ULONG *)buf;
+	papxFkp->rgbx = (struct BxPap *)(&(buf[4]));
 	fseek(fp, offset, SEEK_SET);
 	if (fread(buf, 512, 1, fp) != 1)
 	{
 		ERR("fread");
+		memset(buf, 0, 512);
+		return;
+	}
+
+	// cpara MUST NOT exceed 0x1D, or rgfc and rgbx would not
+	// fit in 512 bytes
+	if (buf[511] > 0x1D){
+		ERR("PapxFkp->cpara: %d", buf[511]);
+		memset(buf, 0, 512);
 		return;
 	}
 
 	papxFkp->cpara = buf[511];
-	papxFkp->rgfc = (ULONG *)buf;
 	papxFkp->rgbx = (struct BxPap *)(&(buf[(papxFkp->cpara + 1)*4]));
 #ifdef DEBUG
 LOG("PapxFkp->cpara: %d", papxFkp->cpara);
@@ -3840,16 +3853,27 @@ static void chpxFkp_init(
 		struct ChpxFkp *chpxFkp, BYTE buf[512],
 		FILE *fp, ULONG offset)
 {
+	// on error leave an empty ChpxFkp, so that every fc is
+	// outside it
 	memset(buf, 0, 512);
+	chpxFkp->crun = 0;
+	chpxFkp->rgfc = (ULONG *)buf;
+	chpxFkp->rgb = &(buf[4]);
 	fseek(fp, offset, SEEK_SET);
 	if (fread(buf, 512, 1, fp) != 1)
 	{
 		ERR("fread");
+		memset(buf, 0, 512);
+		return;
+	}
+
+	if (buf[511] > 0x65){
+		ERR("ChpxFkp->crun: %d", buf[511]);
+		memset(buf, 0, 512);
 		return;
 	}
 
 	chpxFkp->crun = buf[511];
-	chpxFkp->rgfc = (ULONG *)buf;
 	chpxFkp->rgb = &(buf[(chpxFkp->crun + 1)*4]);
 #ifdef DEBUG
 LOG("ChpxFkp->cpara: %d", chpxFkp->crun);
@@ -4395,6 +4419,9 @@ struct STSH {
 										//the order in the following table.
 										//istd sti of application-defined style
 										//(see sti in StdfBase)
+	ULONG cbrglpstd; //size, in bytes, of rglpstd; not in
+										//the file, it is what is left of
+										//the lcbStshf bytes after lpstshi
 };
 
 struct STSH *STSH_get(FILE *fp, 
@@ -4403,7 +4430,7 @@ struct STSH *STSH_get(FILE *fp,
 void STSH_free(struct STSH *stsh);
 
 struct LPStd *LPStd_at_index(
-		BYTE *rglpstd, int cstd, int index);
+		BYTE *rglpstd, ULONG size, int cstd, int index);
 
 /* 2.9.336 UpxChpx
  * The UpxChpx structure specifies the character formatting
@@ -5853,11 +5880,27 @@ struct PlcfSed {
  * MS-DOC Structure.
  */
 
+/* character properties of the last run of text looked up by
+ * direct_character_formatting - they only depend on the run
+ * and on the paragraph properties, so they are worked out
+ * once per run rather than once per character */
+struct ChpxRun {
+	ULONG fcFirst;        //run is from fcFirst to fcLim in
+	ULONG fcLim;          //the WordDocument stream
+	CHP pap_chp;          //paragraph properties used
+	CHP chp;              //result
+};
+
 typedef struct cfb_doc 
 {
 	FILE *WordDocument;   //document stream
 	FILE *Table;          //table stream
 	FILE *Data;           //data stream
+
+	BYTE *WordDocumentBuf; //document stream read into memory
+	ULONG WordDocumentLen; //size of document stream
+	ULONG iPcd;           //last piece used by get_char_for_cp
+	struct ChpxRun chpxRun;
 	
 	Fib  fib;             //File information block
 	struct Clx clx;       //clx data
@@ -5871,6 +5914,8 @@ typedef struct cfb_doc
 	struct PlcfSed *plcfSed;
 	int plcfSedNaCP;      // number of aCP in plcfSed;
 	struct STSH STSH;     // style sheet 
+	int styleDepth;       // styles being applied, one inside
+	                      // another
 	ldp_t prop;           // properties
 } cfb_doc_t;
 
@@ -20,6 +20,9 @@ extern "C"{
 #include <string.h>
 #include <errno.h>
 #include <sys/types.h>
+#if !defined WIN32
+#include <sys/mman.h>
+#endif
 
 #include "byteorder.h"
 #include "log.h"
@@ -418,7 +421,17 @@ static const unsigned char cfb_signature_old[8] =
  */
 struct cfb {
 	FILE * fp;         // pointer to file
-	FILE * ministream; // pointer to ministream
+	BYTE * data;       // contents of file
+	size_t size;       // size of file
+	bool mapped;       // data is mmap'd rather than malloc'd
+	SECT * fat;        // FAT
+	ULONG nfat;        // number of entries in FAT
+	SECT * minifat;    // miniFAT
+	ULONG nminifat;    // number of entries in miniFAT
+	BYTE * ministream; // ministream data
+	ULONG ministreamSize;
+	BYTE ** buffers;   // copies of streams which aren't contiguous
+	int nbuffers;
 	cfb_header header;
 	cfb_dir root;
 	bool biteOrder;
@@ -506,220 +519,197 @@ static size_t _utf16_to_utf8(WORD * utf16, int len, char * utf8){
  or more FAT sectors.
  */
 
-static SECT _cfb_next_sect_in_FAT_chain(SECT sect, struct cfb * cfb){
 /*
- * The FAT is an array of sector numbers that represent the
- * allocation of space within the file, grouped into FAT
- * sectors. Each stream is represented in the FAT by a
- * sector chain, in much the same fashion as a FAT file
- * system.
- */	
-#ifdef DEBUG
-	LOG("get next SECT in FAT chain for: 0x%x:\t", sect);
-#endif		
-	int i;
+ * The whole compound file is mapped (or, where there is no
+ * mmap, read) into memory when it is opened, and the FAT and
+ * miniFAT are read into arrays, so following a chain is an
+ * array lookup rather than several seeks and reads per
+ * sector.
+ */
 
-	if (sect > MAXSECT)
-		return ENDOFCHAIN;	
+static SECT _cfb_sect(struct cfb * cfb, const BYTE * p){
+	SECT sect;
+	memcpy(&sect, p, 4);
+	if (cfb->biteOrder) 
+		sect = bswap_32(sect);
+	return sect;
+}
+
+// return pointer to the data of (FAT) sector sect, or NULL
+static BYTE * _cfb_sector(struct cfb * cfb, SECT sect){
+	size_t ssize = (size_t)1 << cfb->header._uSectorShift;
+	size_t off = ((size_t)sect + 1) * ssize;
+	if (sect > MAXSECT || off + ssize > cfb->size)
+		return NULL;
+	return cfb->data + off;
+}
 
+static int _cfb_read_fat(struct cfb * cfb){
 /*
- * If Header Major Version is 3, there MUST be 128 fields
- * specified to fill a 512-byte sector.  If Header Major
- * Version is 4, there MUST be 1,024 fields specified to
- * fill a 4,096-byte sector.
+ * The FAT is an array of sector numbers that represent the
+ * allocation of space within the file, grouped into FAT
+ * sectors. If Header Major Version is 3, there MUST be 128
+ * fields specified to fill a 512-byte sector.  If Header
+ * Major Version is 4, there MUST be 1,024 fields specified
+ * to fill a 4,096-byte sector.
  */	
-	DWORD ssize = 1 << cfb->header._uSectorShift; //sector size
-	FSINDEX SECTn = ssize/4; // number of sectors in FAT
+	size_t ssize = (size_t)1 << cfb->header._uSectorShift;
+	ULONG SECTn = ssize / 4; // number of sectors in FAT sector
+	ULONG n = cfb->header._csectFat;
+	if ((size_t)n * ssize > cfb->size){
+		ERR("too many FAT sectors: %u", n);
+		return CFB_FAT_ERR;
+	}
+
+	cfb->fat = malloc((size_t)n * ssize + 4);
+	if (!cfb->fat)
+		return CFB_ALLOC_ERR;
+	cfb->nfat = n * SECTn;
 
 /* The DIFAT sectors are linked together by the last field
  * in each DIFAT sector. As an optimization, the first 109
- * FAT sectors are represented within the header itself.  No
- * DIFAT sectors are needed in a compound file that is
- * smaller than 6.875 megabytes (MB) for a 512-byte sector
- * compound file (6.875 MB = (1 header sector + 109 FAT
- * sectors x 128 non-empty entries) × 512 bytes per sector).
+ * FAT sectors are represented within the header itself.
  */ 
-	if (sect < ssize * 109){ // FAT is in header
-
-		FSINDEX FAT_INDEX = sect / SECTn;
-		FSINDEX SECT_INDEX = sect - (FAT_INDEX * SECTn);
-
-		// get SECT offset
-		SECT FAT = cfb->header._sectFat[FAT_INDEX];
-		if (cfb->biteOrder) 
-			FAT = bswap_32(FAT);		
-		DWORD off = 
-			FAT * ssize + ssize
-			+ SECT_INDEX * 4;
-		// seek to offset
-		fseek(cfb->fp, off, SEEK_SET);
-
-		// read sect
-		SECT ch;
-		if (fread(&ch, 4, 1, cfb->fp) != 1){
-#ifdef DEBUG
-	LOG("Error to read SECT from offset: %u", off);
-#endif		
-			return ENDOFCHAIN;
-		};
-		if (cfb->biteOrder) 
-			ch = bswap_32(ch);		
-
-#ifdef DEBUG
-	LOG("0x%x", ch);
-#endif		
-		return ch;
+	SECT DIFAT = cfb->header._sectDifStart;
+	ULONG i, j;
+	for (i = 0; i < n; ++i) {
+		SECT FAT;
+		if (i < 109){
+			FAT = cfb->header._sectFat[i];
+			if (cfb->biteOrder) 
+				FAT = bswap_32(FAT);		
+		} else {
+			ULONG k = (i - 109) % (SECTn - 1);
+			BYTE * d = _cfb_sector(cfb, DIFAT);
+			if (k == 0 && i != 109){
+				// next DIFAT is in the last field
+				if (!d){
+					ERR("can't read DIFAT sector: %u", DIFAT);
+					return CFB_DIF_ERR;
+				}
+				DIFAT = _cfb_sect(cfb, d + (SECTn - 1) * 4);
+				d = _cfb_sector(cfb, DIFAT);
+			}
+			if (!d){
+				ERR("can't read DIFAT sector: %u", DIFAT);
+				return CFB_DIF_ERR;
+			}
+			FAT = _cfb_sect(cfb, d + k * 4);
+		}
 
-	} 
-// FAT is in DIFAT
+		BYTE * p = _cfb_sector(cfb, FAT);
+		if (!p){
+			ERR("can't read FAT sector: %u", FAT);
+			return CFB_FAT_ERR;
+		}
+		for (j = 0; j < SECTn; ++j)
+			cfb->fat[i * SECTn + j] = _cfb_sect(cfb, p + j * 4);
+	}
 
-/* DIFAT
- * double-indirect file allocation table (DIFAT): A
- * structure that is used to locate FAT sectors in a
- * compound file.
- *
- *		FAT Sector Location (variable): This field specifies
- *		the FAT sector number in a DIFAT.  If Header Major
- *		Version is 3, there MUST be 127 fields specified to
- *		fill a 512-byte sector minus the "Next DIFAT Sector
- *		Location" field.  If Header Major Version is 4, there
- *		MUST be 1,023 fields specified to fill a 4,096-byte
- *		sector minus the "Next DIFAT Sector Location" field.
-*/	
-	
-	FSINDEX FATn = 127; //number of FAT sectors in DIFAT
-	if (cfb->header._uDllVersion == 4)
-		FATn = 1023;
-	
-	FSINDEX DIFAT_INDEX = (sect - SECTn * 109) / FATn * SECTn;
-	FSINDEX FAT_INDEX   = sect - (SECTn * 109) - (DIFAT_INDEX * SECTn);
-	FSINDEX SECT_INDEX  = sect - (SECTn * 109) - (DIFAT_INDEX * SECTn) - (FAT_INDEX * SECTn);
+	return 0;
+}
 
-	// get DIFAT 
-	SECT DIFAT = cfb->header._sectDifStart;
-	for (i = 0; i < DIFAT_INDEX; ++i) {
-		// next DIFAT is in 128 (1024) field 
-		DWORD off = DIFAT * ssize + ssize + (FATn * 4); 
-		fseek(cfb->fp, off, SEEK_SET);
-		SECT ch;
-		if (fread(&ch, 4, 1, cfb->fp) != 1){
-#ifdef DEBUG
-	LOG("Error to read DIFAT from offset: %u", off);
-#endif		
-			return ENDOFCHAIN;
-		};
-		if (cfb->biteOrder) 
-			ch = bswap_32(ch);
-		DIFAT = ch;	
+/* Follows the chain starting at sect through fat, and
+ * returns the number of sectors in it, with the sectors
+ * themselves in *chain (which must be freed); or -1 if the
+ * chain is broken. */
+static long _cfb_chain(const SECT * fat, ULONG nfat, SECT sect,
+		SECT ** chain)
+{
+	size_t n = 0, len = 16;
+	SECT * c = malloc(len * sizeof(SECT));
+	if (!c)
+		return -1;
+	while (sect != ENDOFCHAIN) {
+		// a chain can't be longer than the FAT without looping
+		if (sect >= nfat || n >= nfat){
+			free(c);
+			return -1;
+		}
+		if (n == len){
+			len *= 2;
+			SECT * nc = realloc(c, len * sizeof(SECT));
+			if (!nc){
+				free(c);
+				return -1;
+			}
+			c = nc;
+		}
+		c[n++] = sect;
+		sect = fat[sect];
 	}
-	// get FAT 
-	SECT FAT;
-	DWORD off = DIFAT * ssize + ssize + (FAT_INDEX * 4); 
-	fseek(cfb->fp, off, SEEK_SET);
-	SECT ch;
-	if (fread(&ch, 4, 1, cfb->fp) != 1){
-#ifdef DEBUG
-	LOG("Error to read FAT from offset: %u", off);
-#endif		
-		return ENDOFCHAIN;
-	};
-	if (cfb->biteOrder) 
-		ch = bswap_32(ch);
-	FAT = ch;	
-
-	// get SECT offset
-	off = FAT * ssize + ssize + (SECT_INDEX * 4);
-	// seek to offset
-	fseek(cfb->fp, off, SEEK_SET);
-	if (fread(&ch, 4, 1, cfb->fp) != 1){
-#ifdef DEBUG
-	LOG("Error to read SECT from offset: %u", off);
-#endif		
-		return ENDOFCHAIN;
-	};
-	if (cfb->biteOrder) 
-		ch = bswap_32(ch);
-#ifdef DEBUG
-	LOG("0x%x", ch);
-#endif		
-	return ch;	
+	*chain = c;
+	return n;
 }
 
-static SECT _cfb_next_sect_in_mFAT_chain(SECT sect, struct cfb * cfb){
+static int _cfb_read_minifat(struct cfb * cfb){
 /*
  *  The mini FAT is used to allocate space in the mini
  *  stream. The mini stream is divided into smaller,
  *  equal-length sectors, and the sector size that is used
  *  for the mini stream is specified from the Compound File
- *  Header (64 bytes).
+ *  Header (64 bytes). The mini FAT itself is stored in a
+ *  chain in the FAT, like any other stream.
  */	
+	size_t ssize = (size_t)1 << cfb->header._uSectorShift;
+	ULONG SECTn = ssize / 4;
+	SECT * chain;
+	long n = _cfb_chain(cfb->fat, cfb->nfat, 
+			cfb->header._sectMiniFatStart, &chain);
+	if (n < 0){
+		ERR("broken miniFAT chain");
+		return CFB_MFAT_ERR;
+	}
 
-#ifdef DEBUG
-	LOG("get next SECT in mFAT chain for: 0x%x:\t", sect);
-#endif		
-	int i;
-
-	if (sect > MAXSECT)
-		return ENDOFCHAIN;	
-
-/*
- * The mini stream is chained within the FAT in exactly the
- * same fashion as any normal stream.  The mini stream's
- * starting sector is referenced in the first directory
- * entry (root storage stream ID 0).
- */	
-	DWORD ssize = 1 << cfb->header._uSectorShift; //sector size - for mFAT it is 512(4096)
-	FSINDEX SECTn = ssize/4; // number of sectors in mFAT
-	
-	FSINDEX mFAT_INDEX = sect / SECTn;
-	FSINDEX SECT_INDEX = sect - (mFAT_INDEX * SECTn);
-
-	// get FAT 
-	SECT mFAT = cfb->header._sectMiniFatStart;
-	for (i = 0; i < mFAT_INDEX; ++i) {
-		// next mFAT is in FAT chain
-		mFAT = _cfb_next_sect_in_FAT_chain(mFAT, cfb); 
+	cfb->minifat = malloc(n * ssize + 4);
+	if (!cfb->minifat){
+		free(chain);
+		return CFB_ALLOC_ERR;
 	}
-	
-	// get SECT offset
-	DWORD off = mFAT * ssize + ssize + (SECT_INDEX * 4);
-	// seek to offset
-	fseek(cfb->fp, off, SEEK_SET);
-	SECT ch;
-	if (fread(&ch, 4, 1, cfb->fp) != 1){
-#ifdef DEBUG
-	LOG("Error to read SECT from offset: %u", off);
-#endif		
-		return ENDOFCHAIN;
-	};
-	if (cfb->biteOrder) 
-		ch = bswap_32(ch);
-#ifdef DEBUG
-	LOG("0x%x", ch);
-#endif		
-	return ch;	
+	cfb->nminifat = n * SECTn;
+
+	long i;
+	ULONG j;
+	for (i = 0; i < n; ++i) {
+		BYTE * p = _cfb_sector(cfb, chain[i]);
+		if (!p){
+			ERR("can't read miniFAT sector: %u", chain[i]);
+			free(chain);
+			return CFB_MFAT_ERR;
+		}
+		for (j = 0; j < SECTn; ++j)
+			cfb->minifat[i * SECTn + j] = _cfb_sect(cfb, p + j * 4);
+	}
+
+	free(chain);
+	return 0;
 }
 
 static int cfb_dir_name(cfb_dir * dir, char * name){
+	// _cb is the length of the name in bytes, including the
+	// terminating null; the characters are little-endian
 	int size = dir->_cb/2;
-	WORD ab[size];
-	int i, c;
-	for (i = 0, c = 0; i < dir->_cb; ++i, ++c) {
-		char ch0 = dir->_ab[i++];	
-		char ch1 = dir->_ab[i];	
-		if (ch1 == 0)
-			ab[c] = ch0;
-		else
-			ab[c] = (ch0 << 8) + ch1;
-	}
-
-	if (!_utf16_to_utf8(ab, dir->_cb, name))
+	if (size > 32)
+		size = 32;
+	WORD ab[32];
+	int c;
+	for (c = 0; c < size; ++c)
+		ab[c] = dir->_ab[c*2] | (dir->_ab[c*2 + 1] << 8);
+
+	if (!_utf16_to_utf8(ab, size, name))
 		return -1;
 
 	return 0;
 }
 
-static FILE * cfb_get_stream_by_dir(struct cfb * cfb, cfb_dir * dir) {
+/* Returns the data of the stream described by dir, and its
+ * size in *size. If its sectors are contiguous (as they
+ * usually are), this points straight into the file data;
+ * otherwise they're copied into a buffer, which belongs to
+ * cfb and is freed by cfb_close. */
+static BYTE * cfb_get_stream_data(struct cfb * cfb, cfb_dir * dir,
+		ULONG * size)
+{
 #ifdef DEBUG
 	char dirname[BUFSIZ];
 	cfb_dir_name(dir, dirname);	
@@ -731,93 +721,142 @@ static FILE * cfb_get_stream_by_dir(struct cfb * cfb, cfb_dir * dir) {
 #ifdef DEBUG
 	LOG("stream size: %u", st);
 #endif
-	SECT  sect = dir->_sectStart; // start position in FAT/miniFAT chain
-#ifdef DEBUG
-	LOG("stream start sector: 0x%x", dir->_sectStart);
-#endif
 
-	DWORD ssize;  //sector size	
-	DWORD sstart; //start for sectors - 0 for mFAT, ssize for FAT; 
-	FILE * fp;    // file pointer - ministream for mFAT, main stream for FAT
-	SECT (*get_next_sect)(SECT sect, struct cfb * cfb); // get next sect function
+	size_t ssize;    //sector size	
+	size_t sstart;   //start for sectors - 0 for mFAT, ssize for FAT; 
+	BYTE * base;     //ministream for mFAT, file for FAT
+	size_t basesize;
+	const SECT * fat;
+	ULONG nfat;
 	
 	//check FAT or miniFAT
 	//use miniFAT is size < 4096
 	//for root always use FAT
 	if (st < cfb->header._ulMiniSectorCutoff && dir->_mse != STGTY_ROOT){
-#ifdef DEBUG
-	LOG("stream is minifat");
-#endif		
 		//use miniFAT
-		ssize = 1 << cfb->header._uMiniSectorShift;
+		ssize = (size_t)1 << cfb->header._uMiniSectorShift;
 		sstart = 0;
-		fp = cfb->ministream;
-		get_next_sect = _cfb_next_sect_in_mFAT_chain;
+		base = cfb->ministream;
+		basesize = cfb->ministreamSize;
+		fat = cfb->minifat;
+		nfat = cfb->nminifat;
 	}
 	else {
-#ifdef DEBUG
-	LOG("stream is fat");
-#endif				
 		//use FAT
-		ssize = 1 << cfb->header._uSectorShift;
+		ssize = (size_t)1 << cfb->header._uSectorShift;
 		sstart = ssize;
-		fp = cfb->fp;
-		get_next_sect = _cfb_next_sect_in_FAT_chain;
+		base = cfb->data;
+		basesize = cfb->size;
+		fat = cfb->fat;
+		nfat = cfb->nfat;
 	} 
-	
-	DWORD off = sect * ssize + sstart; //offset
-	
-#ifdef DEBUG
-	LOG("sectorsize: %d", ssize);
-	LOG("offset: %d"    , off  );
-#endif				
-	
-	//create stream
-	FILE * stream = tmpfile();
 
-	//copy data
-	while (sect != ENDOFCHAIN) {
-		// seek to start offset
-		fseek(fp, off, SEEK_SET);
-
-		// read/write data
-		char buf[ssize];
-		if (fread (buf, ssize, 1,
-					fp) != 1)
-		{
-			ERR("fread");
+	SECT * chain;
+	long n = _cfb_chain(fat, nfat, dir->_sectStart, &chain);
+	if (n < 0 || (size_t)n * ssize < st){
+		ERR("broken sector chain");
+		if (n >= 0)
+			free(chain);
+		return NULL;
+	}
+
+	// check that every sector is in the file, and see if
+	// they're all in a row
+	n = (st + ssize - 1) / ssize;
+	bool contiguous = true;
+	long i;
+	for (i = 0; i < n; ++i) {
+		size_t need = st - i * ssize;
+		if (need > ssize)
+			need = ssize;
+		if (chain[i] * ssize + sstart + need > basesize){
+			ERR("sector is outside the file: %u", chain[i]);
+			free(chain);
 			return NULL;
 		}
-		fwrite(buf, ssize, 1, stream );
-		
-		// get next FAT/miniFAT
-		sect = get_next_sect(sect, cfb);
+		if (chain[i] != chain[0] + i)
+			contiguous = false;
+	}
 
-		// get next offset 
-		off = sect * ssize + sstart;
+	*size = st;
+	BYTE * data = base;
+	if (n > 0)
+		data = base + chain[0] * ssize + sstart;
+
+	if (!contiguous){
+		BYTE ** buffers = realloc(cfb->buffers, 
+				(cfb->nbuffers + 1) * sizeof(BYTE *));
+		if (buffers)
+			cfb->buffers = buffers;
+		data = buffers ? malloc(st) : NULL;
+		if (!data){
+			free(chain);
+			return NULL;
+		}
+		cfb->buffers[cfb->nbuffers++] = data;
+
+		for (i = 0; i < n; ++i) {
+			size_t need = st - i * ssize;
+			if (need > ssize)
+				need = ssize;
+			memcpy(data + i * ssize, 
+					base + chain[i] * ssize + sstart, need);
+		}
 	}
 
-	fseek(stream, 0, SEEK_SET);
+	free(chain);
+	return data;	
+}
+
+/* Returns the stream described by dir as a FILE. This reads
+ * straight from memory where possible, so cfb must not be
+ * closed before the stream is. */
+static FILE * cfb_get_stream_by_dir(struct cfb * cfb, cfb_dir * dir) {
+	ULONG size;
+	BYTE * data = cfb_get_stream_data(cfb, dir, &size);
+	if (!data)
+		return NULL;
+
+#if defined WIN32
+	FILE * stream = tmpfile();
+	if (stream){
+		fwrite(data, size, 1, stream);
+		fseek(stream, 0, SEEK_SET);
+	}
+#else
+	FILE * stream;
+	if (size)
+		stream = fmemopen(data, size, "rb");
+	else
+		stream = fmemopen(NULL, 1, "w+b");
+#endif
+	if (!stream)
+		ERR("can't open stream");
 	return stream;	
 }
 
 static int cfb_dir_by_sid(struct cfb * cfb, SID sid, void * user_data,
 		int (*callback)(void * user_data, cfb_dir dir))
 {
-	int i;
+	// the directory is a chain of sectors, each holding 
+	// ssize/128 entries
+	size_t ssize = (size_t)1 << cfb->header._uSectorShift;
+	ULONG n = ssize / sizeof(cfb_dir);
+	SECT sect = cfb->header._sectDirStart;
+	ULONG i;
+	for (i = 0; i < sid / n; ++i) {
+		if (sect >= cfb->nfat)
+			return -1;
+		sect = cfb->fat[sect];
+	}
 	
-	//goto dir data
-	ULONG p = 
-		512 
-		+ sid*sizeof(cfb_dir) 
-		+ (cfb->header._sectDirStart << cfb->header._uSectorShift);
-	fseek(cfb->fp, p, SEEK_SET);
+	BYTE * p = _cfb_sector(cfb, sect);
+	if (!p)
+		return -1;
 
 	//copy dir data
 	cfb_dir dir;
-
-	if (fread(&dir, sizeof(cfb_dir), 1, cfb->fp) != 1)
-		return -1;
+	memcpy(&dir, p + (sid % n) * sizeof(cfb_dir), sizeof(cfb_dir));
 
 	if (cfb->biteOrder)
 		_cfb_dir_sw(&dir);
@@ -860,13 +899,16 @@ static int _cfb_dir_find(struct cfb *cfb, cfb_dir * dir, const char * name, void
 		res = 1;
 	else 
 		res = strcmp(name, dirname);
-	if (res == 0)
+	if (res == 0){
 		callback(user_data, *dir);
+		return 0;
+	}
 	if (res < 0){
 		//check left
 		if (dir->_sidLeftSib != -1){
 			cfb_dir new_dir;
-			cfb_dir_by_sid(cfb, dir->_sidLeftSib, &new_dir, cfb_dir_callback);
+			if (cfb_dir_by_sid(cfb, dir->_sidLeftSib, &new_dir, cfb_dir_callback))
+				return -1;
 
 			return _cfb_dir_find(cfb, &new_dir, name, user_data, callback);
 		}
@@ -875,11 +917,13 @@ static int _cfb_dir_find(struct cfb *cfb, cfb_dir * dir, const char * name, void
 		if (dir->_sidRightSib != -1){
 
 			cfb_dir new_dir;
-			cfb_dir_by_sid(cfb, dir->_sidRightSib, &new_dir, cfb_dir_callback);
+			if (cfb_dir_by_sid(cfb, dir->_sidRightSib, &new_dir, cfb_dir_callback))
+				return -1;
 			return _cfb_dir_find(cfb, &new_dir, name, user_data, callback);
 		}	
 	}
-	return 0;
+	// no such entry
+	return -1;
 }
 static int cfb_dir_by_name(struct cfb * cfb, const char * name, void * user_data,
 		int (*callback)(void * user_data, cfb_dir dir))
@@ -889,7 +933,8 @@ static int cfb_dir_by_name(struct cfb * cfb, const char * name, void * user_data
 #endif		
 	
 	cfb_dir dir;
-	cfb_get_dir_by_sid(cfb, &dir, cfb->root._sidChild);
+	if (cfb_get_dir_by_sid(cfb, &dir, cfb->root._sidChild))
+		return -1;
 	return _cfb_dir_find(cfb, &dir, name, user_data, callback);
 }
 
@@ -932,6 +977,36 @@ static FILE * cfb_get_stream_by_name(struct cfb * cfb, const char * name) {
 			cfb_dir *:   cfb_get_stream_by_dir \
 	)((cfb), (arg))	
 
+static int _cfb_load(struct cfb * cfb){
+	FILE * fp = cfb->fp;
+	if (fseek(fp, 0, SEEK_END))
+		return CFB_READ_ERR;
+	long size = ftell(fp);
+	if (size < 512)
+		return CFB_READ_ERR;
+	cfb->size = size;
+
+#if !defined WIN32
+	void * data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, 
+			fileno(fp), 0);
+	if (data != MAP_FAILED){
+		cfb->data = data;
+		cfb->mapped = true;
+		return 0;
+	}
+#endif
+
+	cfb->data = malloc(size);
+	if (!cfb->data)
+		return CFB_ALLOC_ERR;
+	fseek(fp, 0, SEEK_SET);
+	if (fread(cfb->data, size, 1, fp) != 1)
+		return CFB_READ_ERR;
+	return 0;
+}
+
+static void cfb_close(struct cfb * cfb);
+
 static int _cfb_init(struct cfb * cfb, FILE *fp){
 #ifdef DEBUG
 	LOG("start");
@@ -1031,17 +1106,48 @@ static int _cfb_init(struct cfb * cfb, FILE *fp){
 		return CFB_SIG_ERR;
 	}
 
+	/* sectors are 512 bytes (version 3) or 4096 bytes (version 4),
+	 * mini sectors are always 64 bytes; everything below shifts by
+	 * these, so don't trust anything else */
+	if ((cfb->header._uSectorShift != 9 && cfb->header._uSectorShift != 12) ||
+			cfb->header._uMiniSectorShift != 6){
+#ifdef DEBUG
+	LOG("wrong sector shift: %d, mini sector shift: %d",
+			cfb->header._uSectorShift, cfb->header._uMiniSectorShift);
+#endif
+		ERR("can't read MS CFB file");
+		return CFB_HEADER_ERR;
+	}
+
+	error = _cfb_load(cfb);
+	if (error)
+		return error;
+
+	error = _cfb_read_fat(cfb);
+	if (error)
+		return error;
+
+	if (cfb_get_dir_by_sid(cfb, &(cfb->root), 0)){
+		ERR("can't read root directory entry");
+		return CFB_ROOT_ERR;
+	}
+
 	if (cfb->header._csectMiniFat > 0){
 #ifdef DEBUG
 	LOG("get mini stream");
 #endif									 
+		error = _cfb_read_minifat(cfb);
+		if (error)
+			return error;
 /*
  * The mini stream is chained within the FAT in exactly the same fashion as any normal stream. 
  * The mini stream's starting sector is referenced in the first directory entry (root storage 
  * stream ID 0).
  */	
-		cfb_get_dir_by_sid(cfb, &(cfb->root), 0);
-		cfb->ministream = cfb_get_stream_by_dir(cfb, &(cfb->root));
+		cfb->ministream = cfb_get_stream_data(cfb, &(cfb->root),
+				&(cfb->ministreamSize));
+		if (!cfb->ministream)
+			return CFB_ROOT_ERR;
 
 	} else {
 		LOG("No miniFAT stream in file\n");
@@ -1086,7 +1192,10 @@ static int cfb_open(struct cfb * cfb, const char * filename){
 		newfile=fp;
 	}	
 	
-	return _cfb_init(cfb, newfile); 
+	int error = _cfb_init(cfb, newfile); 
+	if (error)
+		cfb_close(cfb);
+	return error;
 };
 
 
@@ -1172,7 +1281,20 @@ static int cfb_get_dirs(struct cfb * cfb, void * user_data,
 }
 
 static void cfb_close(struct cfb * cfb){
-	fclose(cfb->ministream);
+	int i;
+	for (i = 0; i < cfb->nbuffers; ++i)
+		free(cfb->buffers[i]);
+	free(cfb->buffers);
+	free(cfb->fat);
+	free(cfb->minifat);
+	if (cfb->data){
+#if !defined WIN32
+		if (cfb->mapped)
+			munmap(cfb->data, cfb->size);
+		else
+#endif
+			free(cfb->data);
+	}
 	fclose(cfb->fp);
 }
 
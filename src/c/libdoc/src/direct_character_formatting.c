@@ -47,6 +47,16 @@ void direct_character_formatting(
 	LOG("start");
 #endif
 
+	// the properties are the same for the whole of a run, as
+	// long as the paragraph's properties haven't changed
+	struct ChpxRun *run = &(doc->chpxRun);
+	if (fc >= run->fcFirst && fc < run->fcLim &&
+			memcmp(&run->pap_chp, &doc->prop.pap_chp, sizeof(CHP)) == 0)
+	{
+		doc->prop.chp = run->chp;
+		return;
+	}
+
 	set_chp_to_default(doc);
 
 /* 1. Follow the algorithm from Retrieving Text. From step 5
@@ -67,10 +77,17 @@ void direct_character_formatting(
  * character positions in this document, and is
  * not valid. Read a ChpxFkp at offset aPnBteChpx[i].pn *512
  * in the WordDocument Stream. */
-	int i;
-	for (i=0; plcbteChpx->aFc[i] <= fc;)
-		i++;
-	i--;
+	int i, lo, hi;
+	lo = 0;
+	hi = doc->plcbteChpxNaFc - 1;
+	while (lo < hi){
+		int mid = (lo + hi + 1) / 2;
+		if (plcbteChpx->aFc[mid] <= fc)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	i = lo;
 
 #ifdef DEBUG
 	LOG("plcbteChpx->aFc[%d]: %d", 
@@ -103,9 +120,16 @@ void direct_character_formatting(
  * positions in this document, and is not
  * valid. Find a Chpx at offset ChpxFkp.rgb[i] in ChpxFkp.*/
 	int j;
-	for (j = 0; chpxFkp.rgfc[j] <= fc;)
-		j++;
-	j--;
+	lo = 0;
+	hi = chpxFkp.crun;
+	while (lo < hi){
+		int mid = (lo + hi + 1) / 2;
+		if (chpxFkp.rgfc[mid] <= fc)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	j = lo;
 
 	if (chpxFkp.rgfc[chpxFkp.crun] <= fc){
 		ERR("chpxFkp->rgfc[%d]: %d - cp is outside the range "
@@ -116,20 +140,28 @@ void direct_character_formatting(
 		return;
 	}
 
-	ULONG offset = chpxFkp.rgb[j] * 2 + chpxFkp_fc;
-	BYTE cb;
-	fseek(doc->WordDocument, offset,
-		 	SEEK_SET);
-	fread(&cb, 1, 1,
-		 	doc->WordDocument);
+	// an rgb of 0 means there is no Chpx, and the text has
+	// the default properties
+	BYTE cb = 0;
+	BYTE *grpprl = NULL;
+	if (chpxFkp.rgb[j]){
+		ULONG offset = chpxFkp.rgb[j] * 2 + chpxFkp_fc;
+		if (offset >= doc->WordDocumentLen){
+			ERR("Chpx is outside the WordDocument stream");
+			return;
+		}
+		cb = doc->WordDocumentBuf[offset];
 #ifdef DEBUG
 	LOG("cb: %d", cb);
 #endif
 
-	/* GrpPrl has size of chpx.cb */
-	BYTE grpprl[cb];	
-	fread(grpprl, cb, 1, 
-			doc->WordDocument);
+		/* GrpPrl has size of chpx.cb */
+		if (offset + 1 + cb > doc->WordDocumentLen){
+			ERR("Chpx is outside the WordDocument stream");
+			return;
+		}
+		grpprl = &(doc->WordDocumentBuf[offset + 1]);
+	}
 
 #ifdef DEBUG
 	//char str[BUFSIZ] = "grpprl: ";
@@ -141,10 +173,16 @@ void direct_character_formatting(
 
 /* 5. The grpprl within the Chpx is an array of Prls that
  * specifies the direct properties of this character.*/
-	parse_grpprl(
-			grpprl, 
-			cb, 
-			doc, callback);
+	if (cb)
+		parse_grpprl(
+				grpprl, 
+				cb, 
+				doc, callback);
+
+	run->fcFirst = chpxFkp.rgfc[j];
+	run->fcLim = chpxFkp.rgfc[j+1];
+	memcpy(&run->pap_chp, &doc->prop.pap_chp, sizeof(CHP));
+	run->chp = doc->prop.chp;
 
 /* 6. Additionally, apply Pcd.Prm which specifies additional
  * properties for this text. If Pcd.Prm is a Prm0
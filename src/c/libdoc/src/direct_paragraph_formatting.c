@@ -110,13 +110,15 @@ void direct_paragraph_formatting(
 /* 4. Find the grpprl within the GrpprlAndIstd. This is an
  * array of Prl elements that specifies the
  * direct properties of this paragraph. */
-	BYTE grpprl[size-2];
-	fread(grpprl, size-2, 1,
-			doc->WordDocument);
-	parse_grpprl(
-			grpprl, 
-			size-2, 
-			doc, callback);
+	if (size > 2){
+		BYTE grpprl[size-2];
+		fread(grpprl, size-2, 1,
+				doc->WordDocument);
+		parse_grpprl(
+				grpprl, 
+				size-2, 
+				doc, callback);
+	}
 
 /* 5. Finally Pcd.Prm specifies further property
  * modifications that apply to this paragraph. If Pcd.Prm
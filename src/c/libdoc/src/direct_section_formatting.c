@@ -20,7 +20,7 @@ void direct_section_formatting(cfb_doc_t *doc, int index)
 	LOG("start");
 #endif
 
-	if (index >= doc->plcfSedNaCP){
+	if (index >= doc->plcfSedNaCP - 1){
 		ERR("no section with index: %d", index);
 		return;
 	}
@@ -45,7 +45,9 @@
  * 12. Read Fib.cswNew.
  * 13. Read the minimum of Fib.cswNew * 2 bytes and the
  * size, in bytes, of the in-memory version 
- *     of FibRgCswNew into FibRgCswNew.*/
+ *     of FibRgCswNew into FibRgCswNew.
+ * On error whatever was allocated is left in fib, for 
+ * doc_close() to free. */
 static int _doc_fib_init(Fib *fib, FILE *fp, struct cfb *cfb){
 #ifdef DEBUG
 	LOG("start");
@@ -76,7 +78,6 @@ static int _doc_fib_init(Fib *fib, FILE *fp, struct cfb *cfb){
 				fp) != 1)
 	{
 		ERR("fread");
-		free(fib->base);
 		return DOC_ERR_FILE;
 	}
 	if (cfb->biteOrder){
@@ -94,7 +95,6 @@ static int _doc_fib_init(Fib *fib, FILE *fp, struct cfb *cfb){
 	LOG("check wIdent: 0x%x", fib->base->wIdent);
 #endif	
 	if (fib->base->wIdent != 0xA5EC){
-		free(fib->base);
 		return DOC_ERR_HEADER;
 	}	
 
@@ -106,7 +106,6 @@ static int _doc_fib_init(Fib *fib, FILE *fp, struct cfb *cfb){
 				fp) != 1)
 	{
 		ERR("fread");
-		free(fib->base);
 		return DOC_ERR_FILE;
 	}
 	if (cfb->biteOrder){
@@ -118,14 +117,12 @@ static int _doc_fib_init(Fib *fib, FILE *fp, struct cfb *cfb){
 	LOG("check csw: 0x%x", fib->csw);
 #endif		
 	if (fib->csw != 14) {
-		free(fib->base);
 		return DOC_ERR_HEADER;
 	}
 
 	//allocate FibRgW97
 	fib->rgW97 = (FibRgW97 *)ALLOC(28,
 		ERR("malloc");
-		free(fib->base);
 		return DOC_ERR_ALLOC);
 
 	//read FibRgW97
@@ -136,8 +133,6 @@ static int _doc_fib_init(Fib *fib, FILE *fp, struct cfb *cfb){
 				fp) != 1)
 	{
 		ERR("fread");
-		free(fib->base);
-		free(fib->rgW97);
 		return DOC_ERR_FILE;
 	}
 	if (cfb->biteOrder){
@@ -149,8 +144,6 @@ static int _doc_fib_init(Fib *fib, FILE *fp, struct cfb *cfb){
 #endif	
 	//read Fib.cslw
 	if (fread(&(fib->cslw), 2, 1, fp) != 1){
-		free(fib->base);
-		free(fib->rgW97);
 		return DOC_ERR_FILE;
 	}
 	if (cfb->biteOrder){
@@ -162,16 +155,12 @@ static int _doc_fib_init(Fib *fib, FILE *fp, struct cfb *cfb){
 #endif	
 	//check cslw
 	if (fib->cslw != 22) {
-		free(fib->base);
-		free(fib->rgW97);
 		return DOC_ERR_HEADER;
 	}	
 
 	//allocate FibRgLw97
 	fib->rgLw97 = (FibRgLw97 *)ALLOC(88,
 		ERR("malloc");
-		free(fib->base);
-		free(fib->rgW97);
 		return DOC_ERR_ALLOC);
 	
 #ifdef DEBUG
@@ -182,9 +171,6 @@ static int _doc_fib_init(Fib *fib, FILE *fp, struct cfb *cfb){
 				fp) != 1)
 	{
 		ERR("fread");
-		free(fib->base);
-		free(fib->rgW97);
-		free(fib->rgLw97);
 		return DOC_ERR_FILE;
 	}	
 	if (cfb->biteOrder){
@@ -206,9 +192,6 @@ static int _doc_fib_init(Fib *fib, FILE *fp, struct cfb *cfb){
 				fp) != 1)
 	{
 		ERR("fread");
-		free(fib->base);
-		free(fib->rgW97);
-		free(fib->rgLw97);
 		return DOC_ERR_FILE;
 	}
 	if (cfb->biteOrder){
@@ -218,13 +201,13 @@ static int _doc_fib_init(Fib *fib, FILE *fp, struct cfb *cfb){
 #ifdef DEBUG
 	LOG("cbRgFcLcb: 0x%x", fib->cbRgFcLcb);
 #endif	
+	// everything else reads rgFcLcb as a FibRgFcLcb97
+	if (fib->cbRgFcLcb*8 < sizeof(FibRgFcLcb97))
+		return DOC_ERR_HEADER;
 
 	//allocate rgFcLcb
 	fib->rgFcLcb = (uint32_t *)ALLOC(fib->cbRgFcLcb*8,
 		ERR("malloc");
-		free(fib->base);
-		free(fib->rgW97);
-		free(fib->rgLw97);
 		return DOC_ERR_ALLOC);
 
 #ifdef DEBUG
@@ -235,10 +218,6 @@ static int _doc_fib_init(Fib *fib, FILE *fp, struct cfb *cfb){
 				fp) != fib->cbRgFcLcb)
 	{
 		ERR("fread");
-		free(fib->base);
-		free(fib->rgW97);
-		free(fib->rgLw97);
-		free(fib->rgFcLcb);
 		return DOC_ERR_FILE;
 	}	
 	if (cfb->biteOrder){
@@ -256,7 +235,7 @@ static int _doc_fib_init(Fib *fib, FILE *fp, struct cfb *cfb){
 				fp) != 1)
 	{
 		ERR("fread");
-		return -1;
+		return DOC_ERR_FILE;
 	}
 
 #ifdef DEBUG
@@ -271,10 +250,6 @@ static int _doc_fib_init(Fib *fib, FILE *fp, struct cfb *cfb){
 		fib->rgCswNew = 
 			(FibRgCswNew *)ALLOC(fib->cswNew * 2,
 		  ERR("malloc");
-			free(fib->base);
-			free(fib->rgW97);
-			free(fib->rgLw97);
-			free(fib->rgFcLcb);
 			return DOC_ERR_ALLOC);
 
 #ifdef DEBUG
@@ -285,10 +260,6 @@ static int _doc_fib_init(Fib *fib, FILE *fp, struct cfb *cfb){
 					fp) != fib->cswNew)
 		{
 			ERR("fread");
-			free(fib->base);
-			free(fib->rgW97);
-			free(fib->rgLw97);
-			free(fib->rgFcLcb);
 			return DOC_ERR_FILE;
 		}	
 		if (cfb->biteOrder){
@@ -415,9 +386,9 @@ int _doc_plcfSed_init(cfb_doc_t *doc){
 			doc->plcfSedNaCP, doc->Table);
 
 	
-	// read aSpa
+	// read aSed - there is one less Sed than CP
 	int i;
-	for (i = 0; i < doc->plcfSedNaCP; ++i) {
+	for (i = 0; i < doc->plcfSedNaCP - 1; ++i) {
 		// skeep fn
 		fseek(doc->Table, 2, SEEK_CUR);
 		LONG fcSepx;
@@ -432,7 +403,7 @@ int _doc_plcfSed_init(cfb_doc_t *doc){
 	
 #ifdef DEBUG
 	LOG("PlcfSed with NaCP: %d", doc->plcfSedNaCP);
-	for (i = 0; i < doc->plcfSedNaCP; ++i) {
+	for (i = 0; i < doc->plcfSedNaCP - 1; ++i) {
 		LOG("CP: %d, fcSepx: %d", 
 				doc->plcfSed->aCP[i], doc->plcfSed->aSed[i].fcSepx);
 	}
@@ -471,7 +442,6 @@ int _plcpcd_init(struct PlcPcd * PlcPcd, uint32_t len, cfb_doc_t *doc){
 	//allocate aCP
 	PlcPcd->aCp = (uint32_t *)ALLOC(4,
 			ERR("malloc");
-			free(PlcPcd);	
 			return -1);
 
 	//read aCP
@@ -495,7 +465,7 @@ int _plcpcd_init(struct PlcPcd * PlcPcd, uint32_t len, cfb_doc_t *doc){
 #ifdef DEBUG
 	LOG("realloc aCP with size: %d", (i+1)*4);
 #endif
-		void *ptr = REALLOC(PlcPcd->aCp, (i+1)*4,
+		PlcPcd->aCp = REALLOC(PlcPcd->aCp, (i+1)*4,
 				ERR("realloc");
 				break);
 	}
@@ -506,18 +476,25 @@ int _plcpcd_init(struct PlcPcd * PlcPcd, uint32_t len, cfb_doc_t *doc){
 	PlcPcd->aCPl = i;
 
 	//read PCD - has 64bit
+	if (len < i*4){
+		ERR("lcb: %d is smaller than aCP", len);
+		return -1;
+	}
 	uint32_t size = len - i*4;
 	
-	//number of Pcd in array
+	//number of Pcd in array - one less than the number of cp
 	PlcPcd->aPcdl = size / 8;
+	if (PlcPcd->aPcdl >= i){
+		ERR("too many Pcd: %d for %d cp", PlcPcd->aPcdl, i);
+		return -1;
+	}
 #ifdef DEBUG
 	LOG("number of Pcd in array: %d", PlcPcd->aPcdl);
 #endif	
 	
-	PlcPcd->aPcd = (struct Pcd *)ALLOC(size,
+	PlcPcd->aPcd = (struct Pcd *)ALLOC(
+			PlcPcd->aPcdl * sizeof(struct Pcd),
 			ERR("malloc");
-			free(PlcPcd->aCp);	
-			free(PlcPcd);	
 			return -1);
 
 	// get Pcd array
@@ -696,8 +673,10 @@ static int _clx_init(cfb_doc_t *doc)
 #endif	
 
 	//get PlcPcd
-	_plcpcd_init(&(clx->Pcdt->PlcPcd),
+	int ret = _plcpcd_init(&(clx->Pcdt->PlcPcd),
 		 	clx->Pcdt->lcb, doc);
+	if (ret)
+		return ret;
 	
 #ifdef DEBUG
 	LOG("aCP: %d, PCD: %d", clx->Pcdt->PlcPcd.aCPl, 
@@ -779,6 +758,7 @@ int _doc_STSH_init(cfb_doc_t *doc)
 			 	doc->Table) != 1)
 	{
 		ERR("fread");
+		free(buf);
 		return -1;
 	}
 	doc->STSH.lpstshi = (struct LPStshi *)buf;
@@ -786,13 +766,16 @@ int _doc_STSH_init(cfb_doc_t *doc)
 #ifdef DEBUG
 	LOG("cbStshi: %d", doc->STSH.lpstshi->cbStshi);
 #endif
-	if (doc->STSH.lpstshi->cbStshi == 0){
+	// stshi has at least the Stshif, and has to fit
+	if (doc->STSH.lpstshi->cbStshi < sizeof(struct Stshif) ||
+			doc->STSH.lpstshi->cbStshi + 2 > lcb){
 		ERR("cbStshi: %d", doc->STSH.lpstshi->cbStshi);
 		return -1;
 	}
 
 	int off = doc->STSH.lpstshi->cbStshi + 2;
 	doc->STSH.rglpstd = &buf[off];
+	doc->STSH.cbrglpstd = lcb - off;
 
 	return 0;
 }
@@ -818,11 +801,31 @@ int doc_read(cfb_doc_t *doc, struct cfb *cfb){
 	FILE *fp = cfb_get_stream(cfb, (char*)"WordDocument");
 	if (!fp)	
 		return DOC_ERR_FILE;
-	fseek(fp, 0, SEEK_SET);
 	doc->WordDocument = fp;
 
+	// text is read a character at a time, so keep the whole
+	// of WordDocument in memory
+	fseek(fp, 0, SEEK_END);
+	long len = ftell(fp);
+	if (len < 0)
+		return DOC_ERR_FILE;
+	doc->WordDocumentLen = len;
+	doc->WordDocumentBuf = malloc(len + 1);
+	if (!doc->WordDocumentBuf)
+		return DOC_ERR_ALLOC;
+	fseek(fp, 0, SEEK_SET);
+	if (fread(doc->WordDocumentBuf, 1, len, fp) != len){
+		free(doc->WordDocumentBuf);
+		doc->WordDocumentBuf = NULL;
+		return DOC_ERR_FILE;
+	}
+	doc->WordDocumentBuf[len] = 0;
+	fseek(fp, 0, SEEK_SET);
+
 	//init FIB
-	_doc_fib_init(&(doc->fib), doc->WordDocument, cfb);
+	ret = _doc_fib_init(&(doc->fib), doc->WordDocument, cfb);
+	if (ret)
+		return ret;
 
 	//get table
 	doc->Table = _table_stream(doc, cfb);
@@ -885,10 +888,8 @@ void doc_close(cfb_doc_t *doc)
 		if (doc->fib.rgCswNew)
 			free(doc->fib.rgCswNew);
 		
-		if (doc->plcbteChpx)
-			free(doc->plcbteChpx);
-		if (doc->plcbtePapx)
-			free(doc->plcbtePapx);
+		plcbteChpx_free(doc->plcbteChpx);
+		plcbtePapx_free(doc->plcbtePapx);
 		
 		STSH_free(&doc->STSH);
 		
@@ -928,6 +929,8 @@ void doc_close(cfb_doc_t *doc)
 			fclose(doc->Table);
 		if (doc->WordDocument)
 			fclose(doc->WordDocument);
+		if (doc->WordDocumentBuf)
+			free(doc->WordDocumentBuf);
 		if (doc->Data)
 			fclose(doc->Data);
 	}
@@ -1571,6 +1574,12 @@ void doc_get_picture(
 struct PlcBteChpx * plcbteChpx_get(
 		FILE *fp, ULONG offset, ULONG size, int *n)
 {
+	// at least two aFc and one aPnBteChpx
+	if (size < 12){
+		ERR("size: %d", size);
+		return NULL;
+	}
+
 	// get PlcBteChpx data
 	BYTE * p = (BYTE *)ALLOC(size,
 			ERR("malloc"); 
@@ -1579,6 +1588,7 @@ struct PlcBteChpx * plcbteChpx_get(
 	if (fread(p, size, 1, fp) != 1)
 	{
 		ERR("fread");
+		free(p);
 		return NULL;
 	}
 
@@ -1621,6 +1631,12 @@ struct PlcBtePapx * plcbtePapx_get(
 #ifdef DEBUG
 	LOG("start");
 #endif
+	// at least two aFc and one aPnBtePapx
+	if (size < 12){
+		ERR("size: %d", size);
+		return NULL;
+	}
+
 	// get PlcBtePapx data
 	BYTE *p = (BYTE *)ALLOC(size,
 			ERR("malloc"); 
@@ -1629,6 +1645,7 @@ struct PlcBtePapx * plcbtePapx_get(
 	if (fread(p, size, 1, fp) != 1)
 	{
 		ERR("fread");
+		free(p);
 		return NULL;
 	}
 
@@ -1667,7 +1684,7 @@ void plcbtePapx_free(struct PlcBtePapx *p){
 }
 
 struct LPStd *LPStd_at_index(
-		BYTE *rglpstd, int cstd, int index)
+		BYTE *rglpstd, ULONG size, int cstd, int index)
 {
 	int i, k;
 	SHORT cbStd;
@@ -1679,6 +1696,10 @@ struct LPStd *LPStd_at_index(
 			break;
 
 		// read cbStd
+		if (i + 2 > size){
+			ERR("STSH corrupted, LPStd at index: %d is outside it", k);
+			return NULL;
+		}
 		cbStd = *(SHORT *)&(rglpstd[i]);
 #ifdef DEBUG
 	LOG("SDT at index %d size: %d", k, *cbStd);
@@ -1695,6 +1716,17 @@ struct LPStd *LPStd_at_index(
 	if (k != index)
 		return NULL;
 
+	// the whole of the std has to be there
+	if (i + 2 > size){
+		ERR("STSH corrupted, LPStd at index: %d is outside it", k);
+		return NULL;
+	}
+	cbStd = *(SHORT *)&(rglpstd[i]);
+	if (cbStd < 0 || i + 2 + cbStd > size){
+		ERR("STSH corrupted, LPStd at index: %d, cbStd: %d", k, cbStd);
+		return NULL;
+	}
+
 	return (struct LPStd *)&(rglpstd[i]);	
 }
 
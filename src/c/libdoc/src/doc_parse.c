@@ -152,8 +152,11 @@ int doc_parse(const char *filename, void *user_data,
 	// Read the DOC Streams
 	cfb_doc_t doc;
 	ret = doc_read(&doc, &cfb);
-	if (ret)
+	if (ret){
+		doc_close(&doc);
+		cfb_close(&cfb);
 		return ret;
+	}
 
 	doc.prop.data = &doc;
 	FibRgFcLcb97 *rgFcLcb97 = (FibRgFcLcb97 *)(doc.fib.rgFcLcb);
@@ -172,12 +175,10 @@ int doc_parse(const char *filename, void *user_data,
  * paragraph mark (Unicode 0x000D).*/
 
 	// for each section in word document
-	for (i=0; i < doc.plcfSedNaCP; ++i){
+	for (i=0; i < doc.plcfSedNaCP - 1; ++i){
 		CP first = doc.plcfSed->aCP[i];
-		CP last;
-		if (i < doc.plcfSedNaCP)
-			last = doc.plcfSed->aCP[i+1];
-		else
+		CP last = doc.plcfSed->aCP[i+1];
+		if (last > doc.fib.rgLw97->ccpText)
 			last = doc.fib.rgLw97->ccpText;
 		
 		// apply section prop
@@ -249,6 +250,10 @@ int doc_parse(const char *filename, void *user_data,
 
 doc_close(&doc);
 
+// the streams read straight from the CFB's memory, so this
+// has to come after doc_close
+cfb_close(&cfb);
+
 #ifdef DEBUG
 	LOG("done");
 #endif
@@ -41,9 +41,13 @@ CP first_cp_in_paragraph(cfb_doc_t *doc, CP cp)
 	struct PlcPcd *plcPcd = &(doc->clx.Pcdt->PlcPcd);
 
 	int i = 0;
-		while (plcPcd->aCp[i] <= cp)
+		while (i < plcPcd->aCPl && plcPcd->aCp[i] <= cp)
 			i++;
 		i--;	
+		if (i < 0 || i >= plcPcd->aPcdl){
+			ERR("cp: %d is outside the PlcPcd", cp);
+			return CPERROR;
+		}
 
   while(1){
 /* 2. Let pcd be PlcPcd.aPcd[i]. */
@@ -93,6 +97,10 @@ CP first_cp_in_paragraph(cfb_doc_t *doc, CP cp)
 		for (j=0; doc->plcbtePapx->aFc[j] <= fc; )
 			j++;	
 		j--;
+		if (j < 0){
+			ERR("fc: %d is before the first PapxFkp", fc);
+			return CPERROR;
+		}
 
 		of = pnFkpPapx_pn(
 					doc->plcbtePapx->aPnBtePapx[j]) * 512;
@@ -104,16 +112,19 @@ CP first_cp_in_paragraph(cfb_doc_t *doc, CP cp)
  * than or equal to fc, then cp is outside the range of
  * character positions in this document, and is
  * not valid. Let fcFirst be PapxFkp.rgfc[k].*/
-		for (k=0; papxFkp.rgfc[k] <= fc; )
-			k++;	
-		k--;
-		
 		if (papxFkp.rgfc[papxFkp.cpara] <= fc){
 			ERR("last element of PapxFkp.rgfc is less"
 					" than or equal to fc: cp is outside the"
 					" range of character positions in this document");
 			return CPERROR;
 		}
+		for (k=0; papxFkp.rgfc[k] <= fc; )
+			k++;	
+		k--;
+		if (k < 0){
+			ERR("fc: %d is before the PapxFkp", fc);
+			return CPERROR;
+		}
 		fcFirst = papxFkp.rgfc[k];
 
 first_cp_in_paragraph_7:
@@ -161,6 +172,7 @@ CP last_cp_in_paragraph(cfb_doc_t *doc, CP cp)
 #endif
 	CP lcp = CPERROR;
 	struct PapxFkp papxFkp;
+	BYTE buf[512]; // papxFkp points into this
 	struct Pcd *pcd = NULL;
 	int k=0;
 	ULONG of=0;
@@ -175,9 +187,13 @@ CP last_cp_in_paragraph(cfb_doc_t *doc, CP cp)
 	struct PlcPcd *plcPcd = &(doc->clx.Pcdt->PlcPcd);
 	
 	int i;
-	for(i=0; plcPcd->aCp[i] <= cp;)
+	for(i=0; i < plcPcd->aCPl && plcPcd->aCp[i] <= cp;)
 		i++;
 	i--;	
+	if (i < 0 || i >= plcPcd->aPcdl){
+		ERR("cp: %d is outside the PlcPcd", cp);
+		return CPERROR;
+	}
 
 	while(1){
 /* 2. Let pcd be PlcPcd.aPcd[i]. */
@@ -208,18 +224,21 @@ CP last_cp_in_paragraph(cfb_doc_t *doc, CP cp)
  * offset aPnBtePapx[j].pn *512 in the WordDocument Stream */
 		
 		int j;
-		for (j=0; doc->plcbtePapx->aFc[j] <= fc; )
-			j++;	
-		j--;
-		
 		if (doc->plcbtePapx->aFc[doc->plcbtePapxNaFc-1] <= fc){
 			// goto 7
 			goto last_cp_in_paragraph_7;
 		}
+
+		for (j=0; doc->plcbtePapx->aFc[j] <= fc; )
+			j++;	
+		j--;
+		if (j < 0){
+			ERR("fc: %d is before the first PapxFkp", fc);
+			return CPERROR;
+		}
 		
 		of = pnFkpPapx_pn(
 						doc->plcbtePapx->aPnBtePapx[j]) * 512;
-		BYTE buf[512];
 		papxFkp_init(&papxFkp, buf, doc->WordDocument, of);
 
 /* 5. Find largest k such that PapxFkp.rgfc[k] ≤ fc. If the
@@ -227,16 +246,19 @@ CP last_cp_in_paragraph(cfb_doc_t *doc, CP cp)
  * or equal to fc, then cp is outside the range of character
  * positions in this document, and is not
  * valid. Let fcLim be PapxFkp.rgfc[k+1]. */
-		for (k=0; papxFkp.rgfc[k] <= fc; )
-			k++;	
-		k--;
-		
 		if (papxFkp.rgfc[papxFkp.cpara] <= fc){
 			ERR("last element of PapxFkp.rgfc is less"
 					" than or equal to fc: cp is outside the"
 					" range of character positions in this document");
 			return CPERROR;
 		}
+		for (k=0; papxFkp.rgfc[k] <= fc; )
+			k++;	
+		k--;
+		if (k < 0){
+			ERR("fc: %d is before the PapxFkp", fc);
+			return CPERROR;
+		}
 		ULONG fcLim = papxFkp.rgfc[k+1];
 		
 /* 6. If fcLim ≤ fcMac, then let dfc be (fcLim – fcPcd). If
@@ -246,15 +268,18 @@ CP last_cp_in_paragraph(cfb_doc_t *doc, CP cp)
  * Leave the algorithm. */
 		if (fcLim <= fcMac){
 			ULONG dfc = fcLim - fcPcd;
-			if (!FcCompressed(pcd->fc)){
+			if (!FcCompressed(pcd->fc))
 				dfc /= 2;
-				lcp = plcPcd->aCp[i] + dfc - 1;
-				break;
-			}
+			lcp = plcPcd->aCp[i] + dfc - 1;
+			break;
 		}
 /* 7. Set cp to PlcPcd.aCp[i+1]. Set i to i + 1. 
  * Go to step 2.*/
 last_cp_in_paragraph_7:
+		if (i + 1 >= plcPcd->aPcdl){
+			ERR("no paragraph mark after the last piece");
+			return CPERROR;
+		}
 		cp = plcPcd->aCp[i+1];
 		i++;
 	}
@@ -11,11 +11,16 @@
 #include <stdint.h>
 #include "../include/libdoc/sprm.h"
 
-static struct Prl * prl_parse(BYTE *grpprl, int *read)
+static struct Prl * prl_parse(BYTE *grpprl, int len, int *read)
 {
 #ifdef DEBUG
 	LOG("start");
 #endif
+	// the sprm and the first byte of any operand must be there
+	if (*read + (int)sizeof(Sprm) + 1 > len){
+		ERR("grpprl is truncated");
+		return NULL;
+	}
 	Sprm sprm = *(Sprm *)(&grpprl[*read]);
 
 	/*sprm = ctohs(sprm);	*/
@@ -51,6 +56,8 @@ static struct Prl * prl_parse(BYTE *grpprl, int *read)
 				if (SprmSgc(sprm) == sgcTab &&
 						SprmIspmd(sprm) == sprmTDefTable)
 				{
+					if (read[0] + 4 > len)
+						break;
 					USHORT cb = *(USHORT *)(&grpprl[read[0]+2]);
 					bytes = cb + 1;
 					break;
@@ -78,6 +85,10 @@ static struct Prl * prl_parse(BYTE *grpprl, int *read)
 			break;
 			
 	}
+	if (bytes && *read + (int)sizeof(Sprm) + bytes > len){
+		ERR("grpprl is truncated");
+		return NULL;
+	}
 	if (bytes){
 		struct Prl *prl = (struct Prl *)(&grpprl[*read]);	
 		*read += bytes + sizeof(Sprm);
@@ -96,10 +107,22 @@ void parse_grpprl(
 #endif
 	int read = 0;
 	while (read < len) {
-		struct Prl *prl = prl_parse(grpprl, &read);
+		struct Prl *prl = prl_parse(grpprl, len, &read);
 		
 		if (!prl) //stop all grpprl parsing on error
 			break;
+
+		// callbacks read fixed size operands at the size the
+		// spec gives the sprm, which a damaged spra can make
+		// longer than what is there - near the end of grpprl
+		// hand them a copy padded with zeros
+		BYTE pad[sizeof(Sprm) + 4];
+		int start = (BYTE *)prl - grpprl;
+		if (start + (int)sizeof(pad) > len){
+			memset(pad, 0, sizeof(pad));
+			memcpy(pad, prl, read - start);
+			prl = (struct Prl *)pad;
+		}
 		
 		if (callback)
 			if(callback(userdata, prl))
@@ -19,6 +19,39 @@ static void check_marks(cfb_doc_t *doc, int ch)
 	}
 }
 
+/* Find the largest i such that PlcPcd.aCp[i] ≤ cp, or -1 if
+ * cp is outside the range of valid character positions.
+ * Text is almost always read in order, so try the piece
+ * used last time (and the one after it) before doing a
+ * binary search. */
+static int find_pcd(cfb_doc_t *doc, CP cp)
+{
+	struct PlcPcd *PlcPcd = &(doc->clx.Pcdt->PlcPcd);
+	ULONG *aCp = PlcPcd->aCp;
+	int n = PlcPcd->aCPl - 1; // number of pieces
+	
+	if (n < 1 || cp < aCp[0] || cp >= aCp[n])
+		return -1;
+
+	int i = doc->iPcd;
+	if (i < n && aCp[i] <= cp){
+		if (cp < aCp[i+1])
+			return i;
+		if (i + 1 < n && cp < aCp[i+2])
+			return doc->iPcd = i + 1;
+	}
+
+	int lo = 0, hi = n - 1;
+	while (lo < hi){
+		int mid = (lo + hi + 1) / 2;
+		if (aCp[mid] <= cp)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return doc->iPcd = lo;
+}
+
 void get_char_for_cp(cfb_doc_t *doc, CP cp,
 		void *user_data,
 		DOC_PART part,
@@ -27,6 +60,7 @@ void get_char_for_cp(cfb_doc_t *doc, CP cp,
 {
 	struct PlcPcd *PlcPcd = &(doc->clx.Pcdt->PlcPcd);
 	DWORD off; // ofset of WordDocument where text is located
+	BYTE *buf = doc->WordDocumentBuf;
 
 /* The Clx contains a Pcdt, and the Pcdt contains a PlcPcd.
  * Find the largest i such that PlcPcd.aCp[i] ≤ cp. As with
@@ -37,10 +71,9 @@ void get_char_for_cp(cfb_doc_t *doc, CP cp,
  * than or equal to cp, cp is outside the range of valid
  * character positions in this document
  */
-	int i;
-	for (i=0; PlcPcd->aCp[i] <= cp;)
-		i++;
-	i--;	
+	int i = find_pcd(doc, cp);
+	if (i < 0)
+		return;
 
 /*
  * PlcPcd.aPcd[i] is a Pcd. Pcd.fc is an FcCompressed that
@@ -63,15 +96,14 @@ void get_char_for_cp(cfb_doc_t *doc, CP cp,
 */			
 		//ANSI
 		off = (FcValue(fc) / 2) + (cp - PlcPcd->aCp[i]);
+		if (off >= doc->WordDocumentLen)
+			return;
 
 		// get properties
 		direct_character_formatting(doc, off, pcd);
 		doc->prop.chp.cp = cp;
 
-		fseek(doc->WordDocument, off, SEEK_SET);	
-		int ch;
-		fread(&ch, 1, 1, 
-					doc->WordDocument);
+		int ch = buf[off];
 		
 		// check special chars
 		int sch = FcCompressedSpecialChar_get(ch);
@@ -95,31 +127,23 @@ void get_char_for_cp(cfb_doc_t *doc, CP cp,
 */			
 		//UNICODE 16
 		off = FcValue(fc) + 2*(cp - PlcPcd->aCp[i]);
+		if (off + 2 > doc->WordDocumentLen)
+			return;
 
 		// get properties
 		direct_character_formatting(doc, off, pcd);
 		doc->prop.chp.cp = cp;
 		
-		fseek(doc->WordDocument, off, SEEK_SET);	
 		WORD u;
-		fread(&u, 2, 1, 
-					doc->WordDocument);
+		memcpy(&u, &buf[off], 2);
 		if (doc->biteOrder){
 			u = bswap_16(u);
 		}
-		char utf8[4]={0};
-		//sprintf(utf8, "0x%x ", u);
-		_utf16_to_utf8(&u, 1, utf8);
-		//if (doc->biteOrder){
-				//u = bswap_16(u);
-		//}
 		if (u < 0x010){
 			// first byte in uint16 is 00
 			if (u > 0x1f && u < 0x7f) {
 				//simple ANSI
-				int ch;
-				fread(&ch, 1, 1,
-						doc->WordDocument);
+				int ch = buf[off + 2];
 		
 				callback(user_data, part, &doc->prop, ch);
 			} else {
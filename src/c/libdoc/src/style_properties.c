@@ -26,7 +26,8 @@ static int callbackChar(void *userdata, struct Prl *prl);
  * paragraphs, and characters. */
 
 /* Given an istd: */
- struct LPStd *apply_style_properties(cfb_doc_t *doc, USHORT istd)
+static struct LPStd *_apply_style_properties(
+		cfb_doc_t *doc, USHORT istd)
 {
 /* 1. Read the FIB from offset zero in the WordDocument
  * Stream. */
@@ -43,7 +44,7 @@ static int callbackChar(void *userdata, struct Prl *prl);
  * STSH.rglpstd. Read an LPStd at STSH.rglpstd[istd]. */
 	USHORT cstd = doc->STSH.lpstshi->stshi->stshif.cstd;
 	struct LPStd *LPStd = 
-		LPStd_at_index(STSH->rglpstd, 
+		LPStd_at_index(STSH->rglpstd, STSH->cbrglpstd,
 				cstd, istd);
 	if (!LPStd){
 #ifdef DEBUG
@@ -62,6 +63,7 @@ static int callbackChar(void *userdata, struct Prl *prl);
 /* 4. Read the STD structure as LPStd.std, of length
  * LPStd.cbStd bytes. */
 	struct STD *STD = (struct STD *)LPStd->STD;
+	BYTE *end = (BYTE *)LPStd->STD + LPStd->cbStd;
 
 /* 5. From the STD.stdf.stdfBase obtain istdBase. If
  * istdBase is any value other than 0x0FFF, then
@@ -114,6 +116,10 @@ static int callbackChar(void *userdata, struct Prl *prl);
 		ERR("cbSTDBaseInFile");
 		return NULL;
 	}
+	if (p + 2 > end){
+		ERR("STD at index %d is too short", istd);
+		return NULL;
+	}
 
 	// get style name
 	struct Xst *xst = (struct Xst *)p;
@@ -137,21 +143,31 @@ static int callbackChar(void *userdata, struct Prl *prl);
  * structures for how to obtain these
  * arrays.*/
 	BYTE *ptr = p + skip;
+	if (ptr > end){
+		ERR("STD at index %d is too short", istd);
+		return NULL;
+	}
 
 	switch (stk) {
 		case stkPar:
 			{
 				// paragraph prop
+				if (ptr + 4 > end)
+					break;
 				USHORT cbUpx = *ptr;
 				USHORT _istd = *(ptr + 2);
 				int fc = 2;
-				if (istd == _istd){
+				if (istd == _istd && cbUpx >= 2){
 					fc+=2;
 					cbUpx -= 2;
 				}
 				#ifdef DEBUG
 					LOG("UpxPapx len: %d", cbUpx);
 				#endif
+				if (ptr + fc + cbUpx > end){
+					ERR("UpxPapx of style %d is too long", istd);
+					break;
+				}
 				parse_grpprl(
 					ptr+fc, 
 					cbUpx, 
@@ -163,11 +179,17 @@ static int callbackChar(void *userdata, struct Prl *prl);
 				if(cbUpx % 2 != 0)
 					fc++;
 				
+				if (ptr + fc + 2 > end)
+					break;
 				cbUpx = *(ptr + fc); 
 				#ifdef DEBUG
 					LOG("UpxChpx len: %d", cbUpx);
 				#endif
 				fc += 2;
+				if (ptr + fc + cbUpx > end){
+					ERR("UpxChpx of style %d is too long", istd);
+					break;
+				}
 				BYTE *CHPX = ptr + fc;
 				#ifdef DEBUG
 					LOG("UpxChpx len: %d", cbUpx);
@@ -192,10 +214,16 @@ static int callbackChar(void *userdata, struct Prl *prl);
 			break;
 		case stkCha:
 			{
+				if (ptr + 2 > end)
+					break;
 				USHORT cbUpx = *ptr; 
 				#ifdef DEBUG
 					LOG("UpxChpx len: %d", cbUpx);
 				#endif
+				if (ptr + 2 + cbUpx > end){
+					ERR("UpxChpx of style %d is too long", istd);
+					break;
+				}
 				BYTE *CHPX = ptr + 2;
 				#ifdef DEBUG
 				Sprm sprm = *CHPX;
@@ -247,6 +275,21 @@ static int callbackChar(void *userdata, struct Prl *prl);
 #endif
 	return LPStd;
 }
+struct LPStd *apply_style_properties(cfb_doc_t *doc, USHORT istd)
+{
+	// styles apply other styles through istdBase, sprmPIstd
+	// and sprmCIstd; a chain of them can't be longer than the
+	// number of styles, unless it loops
+	if (doc->styleDepth >= doc->STSH.lpstshi->stshi->stshif.cstd){
+		ERR("style %d is based on itself", istd);
+		return NULL;
+	}
+	doc->styleDepth++;
+	struct LPStd *LPStd = _apply_style_properties(doc, istd);
+	doc->styleDepth--;
+	return LPStd;
+}
+
 int callbackPar(void *userdata, struct Prl *prl){
 	// parse properties
 	//USHORT ismpd = SprmIspmd(prl->sprm);
@@ -39,6 +39,7 @@ int main(int argc, const char* argv[])
 	utils_init();
 	filesystem_init();
 	zip_init();
+	xml_init();
 	unrtf_init();
 	undoc_init();
 	image_init();
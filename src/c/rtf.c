@@ -38,7 +38,8 @@ void flushstring(struct unrtf_t *t)
 	lua_pushvalue(t->L, 6);
 	lua_pushlstring(t->L, t->str.str, t->str.len);
 	lua_call(t->L, 1, 0);
-	str_init(&t->str, BUFSIZ);
+	t->str.len = 0;
+	t->str.str[0] = 0;
 }
 
 int style_cb(void *d, STYLE *s)
@@ -227,38 +228,25 @@ static void flushpageprop(struct unrtf_t *t, prop_t *p){
 	lua_call(t->L, 6, 0);
 }
 
-int char_cb(void *d, STREAM s, prop_t *p, int ch)
-{
-	struct unrtf_t *t = d;
+static void checkpageprop(struct unrtf_t *t, prop_t *p){
 	if (!t->flushPageProp){
 		if (p->dop.xaPage){
 			flushpageprop(t, p);
 			t->flushPageProp = true;
 		}
 	}
+}
+
+int text_cb(void *d, STREAM s, prop_t *p, const char *text, int len)
+{
+	struct unrtf_t *t = d;
+	checkpageprop(t, p);
 
 	if (s != sMain)
 		return 0;
 
-	if (ch > 256) {
-		switch (ch) {
-			case PAR:
-				flushparagraph(t, &p->pap);
-				break;
-			case ROW:
-				flushrow(t, &p->trp);
-				break;
-			case CELL:
-				flushcell(t, p);
-				break;
-			
-			default:
-				break;	
-		}
-
-		return 0;
-	}
-	
+	// the whole run has the same properties, so the style
+	// only needs checking once
 	if (
 			t->fBold != p->chp.fBold           ||
 			t->fUnderline != p->chp.fUnderline ||
@@ -297,12 +285,42 @@ int char_cb(void *d, STREAM s, prop_t *p, int ch)
 		}
 	}
 
-	// add char to buffer
-	char c = ch;
-	str_append(&t->str, &c, 1);
+	// add text to buffer
+	str_append(&t->str, text, len);
 	return 0;
 }
 
+int char_cb(void *d, STREAM s, prop_t *p, int ch)
+{
+	struct unrtf_t *t = d;
+	checkpageprop(t, p);
+
+	if (s != sMain)
+		return 0;
+
+	if (ch > 256) {
+		switch (ch) {
+			case PAR:
+				flushparagraph(t, &p->pap);
+				break;
+			case ROW:
+				flushrow(t, &p->trp);
+				break;
+			case CELL:
+				flushcell(t, p);
+				break;
+			
+			default:
+				break;	
+		}
+
+		return 0;
+	}
+
+	char c = ch;
+	return text_cb(d, s, p, &c, 1);
+}
+
 static int unrtf_cb(lua_State* L)
 {
 	size_t size;
@@ -323,6 +341,7 @@ static int unrtf_cb(lua_State* L)
 
 	n.udata = &t;
 	n.char_cb = char_cb;
+	n.text_cb = text_cb;
 	n.style_cb = style_cb;
 	//n.command_cb = command_cb;
 	n.pict_cb = pict_cb;
@@ -331,6 +350,7 @@ static int unrtf_cb(lua_State* L)
 	
 	int ec = ecRtfParse(fp, &p, &n);
 	fclose(fp);
+	free(t.str.str);
 
 	return ec;
 }
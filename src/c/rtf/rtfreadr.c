@@ -584,7 +584,10 @@ RIS ris;
 FONT fnt;
 COLOR col;
 SAVE *psave;
-FILE *fpIn;
+
+// Input; the whole of the RTF is parsed from memory
+const char *pchIn;
+const char *pchInEnd;
 
 PICT pict;
 
@@ -607,11 +610,13 @@ tDATE tdate;
 // RTF parser declarations
 int ecPushRtfState(void);
 int ecPopRtfState(void);
-int ecParseRtfKeyword(FILE *fp);
+int ecParseRtfKeyword(void);
 int ecParseChar(int c);
+int ecParseRun(const char *pch, int cch);
 int ecParseUTF(int c);
 int ecTranslateKeyword(char *szKeyword, int param, bool fParam);
 int ecPrintChar(int ch);
+int ecPrintRun(const char *pch, int cch);
 int ecEndGroupAction(RDS rds);
 int ecApplyPropChange(IPROP iprop, long val);
 int ecChangeDest(IDEST idest);
@@ -622,6 +627,21 @@ int ecParseHexByte(void);
 
 int isymMax = sizeof(rgsymRtf) / sizeof(SYM);
 
+static inline int
+ecGetc(void)
+{
+	if (pchIn >= pchInEnd)
+		return EOF;
+	return (unsigned char) *pchIn++;
+}
+
+static inline void
+ecUngetc(int ch)
+{
+	if (ch != EOF)
+		pchIn--;
+}
+
 struct str img;
 
 //
@@ -807,15 +827,31 @@ ecParseSpecialProperty(IPROP iprop, int val)
 // fParam:         fTrue if the control had a parameter; (that is, if param is valid)
 //                 fFalse if it did not.
 
+static int
+ecCompareSym(const void *a, const void *b)
+{
+	return strcmp(((const SYM *)a)->szKeyword, ((const SYM *)b)->szKeyword);
+}
+
 int
 ecTranslateKeyword(char *szKeyword, int param, bool fParam)
 {
+	static bool fSorted = fFalse;
+	SYM key, *psym;
 	int isym;
+
+	// sort rgsymRtf the first time through, so keywords can be
+	// looked up by bisection
+	if (!fSorted)
+	{
+		qsort(rgsymRtf, isymMax, sizeof(SYM), ecCompareSym);
+		fSorted = fTrue;
+	}
 	
 	// search for szKeyword in rgsymRtf
-	for (isym = 0; isym < isymMax; isym++)
-		if (strcmp(szKeyword, rgsymRtf[isym].szKeyword) == 0)
-			break;
+	key.szKeyword = szKeyword;
+	psym = bsearch(&key, rgsymRtf, isymMax, sizeof(SYM), ecCompareSym);
+	isym = psym ? psym - rgsymRtf : isymMax;
 			
 	if (isym == isymMax)        // control word not found
 	{
@@ -1100,18 +1136,60 @@ ecParseSpecialKeyword(IPFN ipfn)
 //
 // %%Function: ecRtfParse
 //
+// Read the whole of fp into memory, in large blocks, and
+// parse it with ecRtfParseBuffer.
+//
+int ecRtfParse(
+		FILE *fp,
+		prop_t *_prop,
+		rnotify_t *_no
+		)
+{
+	size_t size = 0x10000;
+	size_t len = 0;
+	char *buf = malloc(size);
+	if (!buf)
+		return ecStackOverflow;
+
+	for (;;)
+	{
+		size_t n = fread(buf + len, 1, size - len, fp);
+		len += n;
+		if (len < size)
+			break;
+
+		char *p = realloc(buf, size * 2);
+		if (!p)
+		{
+			free(buf);
+			return ecStackOverflow;
+		}
+		buf = p;
+		size *= 2;
+	}
+
+	int ec = ecRtfParseBuffer(buf, len, _prop, _no);
+	free(buf);
+	return ec;
+}
+
+//
+// %%Function: ecRtfParseBuffer
+//
 // Step 1:
 // Isolate RTF keywords and send them to ecParseRtfKeyword;
 // Push and pop state at the start and end of RTF groups;
-// Send text to ecParseChar for further processing.
+// Send runs of text to ecParseRun for further processing.
 
-int ecRtfParse(
-		FILE *fp,
+int ecRtfParseBuffer(
+		const char *buf,
+		size_t len,
 		prop_t *_prop,
 		rnotify_t *_no
 		)
 {
-	fpIn = fp;
+	pchIn = buf;
+	pchInEnd = buf + len;
 	prop = _prop;
 	// set prop to 0
 	memset(prop, 0, sizeof(prop_t));
@@ -1122,7 +1200,7 @@ int ecRtfParse(
 	int ec;
 	int cNibble = 2;
 	int b = 0;
-	while ((ch = getc(fp)) != EOF)
+	while ((ch = ecGetc()) != EOF)
 	{
 		if (cGroup < 0)
 			return ecStackUnderflow;
@@ -1145,7 +1223,7 @@ int ecRtfParse(
 						return ec;
 						break;
 				case '\\':
-					if ((ec = ecParseRtfKeyword(fp)) != ecOK)
+					if ((ec = ecParseRtfKeyword()) != ecOK)
 						return ec;
 						break;
 				case 0x0d:
@@ -1154,7 +1232,14 @@ int ecRtfParse(
 				default:
 					if (ris == risNorm)
 					{
-						if ((ec = ecParseChar(ch)) != ecOK)
+						// everything up to the next control character
+						// is plain text, so pass it on as one run
+						const char *pch = pchIn - 1;
+						while (pchIn < pchInEnd &&
+								*pchIn != '\\' && *pchIn != '{' && *pchIn != '}' &&
+								*pchIn != 0x0d && *pchIn != 0x0a)
+							pchIn++;
+						if ((ec = ecParseRun(pch, pchIn - pch)) != ecOK)
 							return ec;
 					}
 					else {
@@ -1280,7 +1365,7 @@ ecPopRtfState(void)
 // call ecTranslateKeyword to dispatch the control.
 //
 int
-ecParseRtfKeyword(FILE *fp)
+ecParseRtfKeyword(void)
 {
 	int ch;
 	char fParam = fFalse;
@@ -1292,7 +1377,7 @@ ecParseRtfKeyword(FILE *fp)
 	szKeyword[0] = '\0';
 	szParameter[0] = '\0';
 	
-	if ((ch = getc(fp)) == EOF)
+	if ((ch = ecGetc()) == EOF)
 		return ecEndOfFile;
 		 
 	// a control symbol; no delimiter.
@@ -1303,14 +1388,15 @@ ecParseRtfKeyword(FILE *fp)
 		return ecTranslateKeyword(szKeyword, 0, fParam);
 	}
 		 
-	for (pch = szKeyword; isalpha(ch); ch = getc(fp))
-		*pch++ = (char) ch;
+	for (pch = szKeyword; isalpha(ch); ch = ecGetc())
+		if (pch < szKeyword + sizeof(szKeyword) - 1)
+			*pch++ = (char) ch;
 		 
 	*pch = '\0';
 	if (ch == '-')
 	{
 		fNeg    = fTrue;
-		if ((ch = getc(fp)) == EOF)
+		if ((ch = ecGetc()) == EOF)
 			return ecEndOfFile;
 	}
 
@@ -1319,8 +1405,9 @@ ecParseRtfKeyword(FILE *fp)
 		// a digit after the control means we have a parameter
 		fParam = fTrue;
 		
-		for (pch = szParameter; isdigit(ch); ch = getc(fp))
-			*pch++ = (char) ch;
+		for (pch = szParameter; isdigit(ch); ch = ecGetc())
+			if (pch < szParameter + sizeof(szParameter) - 1)
+				*pch++ = (char) ch;
 				 
 		*pch = '\0';
 		param = atoi(szParameter);
@@ -1338,7 +1425,7 @@ ecParseRtfKeyword(FILE *fp)
 		no->command_cb(no->udata, szKeyword, param, fParam);
 	
 	if (ch != ' ')
-		ungetc(ch, fp);
+		ecUngetc(ch);
 		 
 	return ecTranslateKeyword(szKeyword, param, fParam);
 }
@@ -1460,6 +1547,33 @@ ecParseChar(int ch)
 	}
 }
 
+//
+// %%Function: ecParseRun
+//
+// Route a run of plain text to the appropriate destination
+// stream; text goes out in one go, and anything else a
+// character at a time.
+//
+int
+ecParseRun(const char *pch, int cch)
+{
+	int i, ec;
+	switch (rds)
+	{
+		case rdsSkip:
+			return ecOK;
+
+		case rdsNorm:
+			return ecPrintRun(pch, cch);
+
+		default:
+			for (i = 0; i < cch; ++i)
+				if ((ec = ecParseChar((unsigned char) pch[i])) != ecOK)
+					return ec;
+			return ecOK;
+	}
+}
+
 //
 // %%Function: ecParseUTF
 //
@@ -1473,6 +1587,8 @@ ecParseUTF(int ch)
 	int i;
 	char s[6];
 	int len = c32tomb(s, ch);
+	if (rds == rdsNorm)
+		return ecPrintRun(s, len);
 	for (i = 0; i < len; ++i) {
 		ecParseChar(s[i]);
 	}	
@@ -1495,3 +1611,24 @@ ecPrintChar(int ch)
 		no->char_cb(no->udata, s, prop, ch);
 	return ecOK;
 }
+
+//
+// %%Function: ecPrintRun
+//
+// Send a run of characters to the output file.
+//
+int
+ecPrintRun(const char *pch, int cch)
+{
+	STREAM s = sMain;
+	if (rds == rdsFootnote)
+		s = sFootnotes;
+
+	int i;
+	if (no->text_cb)
+		no->text_cb(no->udata, s, prop, pch, cch);
+	else
+		for (i = 0; i < cch; ++i)
+			ecPrintChar(pch[i]);
+	return ecOK;
+}
@@ -69,12 +69,18 @@ typedef struct rtfnotify {
 	int (*style_cb)(void *udata, STYLE *s);
 	int (*color_cb)(void *udata, COLOR *c);
 	int (*char_cb)(void *udata, STREAM s, prop_t *p, int ch);
+	// runs of plain text; if not set, they go to char_cb
+	// a character at a time
+	int (*text_cb)(void *udata, STREAM s, prop_t *p, const char *text, int len);
 	int (*pict_cb)(void *udata, prop_t *p, PICT *pict);
 } rnotify_t;
 
 /* parse RTF file and run callbacks */
 int ecRtfParse(FILE *fp, prop_t *prop, rnotify_t *no);
 
+/* parse RTF from memory and run callbacks */
+int ecRtfParseBuffer(const char *buf, size_t len, prop_t *prop, rnotify_t *no);
+
 // RTF parser error codes
 #define ecOK									0     // Everything's fine!
 #define ecStackUnderflow      1     // Unmatched '}'
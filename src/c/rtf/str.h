@@ -77,14 +77,23 @@ int str_init(struct str *s, size_t size)
 static int _str_realloc(
 		struct str *s, int new_size)
 {
-	while (s->size < new_size){
-		// do realloc
-		void *p = realloc(s->str, s->size + BUFSIZ);
-		if (!p)
-			return -1;
-		s->str = (char*)p;
-		s->size += BUFSIZ;
-	}
+	if (s->size >= new_size)
+		return 0;
+
+	// grow geometrically, so that appending a character
+	// at a time doesn't keep copying the whole string
+	int size = s->size + BUFSIZ;
+	if (size < s->size * 2)
+		size = s->size * 2;
+	if (size < new_size)
+		size = new_size;
+
+	// do realloc
+	void *p = realloc(s->str, size);
+	if (!p)
+		return -1;
+	s->str = (char*)p;
+	s->size = size;
 	return 0;
 }
 
@@ -94,7 +103,7 @@ void str_append(
 	if (!str || len < 1)
 		return;
 
-	int new_size, i;
+	int new_size;
 	
 	new_size = s->len + len + 1;
 	// realloc if not enough size
@@ -102,8 +111,8 @@ void str_append(
 		return;
 
 	// append string
-	for (i = 0; i < len; ++i)
-		s->str[s->len++] = str[i];
+	memcpy(s->str + s->len, str, len);
+	s->len += len;
   
 	s->str[s->len] = 0;
 }
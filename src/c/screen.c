@@ -6,11 +6,18 @@
 #include "globals.h"
 #include <string.h>
 
+#define SPANSIZE 256
+
 static bool running = false;
 static int cursorx = 0;
 static int cursory = 0;
 static bool cursorshown = true;
 
+/* Counts the calls which draw on the screen, so that the redraw code can
+ * tell whether anything else (a menu, a dialogue, a message) has drawn over
+ * the document since it last ran. */
+static unsigned drawcount = 0;
+
 void screen_deinit(void)
 {
 	if (running)
@@ -31,6 +38,7 @@ static int initscreen_cb(lua_State* L)
 
 static int clearscreen_cb(lua_State* L)
 {
+	drawcount++;
 	dpy_clearscreen();
 	return 0;
 }
@@ -92,14 +100,38 @@ static int write_cb(lua_State* L)
 	const char* s = luaL_checklstring(L, 3, &size);
 	const char* send = s + size;
 
+	/* Printable characters are written out in spans of up to SPANSIZE. */
+	uni_t span[SPANSIZE];
+	int spanlen = 0;
+	int spanx = x;
+
+	drawcount++;
 	while (s < send)
 	{
 		uni_t c = readu8(&s);
 
-		dpy_writechar(x, y, c);
 		if (!iswcntrl(c))
+		{
+			if (spanlen == SPANSIZE)
+			{
+				dpy_writespan(spanx, y, span, spanlen);
+				spanlen = 0;
+			}
+			if (!spanlen)
+				spanx = x;
+			span[spanlen++] = c;
 			x += emu_wcwidth(c);
+		}
+		else
+		{
+			if (spanlen)
+				dpy_writespan(spanx, y, span, spanlen);
+			spanlen = 0;
+			dpy_writechar(x, y, c);
+		}
 	}
+	if (spanlen)
+		dpy_writespan(spanx, y, span, spanlen);
 
 	return 0;
 }
@@ -110,10 +142,51 @@ static int cleararea_cb(lua_State* L)
 	int y1 = forceinteger(L, 2);
 	int x2 = forceinteger(L, 3);
 	int y2 = forceinteger(L, 4);
+	drawcount++;
 	dpy_cleararea(x1, y1, x2, y2);
 	return 0;
 }
 
+static int getdrawcount_cb(lua_State* L)
+{
+	lua_pushnumber(L, drawcount);
+	return 1;
+}
+
+static int glyphcachestats_cb(lua_State* L)
+{
+	struct glyphcachestats stats;
+	dpy_getglyphcachestats(&stats);
+
+	lua_newtable(L);
+
+	lua_pushstring(L, "hits");
+	lua_pushnumber(L, stats.hits);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "misses");
+	lua_pushnumber(L, stats.misses);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "evictions");
+	lua_pushnumber(L, stats.evictions);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "count");
+	lua_pushnumber(L, stats.count);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "size");
+	lua_pushnumber(L, stats.size);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "budget");
+	lua_pushnumber(L, stats.budget);
+	lua_settable(L, -3);
+
+	return 1;
+}
+
 static int gotoxy_cb(lua_State* L)
 {
 	cursorx = forceinteger(L, 1);
@@ -201,8 +274,14 @@ static int getchar_cb(lua_State* L)
 	if (!lua_isnone(L, 1))
 		t = forcedouble(L, 1);
 
-	dpy_setcursor(cursorx, cursory, cursorshown);
-	dpy_sync();
+	/* A zero timeout is just polling for input, so don't bother updating
+	 * the screen. */
+
+	if (t != 0)
+	{
+		dpy_setcursor(cursorx, cursory, cursorshown);
+		dpy_sync();
+	}
 
 	for (;;)
 	{
@@ -213,6 +292,13 @@ static int getchar_cb(lua_State* L)
 			if (s)
 			{
 				lua_pushstring(L, s);
+				if (strcmp(s, "KEY_PASTE") == 0)
+				{
+					size_t len;
+					const char* text = dpy_getpaste(&len);
+					lua_pushlstring(L, text, len);
+					return 2;
+				}
 				break;
 			}
 		}
@@ -251,6 +337,8 @@ void screen_init(const char* argv[])
 		{ "setnormal",                 setnormal_cb },
 		{ "write",                     write_cb },
 		{ "cleararea",                 cleararea_cb },
+		{ "getdrawcount",              getdrawcount_cb },
+		{ "glyphcachestats",           glyphcachestats_cb },
 		{ "gotoxy",                    gotoxy_cb },
 		{ "showcursor",                showcursor_cb },
 		{ "hidecursor",                hidecursor_cb },
@@ -5,6 +5,7 @@
 
 #include "globals.h"
 #include <sys/time.h>
+#include <string.h>
 
 static const uint8_t masks[6] = {
 	0xff, 0x1f, 0x0f, 0x07, 0x03, 0x01
@@ -263,6 +264,209 @@ static int unescape_cb(lua_State* L)
 	return 1;
 }
 
+/* Paragraph blocks, as used by the v4 file format. A block is:
+ *
+ *   u32 count
+ *   u32 offsets[count+1]  (relative to the start of the paragraph data)
+ *   paragraph data
+ *
+ * Each paragraph is its style followed by its words, separated by spaces;
+ * exactly the same as a line of the v3 text format, but without needing to
+ * be split into lines. All integers are little-endian.
+ */
+
+static void putu32(uint8_t* p, uint32_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+	p[2] = value >> 16;
+	p[3] = value >> 24;
+}
+
+static uint32_t getu32(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Measures (or, if dest is non-null, writes) the paragraph on the top of
+ * the stack. */
+
+static size_t encodeparagraph(lua_State* L, uint8_t* dest)
+{
+	size_t size;
+	size_t total;
+	const char* s;
+
+	lua_getfield(L, -1, "style");
+	s = lua_tolstring(L, -1, &size);
+	if (!s)
+		luaL_error(L, "paragraph has no style");
+	if (dest)
+		memcpy(dest, s, size);
+	total = size;
+	lua_pop(L, 1);
+
+	int words = lua_rawlen(L, -1);
+	for (int i = 1; i <= words; i++)
+	{
+		lua_rawgeti(L, -1, i);
+		s = lua_tolstring(L, -1, &size);
+		if (!s)
+			luaL_error(L, "paragraph has a word which isn't a string");
+		if (dest)
+		{
+			dest[total] = ' ';
+			memcpy(dest+total+1, s, size);
+		}
+		total += size + 1;
+		lua_pop(L, 1);
+	}
+
+	return total;
+}
+
+/* Writes the paragraph on the top of the stack to a writer. */
+
+static void writeparagraph(lua_State* L, struct writer* w)
+{
+	size_t size;
+	const char* s;
+
+	lua_getfield(L, -1, "style");
+	s = lua_tolstring(L, -1, &size);
+	writer_write(w, s, size);
+	lua_pop(L, 1);
+
+	int words = lua_rawlen(L, -1);
+	for (int i = 1; i <= words; i++)
+	{
+		lua_rawgeti(L, -1, i);
+		s = lua_tolstring(L, -1, &size);
+		writer_write(w, " ", 1);
+		writer_write(w, s, size);
+		lua_pop(L, 1);
+	}
+}
+
+/* wg.encodeparagraphs(document, [writer]): if a writer is supplied, the
+ * block is streamed to it; otherwise it's returned as a string. Buffers are
+ * userdata, so that they're collected if a bad paragraph raises an error. */
+
+static int encodeparagraphs_cb(lua_State* L)
+{
+	luaL_checktype(L, 1, LUA_TTABLE);
+	struct writer* w = lua_isnoneornil(L, 2) ? NULL : checkwriter(L, 2);
+	int count = lua_rawlen(L, 1);
+
+	size_t headersize = 4 + (count+1)*4;
+	uint8_t* header = lua_newuserdata(L, headersize);
+	size_t offset = 0;
+	putu32(header, count);
+	for (int i = 1; i <= count; i++)
+	{
+		putu32(header + i*4, offset);
+		lua_rawgeti(L, 1, i);
+		offset += encodeparagraph(L, NULL);
+		lua_pop(L, 1);
+	}
+	putu32(header + (count+1)*4, offset);
+
+	if (w)
+	{
+		writer_write(w, (const char*) header, headersize);
+		for (int i = 1; i <= count; i++)
+		{
+			lua_rawgeti(L, 1, i);
+			writeparagraph(L, w);
+			lua_pop(L, 1);
+		}
+		return 0;
+	}
+
+	uint8_t* buffer = lua_newuserdata(L, headersize + offset);
+	memcpy(buffer, header, headersize);
+	uint8_t* data = buffer + headersize;
+	offset = 0;
+	for (int i = 1; i <= count; i++)
+	{
+		lua_rawgeti(L, 1, i);
+		offset += encodeparagraph(L, data + offset);
+		lua_pop(L, 1);
+	}
+
+	lua_pushlstring(L, (const char*) buffer, headersize + offset);
+	return 1;
+}
+
+/* Decodes a paragraph block starting at the given (1-based) offset into
+ * the supplied document, giving each paragraph the supplied metatable.
+ * Returns the offset of the first byte after the block. */
+
+static int decodeparagraphs_cb(lua_State* L)
+{
+	size_t size;
+	const uint8_t* s = (const uint8_t*) luaL_checklstring(L, 1, &size);
+	size_t offset = forceinteger(L, 2) - 1;
+	luaL_checktype(L, 3, LUA_TTABLE);
+	luaL_checktype(L, 4, LUA_TTABLE);
+
+	if ((offset + 4) > size)
+		goto corrupt;
+	uint32_t count = getu32(s + offset);
+	const uint8_t* offsets = s + offset + 4;
+	if ((count > size) || ((offset + 4 + (count+1)*4) > size))
+		goto corrupt;
+
+	const uint8_t* data = offsets + (count+1)*4;
+	size_t datasize = getu32(offsets + count*4);
+	if ((data + datasize) > (s + size))
+		goto corrupt;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t start = getu32(offsets + i*4);
+		uint32_t end = getu32(offsets + (i+1)*4);
+		if ((start > end) || (end > datasize))
+			goto corrupt;
+
+		const uint8_t* p = data + start;
+		const uint8_t* pend = data + end;
+
+		int words = 0;
+		for (const uint8_t* q = p; q < pend; q++)
+			if (*q == ' ')
+				words++;
+
+		lua_createtable(L, words, 1);
+
+		const uint8_t* q = memchr(p, ' ', pend - p);
+		if (!q)
+			q = pend;
+		lua_pushlstring(L, (const char*) p, q - p);
+		lua_setfield(L, -2, "style");
+
+		for (int wn = 1; wn <= words; wn++)
+		{
+			p = q + 1;
+			q = memchr(p, ' ', pend - p);
+			if (!q)
+				q = pend;
+			lua_pushlstring(L, (const char*) p, q - p);
+			lua_rawseti(L, -2, wn);
+		}
+
+		lua_pushvalue(L, 4);
+		lua_setmetatable(L, -2);
+		lua_rawseti(L, 3, i+1);
+	}
+
+	lua_pushinteger(L, (data + datasize - s) + 1);
+	return 1;
+
+corrupt:
+	return luaL_error(L, "corrupt paragraph data");
+}
+
 void utils_init(void)
 {
 	const static luaL_Reg funcs[] =
@@ -273,6 +477,8 @@ void utils_init(void)
 		{ "time",                      time_cb },
 		{ "escape",                    escape_cb },
 		{ "unescape",                  unescape_cb },
+		{ "encodeparagraphs",          encodeparagraphs_cb },
+		{ "decodeparagraphs",          decodeparagraphs_cb },
 		{ NULL,                        NULL }
 	};
 
@@ -88,38 +88,67 @@ static int parseword_cb(lua_State* L)
 	return 0;
 }
 
-/* Draw a styled word at a particular location. */
+/* Draws a styled word at a particular location, and returns the attributes
+ * in force at its end. oattr is whatever was in force at the end of the
+ * previous word, and is used to carry underlining and reverse video across
+ * the space between them. revon and revoff are the byte offsets at which
+ * the mark starts and stops, or -1. *current caches the display's
+ * attributes so that dpy_setattr() is only called when they change.
+ *
+ * Characters are collected into runs with the same attributes, which are
+ * written out in one go (or in SPANSIZE pieces, for enormous words). */
 
-static int writestyled_cb(lua_State* L)
+#define SPANSIZE 256
+
+struct span
 {
-	int x = forceinteger(L, 1);
-	int y = forceinteger(L, 2);
-	size_t size;
-	const char* s = luaL_checklstring(L, 3, &size);
-	const char* send = s + size;
-	int oattr = forceinteger(L, 4);
-	const char* revon = s + forceinteger(L, 5) - 1;
-	const char* revoff = s + forceinteger(L, 6) - 1;
-	int sor = forceinteger(L, 7);
-	
-	int istable = forceinteger(L, 8);
+	int x;
+	int y;
+	int len;
+	uni_t* chars;
+};
+
+static void flushspan(struct span* span)
+{
+	if (span->len)
+		dpy_writespan(span->x, span->y, span->chars, span->len);
+	span->len = 0;
+}
 
+static void setattr(int* current, int attr, struct span* span)
+{
+	if (*current != attr)
+	{
+		flushspan(span);
+		dpy_setattr(0, attr);
+		*current = attr;
+	}
+}
+
+static int drawword(int* current, int x, int y, const char* s, size_t size,
+	int oattr, int revon, int revoff, int sor, bool istable)
+{
+	const char* start = s;
+	const char* send = s + size;
 	int attr = sor;
 	int mark = 0;
 
-	dpy_setattr(0, sor);
+	uni_t chars[SPANSIZE];
+	struct span span = { x, y, 0, chars };
+
+	setattr(current, sor, &span);
 	bool first = true;
 	while (s < send)
 	{
-		if (s == revon)
+		if ((s - start) == revon)
 		{
 			mark = DPY_REVERSE;
-			dpy_setattr(0, attr | mark);
+			setattr(current, attr | mark, &span);
 		}
-		if (s == revoff)
+		if ((s - start) == revoff)
 		{
 			mark = 0;
-			dpy_setattr(0, attr | mark);
+			setattr(current, attr | mark, &span);
 		}
 
 		uni_t c = readu8(&s);
@@ -128,7 +157,7 @@ static int writestyled_cb(lua_State* L)
 		{
 			c &= STYLE_ALL;
 			attr = c | sor;
-			dpy_setattr(0, attr | mark);
+			setattr(current, attr | mark, &span);
 		}
 		else
 		{
@@ -140,17 +169,156 @@ static int writestyled_cb(lua_State* L)
 				if (c == ';')
 					c = ' ';
 
-			dpy_writechar(x, y, c);
+			if (span.len == SPANSIZE)
+				flushspan(&span);
+			if (!span.len)
+				span.x = x;
+			span.chars[span.len++] = c;
 			x += emu_wcwidth(c);
 			first = false;
 		}
 	}
+	flushspan(&span);
+
+	return attr | mark;
+}
+
+/* Draw a styled word at a particular location. */
+
+static int writestyled_cb(lua_State* L)
+{
+	int x = forceinteger(L, 1);
+	int y = forceinteger(L, 2);
+	size_t size;
+	const char* s = luaL_checklstring(L, 3, &size);
+	int oattr = forceinteger(L, 4);
+	int revon = forceinteger(L, 5) - 1;
+	int revoff = forceinteger(L, 6) - 1;
+	int sor = forceinteger(L, 7);
+	
+	int istable = forceinteger(L, 8);
+
+	int current = -1;
+	int attr = drawword(&current, x, y, s, size, oattr, revon, revoff, sor,
+		istable);
 	dpy_setattr(0, 0);
 
-	lua_pushnumber(L, attr | mark);
+	lua_pushnumber(L, attr);
 	return 1;
 }
 
+/* Works out where the mark starts and stops in word wn of paragraph pn, as
+ * 1-based byte offsets (or 0, for nowhere). m is { pn, mp1, mw1, mo1, mp2,
+ * mw2, mo2 }, with the start of the mark before the end. */
+
+static void findmark(const int* m, int wn, int* s, int* e)
+{
+	int pn = m[0];
+	int mp1 = m[1], mw1 = m[2], mo1 = m[3];
+	int mp2 = m[4], mw2 = m[5], mo2 = m[6];
+
+	*s = *e = 0;
+	if ((pn < mp1) || (pn > mp2))
+		return;
+	if ((pn > mp1) && (pn < mp2))
+		*s = 1;
+	else if ((pn == mp1) && (pn == mp2))
+	{
+		if ((wn == mw1) && (wn == mw2))
+		{
+			*s = mo1;
+			*e = mo2;
+		}
+		else if (wn == mw1)
+			*s = mo1;
+		else if (wn == mw2)
+		{
+			*s = 1;
+			*e = mo2;
+		}
+		else if ((wn > mw1) && (wn < mw2))
+			*s = 1;
+	}
+	else if (pn == mp1)
+	{
+		if (wn > mw1)
+			*s = 1;
+		else if (wn == mw1)
+			*s = mo1;
+	}
+	else
+	{
+		if (wn < mw2)
+			*s = 1;
+		else if (wn == mw2)
+		{
+			*s = 1;
+			*e = mo2;
+		}
+	}
+}
+
+/* Draws a whole wrapped line in one go:
+ * renderline(paragraph, line, x, y, istable, words, styles [, marks]).
+ * line is a list of word numbers, positioned using paragraph.xs; words and
+ * styles hold the text and base style of each word on the line. marks, if
+ * given, is { pn, mp1, mw1, mo1, mp2, mw2, mo2 }. */
+
+static int renderline_cb(lua_State* L)
+{
+	luaL_checktype(L, 1, LUA_TTABLE);
+	luaL_checktype(L, 2, LUA_TTABLE);
+	int x = forceinteger(L, 3);
+	int y = forceinteger(L, 4);
+	bool istable = lua_toboolean(L, 5);
+	luaL_checktype(L, 6, LUA_TTABLE);
+	luaL_checktype(L, 7, LUA_TTABLE);
+	bool marked = lua_istable(L, 8);
+
+	int m[7];
+	if (marked)
+	{
+		for (int i = 0; i < 7; i++)
+		{
+			lua_rawgeti(L, 8, i+1);
+			m[i] = lua_tointeger(L, -1);
+			lua_pop(L, 1);
+		}
+	}
+
+	lua_getfield(L, 1, "xs");
+	int xs = lua_gettop(L);
+	luaL_checktype(L, xs, LUA_TTABLE);
+
+	int count = lua_rawlen(L, 2);
+	int current = -1;
+	int attr = 0;
+	for (int i = 1; i <= count; i++)
+	{
+		lua_rawgeti(L, 2, i);
+		int wn = lua_tointeger(L, -1);
+		lua_rawgeti(L, xs, wn);
+		int wx = lua_tointeger(L, -1);
+		lua_rawgeti(L, 6, i);
+		size_t size;
+		const char* s = luaL_checklstring(L, -1, &size);
+		lua_rawgeti(L, 7, i);
+		int sor = lua_tointeger(L, -1);
+
+		int revon = 0;
+		int revoff = 0;
+		if (marked)
+			findmark(m, wn, &revon, &revoff);
+
+		attr = drawword(&current, x + wx, y, s, size, attr, revon - 1,
+			revoff - 1, sor, istable);
+		lua_pop(L, 4);
+	}
+	dpy_setattr(0, 0);
+
+	return 0;
+}
+
 /* Returns the raw text of a word, with no styling. */
 
 static int getwordtext_cb(lua_State* L)
@@ -471,6 +639,199 @@ static int createstylebyte_cb(lua_State* L)
 	return 1;
 }
 
+/* Wraps a paragraph's words into lines.
+ *
+ * Takes the paragraph (or any array of words), the wrap width, the indents of
+ * the first and subsequent lines, the justification mode and whether full
+ * stops get an extra space. Returns the array of lines (each an array of word
+ * numbers plus a 'wn' field), the array of word x offsets, and the set of
+ * words which start sentences. The layout rules exactly match the original
+ * Lua implementations of ParagraphClass:wrap(), wrapBoth(), wrapRight() and
+ * wrapCenter(), quirks included.
+ */
+
+enum
+{
+	WRAP_LEFT,
+	WRAP_BOTH,
+	WRAP_RIGHT,
+	WRAP_CENTER
+};
+
+struct wrapword
+{
+	int width; /* including trailing space(s) */
+	bool fullstop;
+	double x;
+};
+
+struct wrapline
+{
+	int start; /* first word number */
+	int end; /* one past last word number */
+	int width;
+};
+
+static int wrapparagraph_cb(lua_State* L)
+{
+	static const char* const modes[] = { "left", "both", "right", "center", NULL };
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+	int width = forceinteger(L, 2);
+	int firstindent = forceinteger(L, 3);
+	int indent = forceinteger(L, 4);
+	int mode = luaL_checkoption(L, 5, "left", modes);
+	bool fullstopspaces = lua_toboolean(L, 6);
+	int count = lua_rawlen(L, 1);
+
+	/* Scratch space lives in userdata so it gets collected if anything in here
+	 * throws. Words are numbered from 1, like Lua. There can be at most one
+	 * more line than there are words (an overlong first word produces an empty
+	 * first line). */
+
+	struct wrapword* words = lua_newuserdata(L, (count+1) * sizeof(*words));
+	struct wrapline* lines = lua_newuserdata(L, (count+2) * sizeof(*lines));
+
+	for (int wn = 1; wn <= count; wn++)
+	{
+		size_t size;
+		lua_rawgeti(L, 1, wn);
+		const char* s = luaL_checklstring(L, -1, &size);
+		const char* send = s + size;
+
+		struct wrapword* word = &words[wn];
+		word->fullstop = (size > 0) && (send[-1] == '.');
+		word->width = 1;
+		while (s < send)
+		{
+			uni_t c = readu8(&s);
+			if (!iswcntrl(c))
+				word->width += emu_wcwidth(c);
+		}
+		if (fullstopspaces && word->fullstop)
+			word->width++;
+
+		lua_pop(L, 1);
+	}
+
+	/* Break the words into lines. Only left and both justification take the
+	 * indents into account. */
+
+	bool indented = (mode == WRAP_LEFT) || (mode == WRAP_BOTH);
+	int available = indented ? (width - firstindent) : width;
+	int nlines = 0;
+	int start = 1;
+	int w = 0;
+	for (int wn = 1; wn <= count; wn++)
+	{
+		struct wrapword* word = &words[wn];
+		word->x = w;
+		w += word->width;
+		if (w >= available)
+		{
+			lines[nlines].start = start;
+			lines[nlines].end = wn;
+			lines[nlines].width = w - word->width;
+			nlines++;
+			if (indented && (nlines == 1))
+				available += firstindent - indent;
+
+			start = wn;
+			w = word->width;
+			word->x = 0;
+		}
+	}
+	if (start <= count)
+	{
+		lines[nlines].start = start;
+		lines[nlines].end = count + 1;
+		lines[nlines].width = w;
+		nlines++;
+	}
+
+	/* Adjust the word positions for the justification mode. */
+
+	switch (mode)
+	{
+		case WRAP_BOTH:
+			/* Pad every line except the last one out to the full width,
+			 * distributing the extra spaces from the left. */
+			for (int ln = 0; ln < (nlines-1); ln++)
+			{
+				struct wrapline* line = &lines[ln];
+				int nw = line->end - line->start;
+				int dw = (ln == 0) ? (available - firstindent) : available;
+				int n = 1;
+				for (int w = line->width; w < dw; w++)
+				{
+					if (n > nw)
+						n = 1;
+					for (int i = n; i < nw; i++)
+						words[line->start + i].x++;
+					n++;
+				}
+			}
+			break;
+
+		case WRAP_RIGHT:
+		case WRAP_CENTER:
+			for (int ln = 0; ln < nlines; ln++)
+			{
+				struct wrapline* line = &lines[ln];
+				double x;
+				if (mode == WRAP_RIGHT)
+					x = width - line->width;
+				else
+					x = (double)width/2 - (double)line->width/2;
+
+				for (int wn = line->start; wn < line->end; wn++)
+				{
+					words[wn].x = x;
+					x += words[wn].width;
+				}
+			}
+			break;
+	}
+
+	/* Build the results. */
+
+	lua_createtable(L, nlines, 0);
+	for (int ln = 0; ln < nlines; ln++)
+	{
+		struct wrapline* line = &lines[ln];
+		lua_createtable(L, line->end - line->start, 1);
+		for (int wn = line->start; wn < line->end; wn++)
+		{
+			lua_pushnumber(L, wn);
+			lua_rawseti(L, -2, wn - line->start + 1);
+		}
+		lua_pushnumber(L, line->start);
+		lua_setfield(L, -2, "wn");
+		lua_rawseti(L, -2, ln + 1);
+	}
+
+	lua_createtable(L, count, 0);
+	for (int wn = 1; wn <= count; wn++)
+	{
+		lua_pushnumber(L, words[wn].x);
+		lua_rawseti(L, -2, wn);
+	}
+
+	lua_createtable(L, count, 0);
+	bool issentence = true;
+	for (int wn = 1; wn <= count; wn++)
+	{
+		if (issentence || (wn == count))
+		{
+			lua_pushboolean(L, true);
+			lua_rawseti(L, -2, wn);
+		}
+		issentence = words[wn].fullstop;
+	}
+
+	return 3;
+}
+
 /* Draw a row. */
 
 static int writerow_cb(lua_State* L)
@@ -496,6 +857,7 @@ void word_init(void)
 	{
 		{ "parseword",                 parseword_cb },
 		{ "writestyled",               writestyled_cb },
+		{ "renderline",                renderline_cb },
 		{ "getwordtext",               getwordtext_cb },
 		{ "nextcharinword",            nextcharinword_cb },
 		{ "prevcharinword",            prevcharinword_cb },
@@ -504,6 +866,7 @@ void word_init(void)
 		{ "applystyletoword",          applystyletoword_cb },
 		{ "getstylefromword",          getstylefromword_cb },
 		{ "createstylebyte",           createstylebyte_cb },
+		{ "wrapparagraph",             wrapparagraph_cb },
 		{ "writerow",                  writerow_cb },
 		{ NULL,                        NULL }
 	};
@@ -0,0 +1,884 @@
+/* © 2013 David Given.
+ * WordGrinder is licensed under the MIT open source license. See the COPYING
+ * file in this distribution for the full text.
+ */
+
+#include "globals.h"
+#include <string.h>
+#include <ctype.h>
+
+/* A streaming XML tokeniser. This produces exactly the same tokens as the
+ * original Lua one did (see TokeniseXML in xml.lua), including its whitespace
+ * collapsing, but does it in a single pass over the input rather than
+ * rewriting the whole document several times with gsub and then matching
+ * patterns against it. */
+
+#define TOKENISER_METATABLE "wg.xmltokeniser"
+
+/* Input is whitespace-collapsed this many bytes at a time. */
+#define BLOCKSIZE (64*1024)
+
+enum
+{
+	WS_NONE,
+	WS_SPACE,
+	WS_NEWLINE
+};
+
+struct span
+{
+	size_t start; /* relative to the current token */
+	size_t len;
+};
+
+struct string
+{
+	char* data;
+	size_t len;
+};
+
+struct binding
+{
+	struct string prefix;
+	struct string uri;
+};
+
+struct element
+{
+	struct string namespace;
+	struct string name;
+	int nbindings; /* bindings in scope outside this element */
+};
+
+struct attribute
+{
+	const char* prefix;
+	size_t prefixlen;
+	const char* name;
+	size_t namelen;
+	const char* value;
+	size_t valuelen;
+};
+
+struct tokeniser
+{
+	/* The state the iterator is being called from. */
+	lua_State* L;
+
+	/* Raw input: either the whole document, or the current chunk from a
+	 * reader function (both kept alive by the iterator's upvalues). */
+	const char* src;
+	size_t srclen;
+	size_t srcpos;
+	bool reader;
+
+	/* Whitespace-collapsed input; pos is the start of the current token. */
+	char* buf;
+	size_t bufsize;
+	size_t pos;
+	size_t len;
+	bool eof;
+
+	/* Whitespace collapsing state. */
+	int ws;
+	int lastc;
+	bool converted;
+	int sinceconverted;
+
+	/* Namespace prefixes in scope. */
+	struct binding* bindings;
+	int nbindings;
+	int maxbindings;
+
+	/* Currently open elements. */
+	struct element* elements;
+	int depth;
+	int maxdepth;
+
+	struct attribute* attrs;
+	int maxattrs;
+
+	bool closepending;
+	bool finished;
+};
+
+static void* grow(void* p, int* max, int want, size_t size)
+{
+	if (want <= *max)
+		return p;
+
+	int n = *max ? (*max * 2) : 16;
+	while (n < want)
+		n *= 2;
+	p = realloc(p, n * size);
+	if (!p)
+		abort();
+	*max = n;
+	return p;
+}
+
+static void setstring(struct string* s, const char* data, size_t len)
+{
+	s->data = malloc(len + 1);
+	if (!s->data)
+		abort();
+	memcpy(s->data, data, len);
+	s->len = len;
+}
+
+static bool is_space(int c)
+{
+	return (c >= 0) && isspace(c);
+}
+
+/* [%w_-] */
+static bool is_name1(int c)
+{
+	return (c >= 0) && (isalnum(c) || (c == '_') || (c == '-'));
+}
+
+/* [%w+-] */
+static bool is_name2(int c)
+{
+	return (c >= 0) && (isalnum(c) || (c == '+') || (c == '-'));
+}
+
+/* Fetches the next chunk of raw input from the reader function, if there is
+ * one. Returns false at the end of the input. */
+
+static bool fetch(struct tokeniser* t)
+{
+	lua_State* L = t->L;
+	if (!t->reader)
+		return false;
+
+	for (;;)
+	{
+		lua_pushvalue(L, lua_upvalueindex(2));
+		lua_call(L, 0, 1);
+		if (lua_isnil(L, -1))
+		{
+			lua_pop(L, 1);
+			t->reader = false;
+			return false;
+		}
+
+		size_t len;
+		const char* chunk = lua_tolstring(L, -1, &len);
+		if (!chunk)
+			luaL_error(L, "XML reader returned a %s", luaL_typename(L, -1));
+		lua_replace(L, lua_upvalueindex(3));
+		if (len)
+		{
+			t->src = chunk;
+			t->srclen = len;
+			t->srcpos = 0;
+			return true;
+		}
+	}
+}
+
+/* Collapses the next block of input onto the end of the buffer, the same way
+ * that the old gsub passes did: spaces and tabs become a single space, runs
+ * containing a newline disappear (or become a space, if they're between two
+ * pieces of text), and a space between two tags goes. Returns false if there
+ * was nothing left to read. */
+
+static bool more(struct tokeniser* t)
+{
+	if (t->eof)
+		return false;
+
+	if ((t->srcpos == t->srclen) && !fetch(t))
+	{
+		if (t->ws == WS_SPACE)
+		{
+			if (t->len == t->bufsize)
+			{
+				t->buf = realloc(t->buf, t->bufsize + 1);
+				if (!t->buf)
+					abort();
+				t->bufsize++;
+			}
+			t->buf[t->len++] = ' ';
+		}
+		t->ws = WS_NONE;
+		t->eof = true;
+		return true;
+	}
+
+	size_t n = t->srclen - t->srcpos;
+	if (n > BLOCKSIZE)
+		n = BLOCKSIZE;
+
+	if ((t->len + n*2 + 1) > t->bufsize)
+	{
+		size_t size = t->bufsize ? t->bufsize : BLOCKSIZE;
+		while (size < (t->len + n*2 + 1))
+			size *= 2;
+		t->buf = realloc(t->buf, size);
+		if (!t->buf)
+			abort();
+		t->bufsize = size;
+	}
+
+	const char* s = t->src + t->srcpos;
+	const char* send = s + n;
+	char* out = t->buf + t->len;
+	while (s < send)
+	{
+		int c = (unsigned char) *s++;
+		switch (c)
+		{
+			case '\r':
+				continue;
+
+			case '\t':
+			case ' ':
+				if (t->ws == WS_NONE)
+					t->ws = WS_SPACE;
+				continue;
+
+			case '\n':
+				t->ws = WS_NEWLINE;
+				continue;
+		}
+
+		if (t->ws == WS_SPACE)
+		{
+			if ((t->lastc != '>') || (c != '<'))
+				*out++ = ' ';
+			t->converted = false;
+		}
+		else if (t->ws == WS_NEWLINE)
+		{
+			/* A newline between two other characters becomes a space,
+			 * except that the old pattern couldn't match two in a row
+			 * separated by only one character. */
+
+			if ((t->lastc != -1) && (t->lastc != '>') && (c != '<') &&
+				!(t->converted && (t->sinceconverted == 1)))
+			{
+				*out++ = ' ';
+				t->converted = true;
+				t->sinceconverted = 0;
+			}
+			else
+				t->converted = false;
+		}
+
+		t->ws = WS_NONE;
+		*out++ = c;
+		t->lastc = c;
+		t->sinceconverted++;
+	}
+
+	t->srcpos += n;
+	t->len = out - t->buf;
+	return true;
+}
+
+/* Returns the character at offset i in the current token, or -1 at the end
+ * of the input. */
+
+static int peek(struct tokeniser* t, size_t i)
+{
+	while ((t->pos + i) >= t->len)
+	{
+		if (!more(t))
+			return -1;
+	}
+	return (unsigned char) t->buf[t->pos + i];
+}
+
+/* Finds the first c at or after offset i in the current token. */
+
+static bool find(struct tokeniser* t, size_t i, char c, size_t* result)
+{
+	for (;;)
+	{
+		if ((t->pos + i) < t->len)
+		{
+			const char* p = memchr(t->buf + t->pos + i, c, t->len - t->pos - i);
+			if (p)
+			{
+				*result = p - (t->buf + t->pos);
+				return true;
+			}
+			i = t->len - t->pos;
+		}
+
+		if (!more(t))
+			return false;
+	}
+}
+
+static size_t skip_spaces(struct tokeniser* t, size_t i)
+{
+	while (is_space(peek(t, i)))
+		i++;
+	return i;
+}
+
+/* Matches ([%w_-]+)(:?)([%w+-]*) at offset i, returning the offset after it;
+ * s1 is empty if there's no match. */
+
+static size_t qname(struct tokeniser* t, size_t i,
+		struct span* s1, bool* colon, struct span* s3)
+{
+	s1->start = i;
+	while (is_name1(peek(t, i)))
+		i++;
+	s1->len = i - s1->start;
+
+	*colon = (peek(t, i) == ':');
+	if (*colon)
+		i++;
+
+	s3->start = i;
+	while (is_name2(peek(t, i)))
+		i++;
+	s3->len = i - s3->start;
+	return i;
+}
+
+static const char* at(struct tokeniser* t, struct span* s)
+{
+	return t->buf + t->pos + s->start;
+}
+
+static void free_bindings(struct tokeniser* t, int nbindings)
+{
+	while (t->nbindings > nbindings)
+	{
+		struct binding* b = &t->bindings[--t->nbindings];
+		free(b->prefix.data);
+		free(b->uri.data);
+	}
+}
+
+static void add_binding(struct tokeniser* t,
+		const char* prefix, size_t prefixlen, const char* uri, size_t urilen)
+{
+	t->bindings = grow(t->bindings, &t->maxbindings,
+			t->nbindings+1, sizeof(*t->bindings));
+
+	struct binding* b = &t->bindings[t->nbindings++];
+	setstring(&b->prefix, prefix, prefixlen);
+	setstring(&b->uri, uri, urilen);
+}
+
+/* Looks up a namespace prefix in the bindings from base upwards. */
+
+static struct binding* lookup(struct tokeniser* t, int base,
+		const char* prefix, size_t prefixlen)
+{
+	for (int i = t->nbindings-1; i >= base; i--)
+	{
+		struct binding* b = &t->bindings[i];
+		if ((b->prefix.len == prefixlen) &&
+				(memcmp(b->prefix.data, prefix, prefixlen) == 0))
+			return b;
+	}
+	return NULL;
+}
+
+/* Pushes the URI bound to a namespace prefix, or the prefix itself if it's
+ * not bound. */
+
+static void push_namespace(lua_State* L, struct tokeniser* t, int base,
+		const char* prefix, size_t prefixlen)
+{
+	struct binding* b = lookup(t, base, prefix, prefixlen);
+	if (b)
+		lua_pushlstring(L, b->uri.data, b->uri.len);
+	else
+		lua_pushlstring(L, prefix, prefixlen);
+}
+
+/* Parses the attributes in s, adding any namespace declarations to the
+ * bindings, and pushes the rest as a table. Namespaces are looked up in the
+ * bindings from base upwards. */
+
+static void push_attributes(lua_State* L, struct tokeniser* t, int base,
+		const char* s, const char* send)
+{
+	int nattrs = 0;
+
+	for (;;)
+	{
+		/* %s*([%w_-]+)(:?)([%w+-]*)%s*=%s*"([^"]*)", or with ' */
+
+		const char* p = s;
+		while ((p < send) && is_space((unsigned char) *p))
+			p++;
+
+		const char* s1 = p;
+		while ((p < send) && is_name1((unsigned char) *p))
+			p++;
+		size_t s1len = p - s1;
+		if (!s1len)
+			break;
+
+		bool colon = (p < send) && (*p == ':');
+		if (colon)
+			p++;
+
+		const char* s3 = p;
+		while ((p < send) && is_name2((unsigned char) *p))
+			p++;
+		size_t s3len = p - s3;
+
+		while ((p < send) && is_space((unsigned char) *p))
+			p++;
+		if ((p == send) || (*p != '='))
+			break;
+		p++;
+		while ((p < send) && is_space((unsigned char) *p))
+			p++;
+		if ((p == send) || ((*p != '"') && (*p != '\'')))
+			break;
+
+		char quote = *p++;
+		const char* value = p;
+		while ((p < send) && (*p != quote))
+			p++;
+		if (p == send)
+			break;
+		size_t valuelen = p - value;
+		s = p + 1;
+
+		const char* prefix = "";
+		size_t prefixlen = 0;
+		const char* name = s1;
+		size_t namelen = s1len;
+		if (colon)
+		{
+			prefix = s1;
+			prefixlen = s1len;
+			name = s3;
+			namelen = s3len;
+		}
+
+		if ((prefixlen == 5) && (memcmp(prefix, "xmlns", 5) == 0))
+			add_binding(t, name, namelen, value, valuelen);
+		else if ((prefixlen == 0) && (namelen == 5) &&
+				(memcmp(name, "xmlns", 5) == 0))
+			add_binding(t, "", 0, value, valuelen);
+		else
+		{
+			t->attrs = grow(t->attrs, &t->maxattrs, nattrs+1, sizeof(*t->attrs));
+			struct attribute* a = &t->attrs[nattrs++];
+			a->prefix = prefix;
+			a->prefixlen = prefixlen;
+			a->name = name;
+			a->namelen = namelen;
+			a->value = value;
+			a->valuelen = valuelen;
+		}
+	}
+
+	lua_createtable(L, nattrs, 0);
+	for (int i = 0; i < nattrs; i++)
+	{
+		struct attribute* a = &t->attrs[i];
+		lua_createtable(L, 0, 3);
+
+		push_namespace(L, t, base, a->prefix, a->prefixlen);
+		lua_setfield(L, -2, "namespace");
+
+		lua_pushlstring(L, a->name, a->namelen);
+		lua_setfield(L, -2, "name");
+
+		lua_pushlstring(L, a->value, a->valuelen);
+		lua_setfield(L, -2, "value");
+
+		lua_rawseti(L, -2, i+1);
+	}
+}
+
+static void push_token(lua_State* L, const char* event)
+{
+	lua_createtable(L, 0, 4);
+	lua_pushstring(L, event);
+	lua_setfield(L, -2, "event");
+}
+
+static void push_text(lua_State* L, const char* s, size_t len)
+{
+	push_token(L, "text");
+	lua_pushlstring(L, s, len);
+	lua_setfield(L, -2, "text");
+}
+
+/* <%s*([%w_-]+)(:?)([%w+-]*)%s*(.-)(/?)> */
+
+static bool opentag(lua_State* L, struct tokeniser* t)
+{
+	struct span s1, s3;
+	bool colon;
+	size_t i = skip_spaces(t, 1);
+	i = qname(t, i, &s1, &colon, &s3);
+	if (!s1.len)
+		return false;
+	i = skip_spaces(t, i);
+
+	size_t end;
+	if (!find(t, i, '>', &end))
+		return false;
+
+	bool selfclosing = (end > i) && (t->buf[t->pos + end - 1] == '/');
+	const char* attrs = t->buf + t->pos + i;
+	const char* attrsend = t->buf + t->pos + end - (selfclosing ? 1 : 0);
+
+	t->elements = grow(t->elements, &t->maxdepth, t->depth+1,
+			sizeof(*t->elements));
+	struct element* e = &t->elements[t->depth++];
+	e->nbindings = t->nbindings;
+
+	push_token(L, "opentag");
+	push_attributes(L, t, 0, attrs, attrsend);
+	lua_setfield(L, -2, "attrs");
+
+	if (colon)
+	{
+		struct binding* b = lookup(t, 0, at(t, &s1), s1.len);
+		if (b)
+			setstring(&e->namespace, b->uri.data, b->uri.len);
+		else
+			setstring(&e->namespace, at(t, &s1), s1.len);
+		setstring(&e->name, at(t, &s3), s3.len);
+	}
+	else
+	{
+		/* With no default namespace, the old code used the tag name. */
+
+		struct binding* b = lookup(t, 0, "", 0);
+		if (b)
+			setstring(&e->namespace, b->uri.data, b->uri.len);
+		else
+			setstring(&e->namespace, at(t, &s1), s1.len);
+		setstring(&e->name, at(t, &s1), s1.len);
+	}
+
+	lua_pushlstring(L, e->namespace.data, e->namespace.len);
+	lua_setfield(L, -2, "namespace");
+	lua_pushlstring(L, e->name.data, e->name.len);
+	lua_setfield(L, -2, "name");
+
+	t->pos += end + 1;
+	t->closepending = selfclosing;
+	return true;
+}
+
+/* Pops the innermost element and pushes its closetag. */
+
+static int closetag(lua_State* L, struct tokeniser* t)
+{
+	struct element* e = &t->elements[--t->depth];
+
+	push_token(L, "closetag");
+	lua_pushlstring(L, e->namespace.data, e->namespace.len);
+	lua_setfield(L, -2, "namespace");
+	lua_pushlstring(L, e->name.data, e->name.len);
+	lua_setfield(L, -2, "name");
+
+	free(e->namespace.data);
+	free(e->name.data);
+	free_bindings(t, e->nbindings);
+	return 1;
+}
+
+/* </%s*([%w_-]+)(:?)([%w+-]*)%s*> */
+
+static bool match_closetag(struct tokeniser* t)
+{
+	if (peek(t, 1) != '/')
+		return false;
+
+	struct span s1, s3;
+	bool colon;
+	size_t i = skip_spaces(t, 2);
+	i = qname(t, i, &s1, &colon, &s3);
+	if (!s1.len)
+		return false;
+	i = skip_spaces(t, i);
+	if (peek(t, i) != '>')
+		return false;
+
+	t->pos += i + 1;
+	return true;
+}
+
+/* <%?([%w_-]+)%s*(.-)%?> */
+
+static bool processing(lua_State* L, struct tokeniser* t)
+{
+	if (peek(t, 1) != '?')
+		return false;
+
+	size_t i = 2;
+	while (is_name1(peek(t, i)))
+		i++;
+	if (i == 2)
+		return false;
+	size_t namelen = i - 2;
+	i = skip_spaces(t, i);
+
+	size_t end = i;
+	for (;;)
+	{
+		if (!find(t, end, '>', &end))
+			return false;
+		if ((end > i) && (t->buf[t->pos + end - 1] == '?'))
+			break;
+		end++;
+	}
+
+	int nbindings = t->nbindings;
+	push_token(L, "processing");
+	lua_pushlstring(L, t->buf + t->pos + 2, namelen);
+	lua_setfield(L, -2, "name");
+	push_attributes(L, t, nbindings,
+		t->buf + t->pos + i, t->buf + t->pos + end - 1);
+	lua_setfield(L, -2, "attrs");
+	free_bindings(t, nbindings);
+
+	t->pos += end + 1;
+	return true;
+}
+
+/* &#(%d+); or &#x(%x+); or &(%w+); */
+
+static bool entity(lua_State* L, struct tokeniser* t)
+{
+	size_t i = 1;
+	if (peek(t, 1) == '#')
+	{
+		/* The value is clamped as it's read, so there's no limit on the
+		 * number of digits. */
+
+		uint32_t v = 0;
+		if (isdigit(peek(t, 2)))
+		{
+			i = 2;
+			int c;
+			while (isdigit(c = peek(t, i)))
+			{
+				v = (v > (0x7fffffff / 10)) ? 0x7fffffff : (v*10 + (c - '0'));
+				i++;
+			}
+		}
+		else if (peek(t, 2) == 'x')
+		{
+			i = 3;
+			int c;
+			while (((c = peek(t, i)) >= 0) && isxdigit(c))
+			{
+				int digit = isdigit(c) ? (c - '0') : (tolower(c) - 'a' + 10);
+				v = (v > (0x7fffffff / 16)) ? 0x7fffffff : (v*16 + digit);
+				i++;
+			}
+			if (i == 3)
+				return false;
+		}
+		else
+			return false;
+		if (peek(t, i) != ';')
+			return false;
+		if (v > 0x7fffffff)
+			v = 0x7fffffff;
+
+		char buffer[8];
+		char* p = buffer;
+		writeu8(&p, (uni_t) v);
+		push_text(L, buffer, p - buffer);
+	}
+	else
+	{
+		while ((peek(t, i) >= 0) && isalnum(peek(t, i)))
+			i++;
+		if ((i == 1) || (peek(t, i) != ';'))
+			return false;
+
+		const char* name = t->buf + t->pos + 1;
+		size_t len = i - 1;
+		const char* s = "invalidentity";
+		if ((len == 3) && (memcmp(name, "amp", 3) == 0))
+			s = "&";
+		else if ((len == 2) && (memcmp(name, "lt", 2) == 0))
+			s = "<";
+		else if ((len == 2) && (memcmp(name, "gt", 2) == 0))
+			s = ">";
+		else if ((len == 4) && (memcmp(name, "quot", 4) == 0))
+			s = "\"";
+		else if ((len == 4) && (memcmp(name, "apos", 4) == 0))
+			s = "'";
+		push_text(L, s, strlen(s));
+	}
+
+	t->pos += i + 1;
+	return true;
+}
+
+/* [^&<]+ */
+
+static int text(lua_State* L, struct tokeniser* t)
+{
+	size_t i = 0;
+	for (;;)
+	{
+		const char* p = t->buf + t->pos + i;
+		const char* pend = t->buf + t->len;
+		while ((p < pend) && (*p != '&') && (*p != '<'))
+			p++;
+		i = p - (t->buf + t->pos);
+		if ((p < pend) || !more(t))
+			break;
+	}
+
+	push_text(L, t->buf + t->pos, i);
+	t->pos += i;
+	return 1;
+}
+
+static int error(lua_State* L, struct tokeniser* t)
+{
+	peek(t, 100);
+	size_t len = t->len - t->pos;
+	if (len > 101)
+		len = 101;
+
+	push_token(L, "error");
+	lua_pushlstring(L, t->buf + t->pos, len);
+	lua_setfield(L, -2, "text");
+
+	/* Each open element gets closed, and then the error is reported again
+	 * in its parent. */
+
+	if (t->depth)
+		t->closepending = true;
+	else
+		t->finished = true;
+	return 1;
+}
+
+static int next_cb(lua_State* L)
+{
+	struct tokeniser* t = lua_touserdata(L, lua_upvalueindex(1));
+	t->L = L;
+
+	if (t->closepending)
+	{
+		t->closepending = false;
+		return closetag(L, t);
+	}
+	if (t->finished)
+		return 0;
+
+	if (t->pos >= BLOCKSIZE)
+	{
+		memmove(t->buf, t->buf + t->pos, t->len - t->pos);
+		t->len -= t->pos;
+		t->pos = 0;
+	}
+
+	switch (peek(t, 0))
+	{
+		case -1:
+			if (!t->depth)
+			{
+				t->finished = true;
+				return 0;
+			}
+			return closetag(L, t);
+
+		case '<':
+			if (opentag(L, t))
+				return 1;
+			if (match_closetag(t))
+			{
+				if (!t->depth)
+				{
+					t->finished = true;
+					return 0;
+				}
+				return closetag(L, t);
+			}
+			if (processing(L, t))
+				return 1;
+			break;
+
+		case '&':
+			if (entity(L, t))
+				return 1;
+			break;
+
+		default:
+			return text(L, t);
+	}
+
+	return error(L, t);
+}
+
+static int tokeniser_gc_cb(lua_State* L)
+{
+	struct tokeniser* t = luaL_checkudata(L, 1, TOKENISER_METATABLE);
+
+	while (t->depth)
+	{
+		struct element* e = &t->elements[--t->depth];
+		free(e->namespace.data);
+		free(e->name.data);
+	}
+	free_bindings(t, 0);
+	free(t->elements);
+	free(t->bindings);
+	free(t->attrs);
+	free(t->buf);
+	return 0;
+}
+
+/* xmltokens(xml): returns an iterator which produces the tokens in xml.
+ * xml is either a string or a function which returns successive chunks of
+ * it, and then nil; chunks are only asked for as they're needed. */
+
+static int xmltokens_cb(lua_State* L)
+{
+	bool reader = lua_isfunction(L, 1);
+	size_t size = 0;
+	const char* xml = NULL;
+	if (!reader)
+		xml = luaL_checklstring(L, 1, &size);
+
+	struct tokeniser* t = lua_newuserdata(L, sizeof(struct tokeniser));
+	memset(t, 0, sizeof(*t));
+	t->src = xml;
+	t->srclen = size;
+	t->reader = reader;
+	t->lastc = -1;
+	luaL_getmetatable(L, TOKENISER_METATABLE);
+	lua_setmetatable(L, -2);
+
+	lua_pushvalue(L, 1);
+	lua_pushnil(L);
+	lua_pushcclosure(L, next_cb, 3);
+	return 1;
+}
+
+void xml_init(void)
+{
+	luaL_newmetatable(L, TOKENISER_METATABLE);
+	lua_pushcfunction(L, tokeniser_gc_cb);
+	lua_setfield(L, -2, "__gc");
+	lua_pop(L, 1);
+
+	const static luaL_Reg funcs[] =
+	{
+		{ "xmltokens",                 xmltokens_cb },
+		{ NULL,                        NULL }
+	};
+
+	lua_getglobal(L, "wg");
+	luaL_setfuncs(L, funcs, 0);
+}
@@ -7,6 +7,7 @@
 #include <lua.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <zlib.h>
 #include "unzip.h"
 #include "zip.h"
@@ -109,40 +110,292 @@ static int compress_cb(lua_State* L)
 	return 1;
 }
 
-static int readfromzip_cb(lua_State* L)
+/* crc32(s, [offset, size]): returns the CRC32 of size bytes of s starting at
+ * (1-based) offset, or of the whole string. */
+
+static int crc32_cb(lua_State* L)
+{
+	size_t len;
+	const char* s = luaL_checklstring(L, 1, &len);
+	size_t offset = luaL_optinteger(L, 2, 1) - 1;
+	size_t size = luaL_optinteger(L, 3, len - offset);
+	if ((offset > len) || (size > (len - offset)))
+		return luaL_argerror(L, 3, "range out of bounds");
+
+	lua_pushnumber(L, crc32(crc32(0, NULL, 0), (const Bytef*) s + offset, size));
+	return 1;
+}
+
+/* A zip file is opened, and its central directory read, once; after that
+ * members are found by name in a sorted index of it rather than by scanning
+ * the directory again each time. Only one member can be open at a time. */
+
+#define ZIP_METATABLE "wg.zip"
+
+/* Members are read this many bytes at a time. */
+#define BLOCKSIZE (64*1024)
+
+struct member
+{
+	char* name;
+	int index;
+	unz_file_pos pos;
+};
+
+struct zip
+{
+	unzFile zf;
+	struct member* members;
+	int nmembers;
+	int reading;     /* the reader which owns the open member, or 0 */
+	int readers;     /* the number of readers handed out so far */
+	bool transient;  /* opened for a single call, by name */
+};
+
+static int compare_members(const void* p1, const void* p2)
+{
+	const struct member* m1 = p1;
+	const struct member* m2 = p2;
+	int i = strcmp(m1->name, m2->name);
+	if (i)
+		return i;
+	return m1->index - m2->index;
+}
+
+static void close_zip(struct zip* z)
+{
+	if (z->zf)
+	{
+		unzClose(z->zf);
+		z->zf = NULL;
+	}
+
+	for (int i = 0; i < z->nmembers; i++)
+		free(z->members[i].name);
+	free(z->members);
+	z->members = NULL;
+	z->nmembers = 0;
+	z->reading = 0;
+}
+
+static bool index_members(struct zip* z)
+{
+	int maxmembers = 0;
+	int i = unzGoToFirstFile(z->zf);
+	while (i == UNZ_OK)
+	{
+		unz_file_info fi;
+		if (unzGetCurrentFileInfo(z->zf, &fi, NULL, 0, NULL, 0, NULL, 0) != UNZ_OK)
+			return false;
+
+		if (z->nmembers == maxmembers)
+		{
+			maxmembers = maxmembers ? (maxmembers * 2) : 16;
+			struct member* members = realloc(z->members,
+				maxmembers * sizeof(struct member));
+			if (!members)
+				return false;
+			z->members = members;
+		}
+
+		char* name = malloc(fi.size_filename + 1);
+		if (!name)
+			return false;
+		unzGetCurrentFileInfo(z->zf, NULL, name, fi.size_filename + 1,
+			NULL, 0, NULL, 0);
+		name[fi.size_filename] = '\0';
+
+		struct member* m = &z->members[z->nmembers];
+		m->name = name;
+		m->index = z->nmembers;
+		unzGetFilePos(z->zf, &m->pos);
+		z->nmembers++;
+
+		i = unzGoToNextFile(z->zf);
+	}
+
+	if (i != UNZ_END_OF_LIST_OF_FILE)
+		return false;
+
+	qsort(z->members, z->nmembers, sizeof(struct member), compare_members);
+	return true;
+}
+
+/* Pushes a new zip object for zipname, or returns NULL (having pushed
+ * nothing) if it couldn't be opened. */
+
+static struct zip* push_zip(lua_State* L, const char* zipname)
+{
+	struct zip* z = lua_newuserdata(L, sizeof(struct zip));
+	memset(z, 0, sizeof(*z));
+	luaL_getmetatable(L, ZIP_METATABLE);
+	lua_setmetatable(L, -2);
+
+	z->zf = unzOpen(zipname);
+	if (!z->zf || !index_members(z))
+	{
+		close_zip(z);
+		lua_pop(L, 1);
+		return NULL;
+	}
+	return z;
+}
+
+/* The zip functions all take either a zip object or the name of a zip file,
+ * which is opened just for the call (replacing the name on the stack). */
+
+static struct zip* tozip(lua_State* L, int index)
+{
+	if (lua_type(L, index) == LUA_TSTRING)
+	{
+		struct zip* z = push_zip(L, lua_tostring(L, index));
+		if (!z)
+			return NULL;
+		z->transient = true;
+		lua_replace(L, index);
+		return z;
+	}
+
+	struct zip* z = luaL_checkudata(L, index, ZIP_METATABLE);
+	if (!z->zf)
+		luaL_error(L, "zip is closed");
+	return z;
+}
+
+static void done_with_zip(struct zip* z)
+{
+	if (z->transient)
+		close_zip(z);
+}
+
+static bool open_member(struct zip* z, const char* name)
+{
+	/* Find the first member called name (duplicates sort in directory
+	 * order, and the first one is the one unzLocateFile would find). */
+
+	int lo = 0;
+	int hi = z->nmembers;
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (strcmp(z->members[mid].name, name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if ((lo == z->nmembers) || strcmp(z->members[lo].name, name))
+		return false;
+	struct member* m = &z->members[lo];
+
+	if (z->reading)
+	{
+		unzCloseCurrentFile(z->zf);
+		z->reading = 0;
+	}
+	return (unzGoToFilePos(z->zf, &m->pos) == UNZ_OK) &&
+		(unzOpenCurrentFile(z->zf) == UNZ_OK);
+}
+
+/* openzip(zipname): returns a zip object, or nil if the file couldn't be
+ * opened. */
+
+static int openzip_cb(lua_State* L)
 {
 	const char* zipname = luaL_checkstring(L, 1);
+	if (!push_zip(L, zipname))
+		return 0;
+	return 1;
+}
+
+static int zip_close_cb(lua_State* L)
+{
+	struct zip* z = luaL_checkudata(L, 1, ZIP_METATABLE);
+	close_zip(z);
+	return 0;
+}
+
+/* readfromzip(zip, member): returns the whole of member as a string, or nil
+ * if it isn't there. */
+
+static int readfromzip_cb(lua_State* L)
+{
+	struct zip* z = tozip(L, 1);
 	const char* subname = luaL_checkstring(L, 2);
 	int result = 0;
 
-	unzFile zf = unzOpen(zipname);
-	if (zf)
+	if (z && open_member(z, subname))
 	{
-		int i = unzLocateFile(zf, subname, 0);
-		if (i == UNZ_OK)
-		{
-			unz_file_info fi;
-			unzGetCurrentFileInfo(zf, &fi,
-				NULL, 0, NULL, 0, NULL, 0);
+		char buffer[BLOCKSIZE];
+		luaL_Buffer b;
+		luaL_buffinit(L, &b);
+
+		int i;
+		while ((i = unzReadCurrentFile(z->zf, buffer, sizeof(buffer))) > 0)
+			luaL_addlstring(&b, buffer, i);
+		unzCloseCurrentFile(z->zf);
+
+		luaL_pushresult(&b);
+		result = (i == 0);
+		if (!result)
+			lua_pop(L, 1);
+	}
 
-			char* buffer = malloc(fi.uncompressed_size);
-			if (buffer)
-			{
-				unzOpenCurrentFile(zf);
-				i = unzReadCurrentFile(zf, buffer, fi.uncompressed_size);
-				if (i == fi.uncompressed_size)
-				{
-					lua_pushlstring(L, buffer, fi.uncompressed_size);
-					result = 1;
-				}
-				free(buffer);
-			}
-		}
+	if (z)
+		done_with_zip(z);
+	return result;
+}
+
+static int zipreader_next_cb(lua_State* L)
+{
+	struct zip* z = lua_touserdata(L, lua_upvalueindex(1));
+	int reader = lua_tointeger(L, lua_upvalueindex(2));
 
-		unzClose(zf);
+	if (!reader)
+		return 0;
+	if (!z->zf || (z->reading != reader))
+		return luaL_error(L, "another zip member has been opened since this one");
+
+	char buffer[BLOCKSIZE];
+	int i = unzReadCurrentFile(z->zf, buffer, sizeof(buffer));
+	if (i > 0)
+	{
+		lua_pushlstring(L, buffer, i);
+		return 1;
 	}
 
-	return result;
+	unzCloseCurrentFile(z->zf);
+	z->reading = 0;
+	done_with_zip(z);
+	lua_pushinteger(L, 0);
+	lua_replace(L, lua_upvalueindex(2));
+
+	if (i < 0)
+		return luaL_error(L, "error reading zip member");
+	return 0;
+}
+
+/* zipreader(zip, member): returns an iterator which produces member a chunk
+ * at a time, or nil if it isn't there. The member stays open until the
+ * iterator runs out, or until another member is opened. */
+
+static int zipreader_cb(lua_State* L)
+{
+	struct zip* z = tozip(L, 1);
+	const char* subname = luaL_checkstring(L, 2);
+
+	if (!z)
+		return 0;
+	if (!open_member(z, subname))
+	{
+		done_with_zip(z);
+		return 0;
+	}
+
+	z->reading = ++z->readers;
+	lua_pushvalue(L, 1);
+	lua_pushinteger(L, z->reading);
+	lua_pushcclosure(L, zipreader_next_cb, 2);
+	return 1;
 }
 
 static int writezip_cb(lua_State* L)
@@ -261,57 +514,72 @@ static int addimagetozip_cb(lua_State* L)
 	return 0;
 }
 
+/* unzipfile(zip, member, filename): copies member out into filename. */
+
 static int unzipfile_cb(lua_State* L)
 {
-	const char* zipname  = luaL_checkstring(L, 1);
+	struct zip* z = tozip(L, 1);
 	const char* subname  = luaL_checkstring(L, 2);
 	const char* filename = luaL_checkstring(L, 3);
 	int result = 0;
 
-	unzFile zf = unzOpen(zipname);
-	if (zf)
+	if (z && open_member(z, subname))
 	{
-		int i = unzLocateFile(zf, subname, 0);
-		if (i == UNZ_OK)
+		FILE *fp = fopen(filename, "wb");
+		if (fp)
 		{
-			unz_file_info fi;
-			unzGetCurrentFileInfo(zf, &fi,
-				NULL, 0, NULL, 0, NULL, 0);
-
-			char* buffer = malloc(fi.uncompressed_size);
-			if (buffer)
+			char buffer[BLOCKSIZE];
+			int i;
+			while ((i = unzReadCurrentFile(z->zf, buffer, sizeof(buffer))) > 0)
 			{
-				unzOpenCurrentFile(zf);
-				i = unzReadCurrentFile(zf, buffer, fi.uncompressed_size);
-				if (i == fi.uncompressed_size)
+				if (fwrite(buffer, 1, i, fp) != i)
 				{
-					FILE *fp = fopen(filename, "wb");
-					if (!fp){
-						free(buffer);
-						unzClose(zf);
-						return 0;
-					}
-					fwrite(buffer, fi.uncompressed_size, 1, fp);
-					fclose(fp);
-					result = 1;
+					i = -1;
+					break;
 				}
-				free(buffer);
 			}
+			if (fclose(fp) != 0)
+				i = -1;
+			result = (i == 0);
 		}
-
-		unzClose(zf);
+		unzCloseCurrentFile(z->zf);
 	}
 
-	return result;
+	if (z)
+		done_with_zip(z);
+	if (!result)
+		return 0;
+	lua_pushboolean(L, true);
+	return 1;
 }
 
 void zip_init(void)
 {
+	const static luaL_Reg zip_funcs[] =
+	{
+		{ "read",                      readfromzip_cb },
+		{ "reader",                    zipreader_cb },
+		{ "unzip",                     unzipfile_cb },
+		{ "close",                     zip_close_cb },
+		{ NULL,                        NULL }
+	};
+
+	luaL_newmetatable(L, ZIP_METATABLE);
+	lua_newtable(L);
+	luaL_setfuncs(L, zip_funcs, 0);
+	lua_setfield(L, -2, "__index");
+	lua_pushcfunction(L, zip_close_cb);
+	lua_setfield(L, -2, "__gc");
+	lua_pop(L, 1);
+
 	const static luaL_Reg funcs[] =
 	{
 		{ "compress",                  compress_cb },
 		{ "decompress",                decompress_cb },
+		{ "crc32",                     crc32_cb },
+		{ "openzip",                   openzip_cb },
 		{ "readfromzip",               readfromzip_cb },
+		{ "zipreader",                 zipreader_cb },
 		{ "writezip",                  writezip_cb },
 		{ "addimagetozip",             addimagetozip_cb },
 		{ "unzipfile",                 unzipfile_cb },
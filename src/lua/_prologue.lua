@@ -36,6 +36,7 @@ end
 if DEBUG then
 	local allowed = 
 	{
+		GLYPH_CACHE_SIZE = true,
 		X11_BLACK_COLOUR = true,
 		X11_BOLD_MODIFIER = true,
 		X11_BRIGHT_COLOUR = true,
@@ -65,4 +66,5 @@ lunamark = {}
 BLINK_ON_TIME = 0.8
 BLINK_OFF_TIME = 0.53
 IDLE_TIME = (BLINK_ON_TIME + BLINK_OFF_TIME) * 5
+MAX_FPS = 30 -- while input is waiting; 0 means only redraw once it's all done
 
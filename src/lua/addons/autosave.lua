@@ -3,6 +3,14 @@
 -- file in this distribution for the full text.
 
 local Stat = wg.stat
+local Fork = wg.fork
+local WaitChild = wg.waitchild
+local ExitChild = wg.exitchild
+
+-- The autosave running in the background, if any, and the one which has
+-- most recently finished.
+local running = nil
+local finished = nil
 
 local function announce()
 	local settings = DocumentSet.addons.autosave
@@ -31,11 +39,53 @@ local function makefilename(pattern)
 	return dirname.."/"..pattern
 end
 
+local function report(filename, r, e)
+	if not r then
+		ModalMessage("Autosave failed", "The document could not be autosaved: "..e)
+	else
+		NonmodalMessage("Autosaved as "..filename) 
+		QueueRedraw()
+	end
+end
+
+local function autosave_in_foreground(filename)
+	ImmediateMessage("Autosaving...")
+	report(filename, SaveDocumentSetRaw(filename))
+end
+
+-- Saving is done in a forked child where possible, so that the user can
+-- keep typing; the child gets its own snapshot of the document set as it is
+-- right now. It must never return into the event loop, hence the pcall.
+
+local function autosave(filename)
+	local pid = Fork()
+	if (pid == 0) then
+		local ok, r = pcall(SaveDocumentSetRaw, filename)
+		ExitChild((ok and r) and 0 or 1)
+	end
+
+	if pid then
+		running = { pid = pid, filename = filename }
+	else
+		autosave_in_foreground(filename)
+	end
+end
+
 -----------------------------------------------------------------------------
 -- Idle handler. This actually does the work of autosaving.
 
 do
 	local function cb()
+		if running then
+			local status = WaitChild(running.pid)
+			if (status ~= false) then
+				running.status = status
+				finished = running
+				running = nil
+				FireAsyncEvent(Event.Autosaved)
+			end
+		end
+
 		local settings = DocumentSet.addons.autosave
 		if not settings.enabled or not DocumentSet.changed then
 			return
@@ -45,19 +95,9 @@ do
 			settings.lastsaved = os.time()
 		end
 		
-		if ((os.time() - settings.lastsaved) > (settings.period * 60)) then
-			ImmediateMessage("Autosaving...")
-			
-			local filename = makefilename(settings.pattern)
-			local r, e = SaveDocumentSetRaw(filename)
-			
-			if not r then
-				ModalMessage("Autosave failed", "The document could not be autosaved: "..e)
-			else
-				NonmodalMessage("Autosaved as "..filename) 
-				QueueRedraw()
-			end
-			
+		if not running and
+				((os.time() - settings.lastsaved) > (settings.period * 60)) then
+			autosave(makefilename(settings.pattern))
 			settings.lastsaved = os.time()
 		end
 	end
@@ -65,6 +105,28 @@ do
 	AddEventListener(Event.Idle, cb)
 end
 
+-----------------------------------------------------------------------------
+-- Background autosave completion. The child can't tell us why it failed, so
+-- if it did, save again in the foreground to find out.
+
+do
+	local function cb()
+		local f = finished
+		finished = nil
+		if not f then
+			return
+		end
+
+		if (f.status == 0) then
+			report(f.filename, true)
+		else
+			autosave_in_foreground(f.filename)
+		end
+	end
+
+	AddEventListener(Event.Autosaved, cb)
+end
+
 -----------------------------------------------------------------------------
 -- Load document. Nukes the 'last autosave' field 
 
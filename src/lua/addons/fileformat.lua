@@ -0,0 +1,74 @@
+-- © 2008 David Given.
+-- WordGrinder is licensed under the MIT open source license. See the COPYING
+-- file in this distribution for the full text.
+
+-----------------------------------------------------------------------------
+-- Should the document set be saved in the (slower, bigger) text format?
+
+function WantTextFileFormat()
+	local settings = DocumentSet.addons.fileformat
+	if settings then
+		return settings.textformat or false
+	end
+	return false
+end
+
+-----------------------------------------------------------------------------
+-- Addon registration. Create the default settings in the DocumentSet.
+
+do
+	local function cb()
+		DocumentSet.addons.fileformat = DocumentSet.addons.fileformat or {
+			textformat = false,
+		}
+	end
+
+	AddEventListener(Event.RegisterAddons, cb)
+end
+
+-----------------------------------------------------------------------------
+-- Configuration user interface.
+
+function Cmd.ConfigureFileFormat()
+	local settings = DocumentSet.addons.fileformat
+
+	local textformat_checkbox =
+		Form.Checkbox {
+			x1 = 1, y1 = 1,
+			x2 = 40, y2 = 1,
+			label = "Save as text (for diffing)",
+			value = settings.textformat
+		}
+
+	local dialogue =
+	{
+		title = "Configure File Format",
+		width = Form.Large,
+		height = 5,
+		stretchy = false,
+
+		["KEY_^C"] = "cancel",
+		["KEY_RETURN"] = "confirm",
+		["KEY_ENTER"] = "confirm",
+
+		textformat_checkbox,
+
+		Form.Label {
+			x1 = 1, y1 = 3,
+			x2 = -1, y2 = 3,
+			align = Form.Left,
+			value = "Text files are larger and load more slowly."
+		},
+	}
+
+	local result = Form.Run(dialogue, RedrawScreen,
+		"SPACE to toggle, RETURN to confirm, CTRL+C to cancel")
+	if not result then
+		return false
+	end
+
+	settings.textformat = textformat_checkbox.value
+	DocumentSet:touch()
+
+	return true
+end
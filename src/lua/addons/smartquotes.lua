@@ -125,7 +125,8 @@ local function convert_clipboard()
 				newwords[#newwords+1] = w
 			end
 
-			clipboard[pn] = CreateParagraph(para.style, newwords)
+			clipboard:replaceParagraphAt(pn,
+				CreateParagraph(para.style, newwords))
 		end
 	end
 
@@ -154,7 +155,8 @@ local function unconvert_clipboard()
 				newwords[#newwords+1] = w
 			end
 
-			clipboard[pn] = CreateParagraph(para.style, newwords)
+			clipboard:replaceParagraphAt(pn,
+				CreateParagraph(para.style, newwords))
 		end
 	end
 
@@ -71,12 +71,12 @@ local function get_user_dictionary_document()
 		NonmodalMessage("Creating dictionary in document '"
 				..USER_DICTIONARY_NAME.."'.")
 
-		d[1] = CreateParagraph(
+		d:replaceParagraphAt(1, CreateParagraph(
 				"P",
 				SplitString("This is your user dictionary --- place words, "
 						.. "one at a time, in V paragraphs and they will be "
 						.. "considered valid in your document.", "%s")
-			)
+			))
 
 		AddEventListener(Event.DocumentModified,
 			function(self, token, document)
@@ -171,6 +171,7 @@ function Cmd.AddToUserDictionary()
 			d:appendParagraph(CreateParagraph("V", word))
 			d:touch()
 			user_dictionary_cache = nil
+			InvalidateScreen()
 			NonmodalMessage("Word '"..word.."' added to user dictionary")
 		else
 			NonmodalMessage("Word '"..word.."' already in user dictionary")
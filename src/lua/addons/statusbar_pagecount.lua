@@ -42,18 +42,36 @@ LinesPerPage = function()
 		return linesperpage
 end
 
+-- Pages are counted in screen lines, using the document's line index, so
+-- this only costs a few lookups however long the document is. This is an
+-- approximation: screen lines are wrapped at the smaller of the screen width
+-- and the look and feel's maximum width (which Cmd.SetTextWidth sets to the
+-- page's text width), or at the full screen width if look and feel is off.
+-- The count is only exact when that comes out at the page's text width; on a
+-- narrower screen it overestimates, on a wider one it underestimates, which
+-- is why it's labelled as approximate.
+
 do
 	local function cb(event, token, terms)
-			local page = 
-				math.floor(Document.cp / LinesPerPage() + 1)
- 
 		local settings = DocumentSet.addons.pagecount or {}
 		if settings.enabled then
-			--local pages = math.floor((Document.wordcount or 0) / settings.wordsperpage)
+			local linesperpage = LinesPerPage()
+			if (linesperpage < 1) then
+				linesperpage = 1
+			end
+
+			local paragraph = Document[Document.cp]
+			local ln = paragraph:getLineOfWord(Document.cw) or 1
+			local line = Document:getLineOfParagraph(Document.cp) + ln - 1
+			local page = math.floor(line / linesperpage) + 1
+			local pages = math.ceil(Document:getLineCount() / linesperpage)
+			if (pages < page) then
+				pages = page
+			end
+
 			terms[#terms+1] = {
 				priority=80,
-				value=string.format("%d %s", page,
-					Pluralise(page, "page", "pages"))
+				value=string.format("approx. page %d of %d", page, pages)
 			}
 		end
 	end
@@ -2,80 +2,191 @@
 -- WordGrinder is licensed under the MIT open source license. See the COPYING
 -- file in this distribution for the full text.
 
-local STACKSIZE = 500
-
-local function shallowequals(t1, t2)
-	if (#t1 ~= #t2) then
-		return false
+-- The undo and redo stacks don't hold copies of the document. Instead, each
+-- entry is a record of the paragraph-level changes made since a checkpoint,
+-- captured as they happen via Event.ParagraphChanged. Each change is stored
+-- as { pn, old, new }, where old is nil for insertions and new is nil for
+-- deletions. Undoing a record replays the inverse of each change, newest
+-- first, which in turn produces the record needed to redo it.
+--
+-- Words edited in place are stored as { pn, p, p, wn, removed, count }
+-- instead: the count words at wn replaced the ones in removed. Only the words
+-- themselves are kept, so typing doesn't copy the paragraph being typed into.
+-- Because records are replayed strictly newest first, each paragraph is back
+-- in the state a change left it in by the time that change is undone.
+--
+-- The stacks are bounded by an estimate of the memory used by the paragraphs
+-- they keep alive, rather than by number of entries.
+
+local UNDOMEMORY = 16 * 1024 * 1024
+local PARAGRAPHCOST = 96
+local WORDCOST = 48
+local CHANGECOST = 64
+
+local table_remove = table.remove
+
+local function paragraphcost(p)
+	if not p then
+		return 0
 	end
+	return PARAGRAPHCOST + #p*WORDCOST
+end
 
-	for i = 1, #t1 do
-		if (t1[i] ~= t2[i]) then
-			return false
-		end
-	end
+local function createrecord()
+	return {
+		cp = Document.cp,
+		cw = Document.cw,
+		co = Document.co,
+		size = CHANGECOST
+	}
+end
 
-	return true
+local function dropstack(document, stack)
+	for i = 1, #stack do
+		document._undosize = document._undosize - stack[i].size
+		stack[i] = nil
+	end
 end
 
-local function shallowcopy(t1)
-	local t2 = {}
-	for k, v in ipairs(t1) do
-		t2[k] = v
+-- Throws away the oldest undo records until we're back under budget. The
+-- newest record is always kept.
+
+local function trim(document)
+	local undostack = document._undostack
+	while (document._undosize > UNDOMEMORY) and (#undostack > 1) do
+		local record = table_remove(undostack, 1)
+		document._undosize = document._undosize - record.size
 	end
-	return t2
 end
 
-local function savedocument()
-	local copy = shallowcopy(Document)
-	copy.cp, copy.cw, copy.co = Document.cp, Document.cw, Document.co
-	return copy
+local function pushrecord(document)
+	local record = createrecord()
+	local undostack = document._undostack
+	undostack[#undostack+1] = record
+	document._undorecord = record
+	document._undosize = document._undosize + record.size
+
+	-- Nuke the redo stack.
+	dropstack(document, document._redostack)
+	return record
 end
 
-local function loaddocument(copy)
-	local oldlen = #Document
-	for i = 1, #copy do
-		Document[i] = copy[i]
-	end
-	for i = #copy+1, oldlen do
-		Document[i] = nil
+local function initstacks(document)
+	document._undostack = document._undostack or {}
+	document._redostack = document._redostack or {}
+	document._undosize = document._undosize or 0
+end
+
+-- Replays a record backwards, recording the changes this makes into a new
+-- record (which will undo the undo). Runs of consecutive insertions or
+-- deletions are undone in bulk, so that undoing a big paste or delete isn't
+-- quadratic.
+
+local function replay(record)
+	local inverse = createrecord()
+	Document._undorecord = inverse
+
+	local i = #record
+	while (i > 0) do
+		local change = record[i]
+		local pn, old, new = change[1], change[2], change[3]
+		if not old then
+			-- Insertions at pn, pn+1, pn+2...
+			local j = i
+			while (j > 1) and not record[j-1][2]
+					and (record[j-1][1] == record[j][1]-1) do
+				j = j - 1
+			end
+			Document:deleteParagraphsAt(record[j][1], i-j+1)
+			i = j - 1
+		elseif not new then
+			-- Deletions, all at pn.
+			local j = i
+			while (j > 1) and not record[j-1][3] and (record[j-1][1] == pn) do
+				j = j - 1
+			end
+			local paragraphs = {}
+			for k = j, i do
+				paragraphs[#paragraphs+1] = record[k][2]
+			end
+			Document:insertParagraphsBefore(paragraphs, pn)
+			i = j - 1
+		elseif (old == new) then
+			Document:replaceWordsAt(pn, change[4], change[6],
+				unpack(change[5]))
+			i = i - 1
+		else
+			Document:replaceParagraphAt(pn, old)
+			i = i - 1
+		end
 	end
-	Document.cp, Document.cw, Document.co = copy.cp, copy.cw, copy.co
+
+	Document._undorecord = nil
+	Document.cp, Document.cw, Document.co = record.cp, record.cw, record.co
 	Document.mp = nil
-	Document:purge()
 	QueueRedraw()
+	return inverse
 end
 
 local function movechange(srcstack, deststack)
-	local top = srcstack[1]
+	local top = srcstack[#srcstack]
 	if not top then
 		return false
 	end
-	table.remove(srcstack, 1)
-
-	table.insert(deststack, 1, savedocument())
+	srcstack[#srcstack] = nil
+	Document._undosize = Document._undosize - top.size
 
-	loaddocument(top)
+	deststack[#deststack+1] = replay(top)
+	trim(Document)
 	return true
 end
 
 -----------------------------------------------------------------------------
--- Commit an undo checkpoint
+-- Record paragraph changes into the current undo record.
+
+do
+	local function cb(event, token, document, pn, old, new, wn, removed,
+			count)
+		-- Documents which have never been checkpointed have no history to
+		-- keep consistent.
+		if not document._undostack then
+			return
+		end
 
-function Cmd.Checkpoint()
-	local undostack = Document._undostack or {}
-	Document._undostack = undostack
+		-- Changes made without a checkpoint (e.g. straight after an undo)
+		-- start a new record of their own.
+		local record = document._undorecord or pushrecord(document)
+
+		local size = CHANGECOST
+		if (old == new) then
+			size = size + #removed*WORDCOST
+			record[#record+1] = { pn, old, new, wn, removed, count }
+		else
+			size = size + paragraphcost(old)
+			record[#record+1] = { pn, old, new }
+		end
+		record.size = record.size + size
+		document._undosize = document._undosize + size
+		trim(document)
+	end
 
-	local top = undostack[1]
-	if not top or not shallowequals(Document, top) then
-		local copy = savedocument()
-		table.insert(undostack, 1, copy)
-		undostack[STACKSIZE] = nil
+	AddEventListener(Event.ParagraphChanged, cb)
+end
+
+-----------------------------------------------------------------------------
+-- Commit an undo checkpoint
 
-		-- Nuke the redo stack.
-		Document._redostack = {}
+function Cmd.Checkpoint()
+	initstacks(Document)
+
+	-- If nothing has changed since the last checkpoint, there's nothing to
+	-- do.
+	local record = Document._undorecord
+	if not record or (#record > 0) then
+		pushrecord(Document)
+		trim(Document)
 	end
-	
+
 	return true
 end
 
@@ -83,8 +194,7 @@ end
 -- Undo a change.
 
 function Cmd.Undo()
-	Document._undostack = Document._undostack or {}
-	Document._redostack = Document._redostack or {}
+	initstacks(Document)
 	if not movechange(Document._undostack, Document._redostack) then
 		NonmodalMessage("Nothing left to undo")
 		return false
@@ -97,8 +207,7 @@ end
 -- Redo an undone change.
 
 function Cmd.Redo()
-	Document._undostack = Document._undostack or {}
-	Document._redostack = Document._redostack or {}
+	initstacks(Document)
 	if not movechange(Document._redostack, Document._undostack) then
 		NonmodalMessage("Nothing left to redo")
 		return false
@@ -106,4 +215,3 @@ function Cmd.Redo()
 	NonmodalMessage("Redone ("..#Document._redostack.." left in redo buffer)")
 	return true
 end
-
@@ -12,8 +12,10 @@ Last Modified By  : Igor V. Sementsov <ig.kuzm@gmail.com>
 local table_remove = table.remove
 local table_insert = table.insert
 local table_concat = table.concat
+local bitand = bit32.band
+local int = math.floor
 local Write = wg.write
-local WriteStyled = wg.writestyled
+local RenderLine = wg.renderline
 local ParseImage = wg.parseimage
 local ClearToEOL = wg.cleartoeol
 local SetNormal = wg.setnormal
@@ -24,6 +26,7 @@ local SetDim = wg.setdim
 local GetStringWidth = wg.getstringwidth
 local GetBytesOfCharacter = wg.getbytesofcharacter
 local GetWordText = wg.getwordtext
+local WrapParagraph = wg.wrapparagraph
 local BOLD = wg.BOLD
 local ITALIC = wg.ITALIC
 local UNDERLINE = wg.UNDERLINE
@@ -39,6 +42,266 @@ local stylemarkup =
 	["H4"] = BRIGHT + BOLD
 }
 
+-- Paragraph layouts are cached, and only recalculated when something which
+-- affects them has changed: the wrap width, the justification mode, the
+-- paragraph style and its indents, the full stop spacing setting, or the
+-- layout generation. Paragraphs don't know which document they belong to, so
+-- there's one generation for all of them, bumped whenever any document's
+-- layout is thrown away.
+-- Returns true if the cached layout is still good; otherwise, records the new
+-- key and returns false, and the caller must rewrap.
+
+local wrapgeneration = 0
+
+local function checklayout(self, width, mode)
+	local firstindent = self:getIndentOfLine(1)
+	local indent = self:getIndentOfLine(2)
+	local fullstopspaces = WantFullStopSpaces()
+	local generation = wrapgeneration
+
+	if (self.wrapwidth == width) and (self.wrapmode == mode) and
+			(self.wrapstyle == self.style) and
+			(self.wrapfirstindent == firstindent) and
+			(self.wrapindent == indent) and
+			(self.wrapfullstopspaces == fullstopspaces) and
+			(self.wrapgeneration == generation) then
+		return true
+	end
+
+	self.wrapwidth = width
+	self.wrapmode = mode
+	self.wrapstyle = self.style
+	self.wrapfirstindent = firstindent
+	self.wrapindent = indent
+	self.wrapfullstopspaces = fullstopspaces
+	self.wrapgeneration = generation
+	return false
+end
+
+-- Lines are drawn in a single call to wg.renderline. Event.DrawWord
+-- listeners get to see (and change) each word and its style first; the
+-- results are collected into these, which are reused from line to line.
+
+local drawwords = {}
+local drawstyles = {}
+local drawpayload = {}
+
+local function renderline(self, line, x, y, marks)
+	local style = self.style
+	local istable = (style == "TR") or (style == "TRB")
+	local cstyle = stylemarkup[style] or 0
+	local sentences = self.sentences
+	local payload = drawpayload
+	for i, wn in ipairs(line) do
+		payload.word = self[wn]
+		payload.cstyle = cstyle
+		payload.firstword = sentences[wn]
+		FireEvent(Event.DrawWord, payload)
+
+		drawwords[i] = payload.word
+		drawstyles[i] = payload.cstyle
+	end
+
+	RenderLine(self, line, x, y, istable, drawwords, drawstyles, marks)
+end
+
+-- The document also keeps an index of how many screen lines each paragraph
+-- takes up (the space above it plus its wrapped lines), as a Fenwick tree,
+-- so that converting between paragraphs and screen lines is O(log n) rather
+-- than a walk over the whole document. A height of false means that the
+-- paragraph needs rewrapping. Changing a paragraph's words or style only
+-- marks it (and, as its spacing depends on its neighbour, the one after it)
+-- dirty, and the tree gets patched the next time it's used; inserting or
+-- deleting paragraphs shifts the heights along and drops the tree, which is
+-- rebuilt from the heights in O(n) without rewrapping anything else. Table
+-- rows take their cell widths from the row above, so any change also marks
+-- the run of table rows which follows it dirty.
+-- Anything which affects the layout of every paragraph (the wrap width, the
+-- layout generation, full stop spacing) throws the whole thing away.
+
+local function linechanged(self, pn)
+	local heights = self._lineheights
+	if heights and heights[pn] then
+		heights[pn] = false
+		if self._linetree then
+			local dirty = self._linedirty
+			dirty[#dirty+1] = pn
+		end
+	end
+end
+
+local function rowschanged(self, pn)
+	while true do
+		local style = self[pn] and self[pn].style
+		if (style ~= "TR") and (style ~= "TRB") then
+			return
+		end
+		linechanged(self, pn)
+		pn = pn + 1
+	end
+end
+
+local function lineschanged(self, pn, count, inserted)
+	local heights = self._lineheights
+	if not heights then
+		return
+	end
+
+	if (count == 0) then
+		linechanged(self, pn)
+		linechanged(self, pn+1)
+		rowschanged(self, pn+1)
+		return
+	end
+
+	local len = #self
+	if inserted then
+		for i = len, pn+count, -1 do
+			heights[i] = heights[i-count]
+		end
+		for i = pn, pn+count-1 do
+			heights[i] = false
+		end
+		heights[pn+count] = false
+	else
+		for i = pn, len do
+			heights[i] = heights[i+count]
+		end
+		for i = len+1, len+count do
+			heights[i] = nil
+		end
+		heights[pn] = false
+	end
+	heights[len+1] = nil
+
+	self._linetree = nil
+	self._linedirty = {}
+	rowschanged(self, inserted and (pn+count) or pn)
+end
+
+local function lineheight(self, pn)
+	return self:spaceAbove(pn) +
+		#self[pn]:wrapForStyle(self.wrapwidth, self[pn-1] or false)
+end
+
+-- returns: the total height of paragraphs 1 to pn
+local function lineprefix(tree, pn)
+	local total = 0
+	while (pn > 0) do
+		total = total + tree[pn]
+		pn = pn - bitand(pn, -pn)
+	end
+	return total
+end
+
+-- Brings the line index up to date, and returns the tree.
+local function getlinetree(self)
+	local width = self.wrapwidth
+	local generation = self._wrapgeneration
+	local fullstopspaces = WantFullStopSpaces()
+	local heights = self._lineheights
+	if not heights or (self._linewidth ~= width) or
+			(self._linegeneration ~= generation) or
+			(self._linefullstopspaces ~= fullstopspaces) then
+		heights = {}
+		self._lineheights = heights
+		self._linetree = nil
+		self._linewidth = width
+		self._linegeneration = generation
+		self._linefullstopspaces = fullstopspaces
+	end
+
+	local len = #self
+	local tree = self._linetree
+	if not tree then
+		tree = {}
+		for pn = 1, len do
+			local h = heights[pn]
+			if not h then
+				h = lineheight(self, pn)
+				heights[pn] = h
+			end
+			tree[pn] = h
+		end
+		for pn = 1, len do
+			local parent = pn + bitand(pn, -pn)
+			if (parent <= len) then
+				tree[parent] = tree[parent] + tree[pn]
+			end
+		end
+
+		self._linetree = tree
+		self._linedirty = {}
+		return tree
+	end
+
+	local dirty = self._linedirty
+	for i = 1, #dirty do
+		local pn = dirty[i]
+		if not heights[pn] then
+			local h = lineheight(self, pn)
+			local delta = h - (lineprefix(tree, pn) - lineprefix(tree, pn-1))
+			heights[pn] = h
+			while (pn <= len) do
+				tree[pn] = tree[pn] + delta
+				pn = pn + bitand(pn, -pn)
+			end
+		end
+		dirty[i] = nil
+	end
+	return tree
+end
+
+-- The word count and list numbering are kept up to date incrementally. Each
+-- change to the paragraph list adjusts the running word count and widens the
+-- range of paragraph numbers which renumber() needs to look at; indices are
+-- in terms of the document after the change. If the running count isn't
+-- known yet (e.g. for a freshly loaded document), renumber() does the whole
+-- thing.
+
+local function paragraphschanged(self, pn, count, inserted, words)
+	lineschanged(self, pn, count, inserted)
+
+	if self._wordcount then
+		self._wordcount = self._wordcount + words
+	end
+
+	local from = self._renumberfrom
+	local to = self._renumberto
+	if not from then
+		from = pn
+		to = pn
+	else
+		if (pn < from) then
+			from = pn
+		end
+		if inserted then
+			if (to >= pn) then
+				to = to + count
+			end
+		elseif (to >= pn+count) then
+			to = to - count
+		elseif (to > pn) then
+			to = pn
+		end
+	end
+
+	local last = pn
+	if inserted then
+		last = pn + count - 1
+	end
+	if (last > to) then
+		to = last
+	end
+
+	self._renumberfrom = from
+	self._renumberto = to
+end
+
+local function islist(style)
+	return style.numbered or style.list
+end
+
 DocumentSetClass =
 {
 	-- remove any cached data prior to saving
@@ -185,16 +448,122 @@ DocumentSetClass =
 
 DocumentClass =
 {
+	-- All changes to a document's paragraphs must go through these, so that
+	-- anything which tracks changes (such as undo) gets to hear about them.
+
 	appendParagraph = function(self, p)
-		self[#self+1] = p
+		local pn = #self + 1
+		self[pn] = p
+		paragraphschanged(self, pn, 1, true, #p)
+		FireEvent(Event.ParagraphChanged, self, pn, nil, p)
 	end,
 
 	insertParagraphBefore = function(self, paragraph, pn)
-		table.insert(self, pn, paragraph)
+		table_insert(self, pn, paragraph)
+		paragraphschanged(self, pn, 1, true, #paragraph)
+		FireEvent(Event.ParagraphChanged, self, pn, nil, paragraph)
 	end,
 
 	deleteParagraphAt = function(self, pn)
-		table.remove(self, pn)
+		local paragraph = table_remove(self, pn)
+		paragraphschanged(self, pn, 1, false, -#paragraph)
+		FireEvent(Event.ParagraphChanged, self, pn, paragraph, nil)
+	end,
+
+	-- Bulk versions of the above. These move the rest of the document once,
+	-- rather than once per paragraph, so that multi-paragraph operations
+	-- aren't quadratic. The events fired are the same as if the paragraphs
+	-- had been inserted (or deleted) one at a time, in order.
+
+	insertParagraphsBefore = function(self, paragraphs, pn)
+		local count = #paragraphs
+		if (count == 0) then
+			return
+		end
+
+		for i = #self, pn, -1 do
+			self[i+count] = self[i]
+		end
+		local words = 0
+		for i = 1, count do
+			local paragraph = paragraphs[i]
+			self[pn+i-1] = paragraph
+			words = words + #paragraph
+		end
+		paragraphschanged(self, pn, count, true, words)
+		for i = 1, count do
+			FireEvent(Event.ParagraphChanged, self, pn+i-1, nil, paragraphs[i])
+		end
+	end,
+
+	deleteParagraphsAt = function(self, pn, count)
+		local len = #self
+		local deleted = {}
+		local words = 0
+		for i = 1, count do
+			local paragraph = self[pn+i-1]
+			deleted[i] = paragraph
+			words = words + #paragraph
+		end
+
+		for i = pn+count, len do
+			self[i-count] = self[i]
+		end
+		for i = len-count+1, len do
+			self[i] = nil
+		end
+		paragraphschanged(self, pn, count, false, -words)
+		for i = 1, count do
+			FireEvent(Event.ParagraphChanged, self, pn, deleted[i], nil)
+		end
+	end,
+
+	replaceParagraphAt = function(self, pn, paragraph)
+		local old = self[pn]
+		self[pn] = paragraph
+		paragraphschanged(self, pn, 0, false, #paragraph - #old)
+		FireEvent(Event.ParagraphChanged, self, pn, old, paragraph)
+	end,
+
+	-- Replaces count words starting at wn of paragraph pn with the words
+	-- given, editing the paragraph in place. The words removed are passed on
+	-- with the event, so that anything tracking changes (such as undo) can
+	-- keep just those rather than a copy of the whole paragraph.
+
+	replaceWordsAt = function(self, pn, wn, count, ...)
+		local paragraph = self[pn]
+		local removed = {}
+		for i = 1, count do
+			removed[i] = paragraph[wn+i-1]
+		end
+
+		local n = select("#", ...)
+		local len = #paragraph
+		local delta = n - count
+		if (delta > 0) then
+			for i = len, wn+count, -1 do
+				paragraph[i+delta] = paragraph[i]
+			end
+		elseif (delta < 0) then
+			for i = wn+count, len do
+				paragraph[i+delta] = paragraph[i]
+			end
+			for i = len+delta+1, len do
+				paragraph[i] = nil
+			end
+		end
+		for i = 1, n do
+			paragraph[wn+i-1] = (select(i, ...))
+		end
+		if self._wordcount then
+			self._wordcount = self._wordcount + delta
+		end
+
+		paragraph:touch()
+		linechanged(self, pn)
+		rowschanged(self, pn+1)
+		FireEvent(Event.ParagraphChanged, self, pn, paragraph, paragraph, wn,
+			removed, n)
 	end,
 
 	wrap = function(self, width)
@@ -223,12 +592,62 @@ DocumentClass =
 		return mp1, mw1, mo1, mp2, mw2, mo2
 	end,
 
-	-- remove any cached data prior to saving
-	purge = function(self)
-		for _, paragraph in ipairs(self) do
-			paragraph:touch()
+	-- returns: the screen line (counting from 0) of the first line of
+	-- paragraph pn
+	getLineOfParagraph = function(self, pn)
+		local tree = getlinetree(self)
+		return lineprefix(tree, pn-1) + self:spaceAbove(pn)
+	end,
+
+	-- returns: paragraph number, line number in paragraph
+	getParagraphOfLine = function(self, line)
+		local tree = getlinetree(self)
+		local len = #self
+		local mask = 1
+		while ((mask*2) <= len) do
+			mask = mask * 2
 		end
 
+		-- Find the last paragraph which ends at or above the line; the
+		-- line's in the one after it.
+
+		local pn = 0
+		while (mask > 0) do
+			local n = pn + mask
+			if (n <= len) and (tree[n] <= line) then
+				pn = n
+				line = line - tree[n]
+			end
+			mask = int(mask / 2)
+		end
+		pn = pn + 1
+
+		if (pn > len) then
+			return len,
+				#self[len]:wrapForStyle(self.wrapwidth, self[len-1] or false)
+		end
+		local ln = line - self:spaceAbove(pn) + 1
+		if (ln < 1) then
+			ln = 1
+		end
+		return pn, ln
+	end,
+
+	-- returns: the number of screen lines in the document
+	getLineCount = function(self)
+		return lineprefix(getlinetree(self), #self)
+	end,
+
+	-- throw away every paragraph's cached layout (lazily; paragraphs notice
+	-- the next time they're wrapped)
+	invalidateLayout = function(self)
+		wrapgeneration = wrapgeneration + 1
+		self._wrapgeneration = wrapgeneration
+	end,
+
+	-- remove any cached data prior to saving (paragraph layouts aren't saved,
+	-- so they're left alone)
+	purge = function(self)
 		self.topp = nil
 		self.topw = nil
 		self.botp = nil
@@ -283,22 +702,54 @@ DocumentClass =
 	end,
 
 	renumber = function(self)
-		local wc = 0
-		local pn = 1
-
-		for _, p in ipairs(self) do
-			wc = wc + #p
-
-			local style = DocumentStyles[p.style]
-			if style.numbered then
-				p.number = pn
-				pn = pn + 1
-			elseif not style.list then
-				pn = 1
+		if not self._wordcount then
+			local wc = 0
+			local pn = 1
+
+			for _, p in ipairs(self) do
+				wc = wc + #p
+
+				local style = DocumentStyles[p.style]
+				if style.numbered then
+					p.number = pn
+					pn = pn + 1
+				elseif not style.list then
+					pn = 1
+				end
+			end
+
+			self._wordcount = wc
+		else
+			local from = self._renumberfrom
+			if from then
+				-- Start at the beginning of the list containing the first
+				-- change, and stop at the end of the list containing the last.
+
+				while (from > 1) and islist(DocumentStyles[self[from-1].style]) do
+					from = from - 1
+				end
+
+				local to = self._renumberto
+				local n = 1
+				for pn = from, #self do
+					local p = self[pn]
+					local style = DocumentStyles[p.style]
+					if style.numbered then
+						p.number = n
+						n = n + 1
+					elseif not style.list then
+						if (pn > to) then
+							break
+						end
+						n = 1
+					end
+				end
 			end
 		end
 
-		self.wordcount = wc
+		self._renumberfrom = nil
+		self._renumberto = nil
+		self.wordcount = self._wordcount
 	end
 }
 
@@ -320,11 +771,16 @@ ParagraphClass =
 		self.sentences = nil
 	end,
 
-	wrapTableRow = function(self, width)
+	-- A table row borrows its cell widths from the row before it. Callers
+	-- which know which paragraph that is (or that there isn't one, as
+	-- false) should pass it in; otherwise it's searched for in the
+	-- current document.
+
+	wrapTableRow = function(self, width, pp)
 
 		width = width or Document.wrapwidth
 
-		if with == nil then
+		if width == nil then
 			width = 80
 		end
 		
@@ -349,16 +805,14 @@ ParagraphClass =
 		local fullstopspaces = WantFullStopSpaces()
 
 		-- get previous paragraph
-		local pn = 0 
-		for n, par in ipairs(Document) do
-			if par == self then
-				pn = n - 1
+		if (pp == nil) then
+			for n, par in ipairs(Document) do
+				if par == self then
+					pp = Document[n-1]
+					break
+				end
 			end
 		end
-		local pp = nil
-		if pn > 0 then
-			pp = Document[pn]
-		end
 
 		-- count cells
 		local cells = {}
@@ -396,11 +850,11 @@ ParagraphClass =
 		end
 		cells[#cells+1] = cell
 		
-		self.isFirstRow = true
+		local isFirstRow = true
 		self.cn = cn
 		self.cells = cells
 		self.cellWidth = cellWidth
-		if pp ~= nil then 
+		if pp then 
 			if pp.style == "TR"  or 
 				 pp.style == "TRB" 
 			then
@@ -411,6 +865,7 @@ ParagraphClass =
 				end
 			end
 		end
+		self.isFirstRow = isFirstRow
 		
 		-- wrap each cell
 		self.rowheight = 1
@@ -494,10 +949,19 @@ ParagraphClass =
 		self.xs = xs
 		self.wordp = wordp
 		self.lines = lines
+
+		-- Table rows depend on the previous row, so their layout is never
+		-- cached; make sure nothing else thinks it can reuse it.
+		self.wrapwidth = nil
 		return self.lines
 	end,
 
 	wrapImage = function(self, width)
+		width = width or Document.wrapwidth
+		if checklayout(self, width, "image") then
+			return self.lines
+		end
+
 		local sentences = self.sentences
 		if (sentences == nil) then
 			local issentence = true
@@ -530,7 +994,6 @@ ParagraphClass =
 		end
 		self.imagedata = imagedata
 		
-		width = width or Document.wrapwidth
 		ParseImage(self[1], width, writerow)
 
 		local i
@@ -552,408 +1015,63 @@ ParagraphClass =
 		return self.lines
 	end,
 
-	wrap = function(self, width)
-		local sentences = self.sentences
-		if (sentences == nil) then
-			local issentence = true
-			sentences = {}
-			for wn, word in ipairs(self) do
-				if issentence then
-					sentences[wn] = true
-					issentence = false
-				end
-
-				if word:find("%.$") then
-					issentence = true
-				end
-			end
-			sentences[#self] = true
-			self.sentences = sentences
-		end
-
-		width = width or Document.wrapwidth
-		if (self.wrapwidth ~= width) then
-			local lines = {}
-			local line = {wn = 1}
-			local w = 0
-			local xs = {}
-			local fullstopspaces = WantFullStopSpaces()
-			self.xs = xs
-
-			width = width - self:getIndentOfLine(1)
-
-			for wn, word in ipairs(self) do
-				-- get width of word (including space)
-				local ww = GetStringWidth(word) + 1
-
-				-- add an extra space if the user asked for it
-				if fullstopspaces and word:find("%.$") then
-					ww = ww + 1
-				end
-
-				xs[wn] = w
-				w = w + ww
-				if (w >= width) then
-					lines[#lines+1] = line
-					if #lines == 1 then
-						width = width + self:getIndentOfLine(1) - self:getIndentOfLine(2)
-					end
-					line = {wn = wn}
-					w = ww
-					xs[wn] = 0
-				end
-
-				line[#line+1] = wn
-			end
-
-			if (#line > 0) then
-				lines[#lines+1] = line
-			end
-
-			self.lines = lines
+	-- Wraps the paragraph the way it's displayed, which depends on its
+	-- style.
+
+	wrapForStyle = function(self, width, pp)
+		local style = self.style
+		if (style == "TR") or (style == "TRB") then
+			return self:wrapTableRow(width, pp)
+		elseif (style == "IMG") then
+			return self:wrapImage(width)
+		elseif (style == "BOTH") then
+			return self:wrapBoth(width)
+		elseif (style == "CENTER") then
+			return self:wrapCenter(width)
+		elseif (style == "RIGHT") then
+			return self:wrapRight(width)
 		end
-
-		return self.lines
+		return self:wrap(width)
 	end,
 
-	wrapBoth = function(self, width)
-		local sentences = self.sentences
-		if (sentences == nil) then
-			local issentence = true
-			sentences = {}
-			for wn, word in ipairs(self) do
-				if issentence then
-					sentences[wn] = true
-					issentence = false
-				end
-
-				if word:find("%.$") then
-					issentence = true
-				end
-			end
-			sentences[#self] = true
-			self.sentences = sentences
-		end
+	-- The four justification modes all share the same line breaker, which
+	-- lives in C (see wg.wrapparagraph). These are just thin wrappers.
 
+	wrapWithMode = function(self, width, mode)
 		width = width or Document.wrapwidth
-		if (self.wrapwidth ~= width) then
-			local lines = {}
-			local line = {wn = 1}
-			local nlines = 0  -- number of lines
-			local linesw = {} -- width of line
-			local w = 0
-			local xs = {}
-			local fullstopspaces = WantFullStopSpaces()
-			self.xs = xs
-
-			width = width - self:getIndentOfLine(1)
-
-			for wn, word in ipairs(self) do
-				-- get width of word (including space)
-				local ww = GetStringWidth(word) + 1
-
-				-- add an extra space if the user asked for it
-				if fullstopspaces and word:find("%.$") then
-					ww = ww + 1
-				end
-
-				xs[wn] = w
-				w = w + ww
-				if (w >= width) then
-					nlines = nlines + 1
-					linesw[#linesw+1] = w - ww
-					lines[#lines+1] = line
-					if #lines == 1 then
-						width = width + self:getIndentOfLine(1) - self:getIndentOfLine(2)
-					end
-					line = {wn = wn}
-					w = ww
-					xs[wn] = 0
-				end
-
-				line[#line+1] = wn
-			end
-
-			if (#line > 0) then
-				nlines = nlines + 1
-				linesw[#linesw+1] = w
-				lines[#lines+1] = line
-			end
-
-			-- Justify lines
-			for ln, line in ipairs(lines) do
-				if ln < nlines then
-					local w = linesw[ln]
-					local dw = width
-					if ln == 1 then
-						dw = width - DocumentStyles[self.style].firstindent or 0
-					end
-					local n = 1
-					while w < dw do
-						if not line[n] then
-							n = 1
-						end
-						for i, wn in ipairs(line) do
-							if i > n then
-								xs[wn] = xs[wn] + 1
-							end
-						end
-						w = w + 1
-						n = n + 1
-					end
-				end
-			end
-
-			self.lines = lines
+		if not checklayout(self, width, mode) then
+			self.lines, self.xs, self.sentences = WrapParagraph(self, width,
+				self:getIndentOfLine(1), self:getIndentOfLine(2), mode,
+				WantFullStopSpaces())
 		end
 
 		return self.lines
 	end,
 
-	wrapRight = function(self, width)
-		local sentences = self.sentences
-		if (sentences == nil) then
-			local issentence = true
-			sentences = {}
-			for wn, word in ipairs(self) do
-				if issentence then
-					sentences[wn] = true
-					issentence = false
-				end
-
-				if word:find("%.$") then
-					issentence = true
-				end
-			end
-			sentences[#self] = true
-			self.sentences = sentences
-		end
-
-		width = width or Document.wrapwidth
-		if (self.wrapwidth ~= width) then
-			local linesw = {} -- width of line
-			local wordsw = {} -- width of word
-			local lines = {}
-			local line = {wn = 1}
-			local w = 0
-			local xs = {}
-			local fullstopspaces = WantFullStopSpaces()
-			self.xs = xs
-
-			for wn, word in ipairs(self) do
-				-- get width of word (including space)
-				local ww = GetStringWidth(word) + 1
-
-				-- add an extra space if the user asked for it
-				if fullstopspaces and word:find("%.$") then
-					ww = ww + 1
-				end
-
-				wordsw[#wordsw+1] = ww
-				
-				xs[wn] = w
-				w = w + ww
-				if (w >= width) then
-					linesw[#linesw+1] = w - ww
-					lines[#lines+1] = line
-					line = {wn = wn}
-					w = ww
-					xs[wn] = 0
-				end
-
-				line[#line+1] = wn
-			end
-
-			if (#line > 0) then
-				linesw[#linesw+1] = w
-				lines[#lines+1] = line
-			end
-		
-			-- set lines to right
-			local n = 1
-			for ln, line in ipairs(lines) do
-				local x = width - linesw[ln]
-				for _, wn in ipairs(line) do
-					self.xs[wn] = x
-					x = x + wordsw[n]
-					n = n + 1
-				end
-			end
+	wrap = function(self, width)
+		return self:wrapWithMode(width, "left")
+	end,
 
-			self.lines = lines
-		end
+	wrapBoth = function(self, width)
+		return self:wrapWithMode(width, "both")
+	end,
 
-		return self.lines
+	wrapRight = function(self, width)
+		return self:wrapWithMode(width, "right")
 	end,
 
 	wrapCenter = function(self, width)
-		local sentences = self.sentences
-		if (sentences == nil) then
-			local issentence = true
-			sentences = {}
-			for wn, word in ipairs(self) do
-				if issentence then
-					sentences[wn] = true
-					issentence = false
-				end
-
-				if word:find("%.$") then
-					issentence = true
-				end
-			end
-			sentences[#self] = true
-			self.sentences = sentences
-		end
-
-
-		width = width or Document.wrapwidth
-		if (self.wrapwidth ~= width) then
-			local linesw = {} -- width of line
-			local wordsw = {} -- width of word
-			local lines = {}
-			local line = {wn = 1}
-			local w = 0
-			local xs = {}
-			local fullstopspaces = WantFullStopSpaces()
-			self.xs = xs
-
-			for wn, word in ipairs(self) do
-				-- get width of word (including space)
-				local ww = GetStringWidth(word) + 1
-
-				-- add an extra space if the user asked for it
-				if fullstopspaces and word:find("%.$") then
-					ww = ww + 1
-				end
-
-				wordsw[#wordsw+1] = ww
-
-				xs[wn] = w
-				w = w + ww
-				if (w >= width) then
-					linesw[#linesw+1] = w - ww
-					lines[#lines+1] = line
-					line = {wn = wn}
-					w = ww
-					xs[wn] = 0
-				end
-
-				line[#line+1] = wn
-			end
-
-			if (#line > 0) then
-				linesw[#linesw+1] = w
-				lines[#lines+1] = line
-			end
-
-			-- center lines
-			local n = 1
-			for ln, line in ipairs(lines) do
-				local x = width / 2 - linesw[ln] / 2
-				for _, wn in ipairs(line) do
-					self.xs[wn] = x
-					x = x + wordsw[n]
-					n = n + 1
-				end
-			end
-
-			self.lines = lines
-		end
-
-		return self.lines
+		return self:wrapWithMode(width, "center")
 	end,
 
 	renderLine = function(self, line, x, y)
-		local istable = 0; 
-		if self.style == "TR"  or 
-			 self.style == "TRB" 
-		then
-			istable = 1
-		end
-
-		local cstyle = stylemarkup[self.style] or 0
-		local ostyle = 0
-		local xs = self.xs
-		for _, wn in ipairs(line) do
-			local w = self[wn]
-
-			local payload = {
-				word = w,
-				ostyle = ostyle,
-				cstyle = cstyle,
-				firstword = self.sentences[wn]
-			}
-			FireEvent(Event.DrawWord, payload)
-
-			ostyle = WriteStyled(x+xs[wn], y, payload.word,
-				payload.ostyle, nil, nil, payload.cstyle, istable)
-		end
+		renderline(self, line, x, y)
 	end,
 
 	renderMarkedLine = function(self, line, x, y, width, pn)
-		local istable = 0; 
-		if self.style == "TR"  or 
-			 self.style == "TRB" 
-		then
-			istable = 1
-		end
-		
-		width = width or (ScreenWidth - x)
-
-		local lwn = line.wn
 		local mp1, mw1, mo1, mp2, mw2, mo2 = Document:getMarks()
-
-		local cstyle = stylemarkup[self.style] or 0
-		local ostyle = 0
-		for wn, w in ipairs(line) do
-			local s, e
-
-			wn = lwn + wn - 1
-
-			if (pn < mp1) or (pn > mp2) then
-				s = nil
-			elseif (pn > mp1) and (pn < mp2) then
-				s = 1
-			else
-				if (pn == mp1) and (pn == mp2) then
-					if (wn == mw1) and (wn == mw2) then
-						s = mo1
-						e = mo2
-					elseif (wn == mw1) then
-						s = mo1
-					elseif (wn == mw2) then
-						s = 1
-						e = mo2
-					elseif (wn > mw1) and (wn < mw2) then
-						s = 1
-					end
-				elseif (pn == mp1) then
-					if (wn > mw1) then
-						s = 1
-					elseif (wn == mw1) then
-						s = mo1
-					end
-				else
-					s = 1
-					if (wn > mw2) then
-						s = nil
-					elseif (wn == mw2) then
-						e = mo2
-					end
-				end
-			end
-
-			local payload = {
-				word = self[w],
-				ostyle = ostyle,
-				cstyle = cstyle,
-				firstword = self.sentences[wn]
-			}
-			FireEvent(Event.DrawWord, payload)
-
-			ostyle = WriteStyled(x+self.xs[w], y, payload.word,
-				payload.ostyle, s, e, payload.cstyle, istable)
-		end
+		renderline(self, line, x, y,
+			{ pn, mp1, mw1, mo1, mp2, mw2, mo2 })
 	end,
 
 	-- returns: line number, word number in line
@@ -1301,6 +1419,15 @@ function UpdateDocumentStyles()
 	end
 
 	DocumentStyles = styles
+
+	-- Paragraph spacing and indents come from the styles, so every
+	-- document's layout is now out of date, not just the current one's.
+	local documentset = rawget(_G, "DocumentSet")
+	if documentset then
+		for _, document in ipairs(documentset.documents) do
+			document:invalidateLayout()
+		end
+	end
 end
 
 function CreateDocumentSet()
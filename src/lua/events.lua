@@ -6,16 +6,18 @@ local listeners = {}
 local batched = {}
 
 Event = {}
+Event.Autosaved = {}         --- a background autosave has finished
 Event.BuildStatusBar = {}    --- (statusbararray) the contents of the statusbar is being calculated
 Event.Changed = {}           --- the document's been changed
 Event.DocumentCreated = {}   --- a new documentset has just been created
 Event.DocumentLoaded = {}    --- a new documentset has just been loaded
 Event.DocumentModified = {}  --- (document) a document has been modified
 Event.DocumentUpgrade = {}   --- (oldversion, newversion) the documentset is being upgraded
-Event.DrawWord = {}          --- (word=, ostyle=, cstyle=) a word is being drawn on the screen
+Event.DrawWord = {}          --- (word=, cstyle=, firstword=) a word is being drawn on the screen
 Event.KeyTyped = {}          --- (value=) user is typing into the document
 Event.Idle = {}              --- the user isn't touching the keyboard
 Event.Moved = {}             --- the cursor has moved
+Event.ParagraphChanged = {}  --- (document, pn, old, new, wn, removed, count) a paragraph has been replaced, inserted (old is nil), deleted (new is nil) or edited in place (old == new, and the words in removed starting at wn were replaced by count others)
 Event.Redraw = {}            --- the screen has just been redrawn
 Event.RegisterAddons = {}    --- all addons should register themselves in the documentset
 Event.WaitingForUser = {}    --- we're about to wait for a keypress
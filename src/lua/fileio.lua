@@ -21,12 +21,19 @@ local writeu8 = wg.writeu8
 local readu8 = wg.readu8
 local escape = wg.escape
 local unescape = wg.unescape
+local EncodeParagraphs = wg.encodeparagraphs
+local CRC32 = wg.crc32
+local DecodeParagraphs = wg.decodeparagraphs
+local OpenWriter = wg.openwriter
+local Stat = wg.stat
+local table_concat = table.concat
 local string_format = string.format
 local unpack = rawget(_G, "unpack") or table.unpack
 
 local MAGIC  = "WordGrinder dumpfile v1: this is not a text file!"
 local ZMAGIC = "WordGrinder dumpfile v2: this is not a text file!"
 local TMAGIC = "WordGrinder dumpfile v3: this is a text file; diff me!"
+local BMAGIC = "WordGrinder dumpfile v4: this is not a text file!"
 
 local STOP = 0
 local TABLE = 1
@@ -44,7 +51,30 @@ local PARAGRAPHCLASS = 102
 local WORDCLASS = 103
 local MENUCLASS = 104
 
-local function writetostream(object, write, writeo)
+local function u32(n)
+	local floor = math.floor
+	return string.char(n % 0x100, floor(n / 0x100) % 0x100,
+		floor(n / 0x10000) % 0x100, floor(n / 0x1000000) % 0x100)
+end
+
+-- Writes all the properties of object using writeo(). If it's a document
+-- set, the documents themselves are written using writedocument(id, d).
+
+-- Document fields which only cache the screen layout, and so aren't saved.
+-- (Leaving them alone means saving doesn't cause a relayout.)
+
+local layoutkeys =
+{
+	topp = true,
+	topw = true,
+	botp = true,
+	botw = true,
+	wrapwidth = true,
+	undostack = true,
+	redostack = true,
+}
+
+local function writetostream(object, writeo, writedocument)
 	local function save(key, t, force)
 		if (type(t) == "table") then
 			local m = GetClass(t)
@@ -59,7 +89,8 @@ local function writetostream(object, write, writeo)
 					local keys = {}
 					for k in pairs(t) do
 						if (type(k) ~= "number") then
-							if not k:find("^_") then
+							if not k:find("^_") and
+									not ((m == DocumentClass) and layoutkeys[k]) then
 								keys[#keys+1] = k
 							end
 						end
@@ -87,69 +118,140 @@ local function writetostream(object, write, writeo)
 	if (GetClass(object) == DocumentSetClass) then
 		save(".current", object:_findDocument(object.current.name))
 
-		local function save_document(i, d)
-			write("#")
-			write(tostring(i))
-			write("\n")
-
-			for _, p in ipairs(d) do
-				write(p.style)
-
-				for _, s in ipairs(p) do
-					write(" ")
-					write(s)
-				end
-
-				write("\n")
-			end
-
-			write(".")
-			write("\n")
-		end
-
 		if object.clipboard then
-			save_document("clipboard", object.clipboard)
+			writedocument("clipboard", object.clipboard)
 		end
 		for i, d in ipairs(object.documents) do
-			save_document(i, d)
+			writedocument(i, d)
 		end
 	end
 
 	return true
 end
 
-function SaveToStream(filename, object)
+-- Saves object to a file. This is streamed straight to disk through a
+-- buffered writer, so no copy of the whole file is ever built in memory.
+-- Document sets may be saved in the binary format, where the properties are
+-- stored as they are in the text format but each document is a
+-- length-prefixed block of paragraphs with an offset index (see
+-- wg.encodeparagraphs()), which can be decoded without any line splitting
+-- or parsing.
+
+function SaveToStream(filename, object, binary)
 	-- Write the file to a *different* filename (so that crashes during
 	-- writing doesn't corrupt the file).
 
-	local fp, e = io.open(filename..".new", "wb")
-	if not fp then
+	local w, e = OpenWriter(filename..".new")
+	if not w then
 		return nil, e
 	end
 
-	local fpw = fp.write
+	local r
+	local saved
+	if binary then
+		-- Documents which haven't changed since they were last loaded from,
+		-- or saved to, the document set's own file are copied straight out
+		-- of it rather than being encoded again. Each copied range is checked
+		-- against the checksum it had then; if the file has been changed
+		-- behind our back, the whole thing is saved again from scratch.
+
+		local oldfp
+		local stale = false
+		local source = object._savedfile
+		if source then
+			local st = Stat(source.name)
+			if st and (st.size == source.size) then
+				oldfp = io.open(source.name, "rb")
+			end
+		end
+		saved = {}
 
-	local ss = {}
-	local write = function(s)
-		ss[#ss+1] = s
-	end
+		-- The properties block is length-prefixed, so it's collected and
+		-- written out just before the first document.
 
-	local writeo = function(k, v)
-		write(k)
-		write(": ")
-		write(v)
-		write("\n")
-	end
+		local properties = {}
+		local writeo = function(k, v)
+			properties[#properties+1] = k
+			properties[#properties+1] = ": "
+			properties[#properties+1] = v
+			properties[#properties+1] = "\n"
+		end
 
-	local r = writetostream(object, write, writeo)
-	local s = table.concat(ss)
+		local count = 0
+		if (GetClass(object) == DocumentSetClass) then
+			count = #object.documents
+			if object.clipboard then
+				count = count + 1
+			end
+		end
 
-	local e
-	if r then
-		r, e = fp:write(TMAGIC, "\n", s)
+		local function writeheader()
+			if properties then
+				local s = table_concat(properties)
+				w:write(BMAGIC, "\n", u32(#s), s, u32(count))
+				properties = nil
+			end
+		end
+
+		r = writetostream(object, writeo,
+			function(id, d)
+				writeheader()
+				id = tostring(id)
+				w:write(u32(#id), id)
+
+				local offset = w:tell()
+				w:checksum()
+				if oldfp and d._saved then
+					if not w:copy(oldfp, d._saved.offset, d._saved.size,
+							d._saved.checksum) then
+						stale = true
+					end
+				else
+					EncodeParagraphs(d, w)
+				end
+				saved[d] = {
+					offset = offset,
+					size = w:tell() - offset,
+					checksum = w:checksum()
+				}
+			end)
+		writeheader()
+
+		if oldfp then
+			oldfp:close()
+		end
+		if stale then
+			w:close()
+			os.remove(filename..".new")
+			object._savedfile = nil
+			return SaveToStream(filename, object, binary)
+		end
+	else
+		local writeo = function(k, v)
+			w:write(k, ": ", v, "\n")
+		end
+
+		w:write(TMAGIC, "\n")
+		r = writetostream(object, writeo,
+			function(id, d)
+				w:write("#", tostring(id), "\n")
+
+				for _, p in ipairs(d) do
+					w:write(p.style)
+					if (#p > 0) then
+						w:write(" ", table_concat(p, " "))
+					end
+					w:write("\n")
+				end
+
+				w:write(".\n")
+			end)
 	end
-	r, e = fp:close()
-	if e then
+
+	local size = w:tell()
+	r, e = w:close()
+	if not r then
+		os.remove(filename..".new")
 		return r, e
 	end
 
@@ -165,12 +267,24 @@ function SaveToStream(filename, object)
 		-- one...
 		return r, e..": the filename of your document has changed"
 	end
+
+	-- Remember where everything is in the document set's own file, so that
+	-- the next save can reuse it.
+
+	if (filename == object.name) then
+		object._savedfile = nil
+		if saved then
+			for d, location in pairs(saved) do
+				d._saved = location
+			end
+			object._savedfile = { name = filename, size = size }
+		end
+	end
 	return r, e
 end
 
 function SaveDocumentSetRaw(filename)
-	DocumentSet:purge()
-	return SaveToStream(filename, DocumentSet)
+	return SaveToStream(filename, DocumentSet, not WantTextFileFormat())
 end
 
 function Cmd.SaveCurrentDocumentAs(filename)
@@ -476,10 +590,86 @@ function loadfromstreamz(fp)
 	return load()
 end
 
-function loadfromstreamt(fp)
+local function createloaddata()
 	local data = CreateDocumentSet()
 	data.menu = CreateMenuBindings()
 	data.documents = {}
+	return data
+end
+
+-- Applies a property line (".foo.bar: value") to the data being loaded.
+
+local function loadproperty(data, line)
+	local _, _, k, p, v = line:find("^(.*)%.([^.:]+): (.*)$")
+
+	-- This is setting a property value.
+	local o = data
+	for e in k:gmatch("[^.]+") do
+		if e:find('^[0-9]+') then
+			e = tonumber(e)
+		end
+		if not o[e] then
+			if (o == data.documents) then
+				o[e] = CreateDocument()
+			else
+				o[e] = {}
+			end
+		end
+		o = o[e]
+	end
+
+	if v:find('^-?[0-9][0-9.e+-]*$') then
+		v = tonumber(v)
+	elseif (v == "true") then
+		v = true
+	elseif (v == "false") then
+		v = false
+	elseif v:find('^".*"$') then
+		v = v:sub(2, -2)
+		v = unescape(v)
+	else
+		error(
+			string.format("malformed property %s.%s: %s", k, p, v))
+	end
+
+	if p:find('^[0-9]+$') then
+		p = tonumber(p)
+	end
+
+	o[p] = v
+end
+
+-- Returns the document with the given id ("clipboard" or a document index).
+
+local function findloaddocument(data, id)
+	if (id == "clipboard") then
+		local doc = data.clipboard
+		if not doc then
+			doc = {}
+			setmetatable(doc, {__index = DocumentClass})
+			data.clipboard = doc
+		end
+		return doc
+	end
+	return data.documents[tonumber(id)]
+end
+
+local function finishload(data)
+	-- Patch up document names.
+	for i, d in ipairs(data.documents) do
+		data.documents[d.name] = d
+	end
+	data.current = data.documents[data.current]
+
+	-- Remove any broken clipboard (works around a bug in v0.6 saved files).
+	if data.clipboard and (#data.clipboard == 0) then
+		data.clipboard = nil
+	end
+	return data
+end
+
+function loadfromstreamt(fp)
+	local data = createloaddata()
 
 	while true do
 		local line = fp:read("*l")
@@ -488,55 +678,9 @@ function loadfromstreamt(fp)
 		end
 
 		if line:find("^%.") then
-			local _, _, k, p, v = line:find("^(.*)%.([^.:]+): (.*)$")
-
-			-- This is setting a property value.
-			local o = data
-			for e in k:gmatch("[^.]+") do
-				if e:find('^[0-9]+') then
-					e = tonumber(e)
-				end
-				if not o[e] then
-					if (o == data.documents) then
-						o[e] = CreateDocument()
-					else
-						o[e] = {}
-					end
-				end
-				o = o[e]
-			end
-
-			if v:find('^-?[0-9][0-9.e+-]*$') then
-				v = tonumber(v)
-			elseif (v == "true") then
-				v = true
-			elseif (v == "false") then
-				v = false
-			elseif v:find('^".*"$') then
-				v = v:sub(2, -2)
-				v = unescape(v)
-			else
-				error(
-					string.format("malformed property %s.%s: %s", k, p, v))
-			end
-
-			if p:find('^[0-9]+$') then
-				p = tonumber(p)
-			end
-
-			o[p] = v
+			loadproperty(data, line)
 		elseif line:find("^#") then
-			local id = line:sub(2)
-			local doc
-			if (id == "clipboard") then
-				doc = data.clipboard
-				if not doc then
-					doc = {}
-					data.clipboard = doc
-				end
-			else
-				doc = data.documents[tonumber(id)]
-			end
+			local doc = findloaddocument(data, line:sub(2))
 
 			local index = 1
 			while true do
@@ -557,17 +701,57 @@ function loadfromstreamt(fp)
 		end
 	end
 
-	-- Patch up document names.
-	for i, d in ipairs(data.documents) do
-		data.documents[d.name] = d
+	-- Files in the text format stay in the text format (they're probably
+	-- being kept in version control).
+	data.addons.fileformat = data.addons.fileformat or { textformat = true }
+
+	return finishload(data)
+end
+
+function loadfromstreamb(fp, filename)
+	local s = fp:read("*a")
+	local offset = 1
+
+	local function readu32()
+		local a, b, c, d = s:byte(offset, offset+3)
+		if not d then
+			error("unexpected EOF when reading file")
+		end
+		offset = offset + 4
+		return a + b*0x100 + c*0x10000 + d*0x1000000
 	end
-	data.current = data.documents[data.current]
 
-	-- Remove any broken clipboard (works around a bug in v0.6 saved files).
-	if data.clipboard and (#data.clipboard == 0) then
-		data.clipboard = nil
+	local function readstring(n)
+		local v = s:sub(offset, offset+n-1)
+		offset = offset + n
+		return v
 	end
-	return data
+
+	local data = createloaddata()
+
+	local properties = readstring(readu32())
+	for line in properties:gmatch("[^\n]+") do
+		loadproperty(data, line)
+	end
+
+	-- Remember where each document came from, so that saving again can
+	-- copy unchanged ones straight out of this file.
+	local base = #BMAGIC + 1
+	data._savedfile = { name = filename, size = base + #s }
+
+	local metatable = {__index = ParagraphClass}
+	for i = 1, readu32() do
+		local doc = findloaddocument(data, readstring(readu32()))
+		local start = offset
+		offset = DecodeParagraphs(s, offset, doc, metatable)
+		doc._saved = {
+			offset = base + start - 1,
+			size = offset - start,
+			checksum = CRC32(s, start, offset - start)
+		}
+	end
+
+	return finishload(data)
 end
 
 function LoadFromStream(filename)
@@ -583,12 +767,14 @@ function LoadFromStream(filename)
 		loader = loadfromstreamz
 	elseif (magic == TMAGIC) then
 		loader = loadfromstreamt
+	elseif (magic == BMAGIC) then
+		loader = loadfromstreamb
 	else
 		fp:close()
 		return nil, ("'"..filename.."' is not a valid WordGrinder file.")
 	end
 
-	local d, e = loader(fp)
+	local d, e = loader(fp, filename)
 	fp:close()
 
 	return d, e
@@ -752,3 +938,15 @@ function UpgradeDocument(oldversion)
 		DocumentSet.idletime = nil
 	end
 end
+
+-----------------------------------------------------------------------------
+-- Any change to a document means it has to be encoded afresh next time it's
+-- saved.
+
+do
+	local function cb(event, token, document)
+		document._saved = nil
+	end
+
+	AddEventListener(Event.ParagraphChanged, cb)
+end
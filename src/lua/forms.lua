@@ -285,6 +285,20 @@ Form.TextField = makewidgetclass {
 		return "nop"
 	end,
 
+	-- Pasted text is inserted in one go. Text fields only hold a single
+	-- line, so a trailing newline is dropped and other control characters
+	-- become spaces.
+	["KEY_PASTE"] = function(self, key, text)
+		text = (text or ""):gsub("[\r\n]+$", ""):gsub("%c", " ")
+		discard_transient_textfield(self)
+		self.value = self.value:sub(1, self.cursor-1) .. text .. self.value:sub(self.cursor)
+		self.cursor = self.cursor + text:len()
+		self:changed()
+		self:draw()
+
+		return "nop"
+	end,
+
 	key = function(self, key)
 		if not key:match("^KEY_") then
 			discard_transient_textfield(self)
@@ -486,13 +500,13 @@ local function resolvesize(size, bound)
 	end
 end
 
-local function findaction(table, object, key)
+local function findaction(table, object, key, text)
 	local action = table[key]
 	if action and (type(action) == "function") then
-		action = action(object, key)
+		action = action(object, key, text)
 	end
 	if not action and table.key then
-		action = table.key(object, key)
+		action = table.key(object, key, text)
 	end
 	return action
 end
@@ -617,7 +631,7 @@ function Form.Run(dialogue, redraw, helptext)
 			getchar = GetCharWithBlinkingCursor
 		end
 		HideCursor()
-		local key = getchar()
+		local key, text = getchar()
 
 		if dialogue.transient then
 			redraw_dialogue()
@@ -631,12 +645,12 @@ function Form.Run(dialogue, redraw, helptext)
 		local action = nil
 		if dialogue.focus then
 			local w = dialogue[dialogue.focus]
-			action = findaction(w, w, key)
+			action = findaction(w, w, key, text)
 		end
 
 		if not action then
-			action = findaction(dialogue, dialogue, key) or
-				findaction(standard_actions, dialogue, key)
+			action = findaction(dialogue, dialogue, key, text) or
+				findaction(standard_actions, dialogue, key, text)
 		end
 
 		if (action == "cancel") then
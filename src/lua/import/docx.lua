@@ -14,8 +14,7 @@ local UNDERLINE = wg.UNDERLINE
 local BOLD = wg.BOLD
 local ParseWord = wg.parseword
 local WriteU8 = wg.writeu8
-local ReadFromZip = wg.readfromzip
-local UnzipFile = wg.unzipfile
+local OpenZip = wg.openzip
 local bitand = bit32.band
 local bitor = bit32.bor
 local bitxor = bit32.bxor
@@ -34,7 +33,10 @@ local PIC = "http://schemas.openxmlformats.org/drawingml/2006/picture"
 local VAL = W .. " val"
 
 local relations = {}
-local zipfile
+
+-- Images are unzipped once the body has been read, as only one member of
+-- the zip can be open at a time.
+local images
 
 -----------------------------------------------------------------------------
 -- The importer itself.
@@ -462,7 +464,7 @@ local function import_paragraphs(styles, lists, importer, element, defaultstyle)
 																	if target then
 																		local image = string.format("word/%s", target)
 																		local tmpname = os.tmpname()
-																		UnzipFile(zipfile, image, tmpname)
+																		images[#images+1] = {image, tmpname}
 																		-- add image to WG
 																		importer:style_off(BOLD)
 																		importer:style_off(ITALIC)
@@ -500,27 +502,29 @@ function Cmd.ImportDOCXFile(filename)
 	
 	ImmediateMessage("Importing...")	
 
-	-- Load the styles and content subdocuments.
-	zipfile = filename
+	-- Load the styles and content subdocuments. Each is parsed as it's
+	-- decompressed, a chunk at a time, rather than being read whole first.
 	
-	local relationsxml  = ReadFromZip(filename, "word/_rels/document.xml.rels")
-	local stylesxml     = ReadFromZip(filename, "word/styles.xml")
-	local numberingxml  = ReadFromZip(filename, "word/numbering.xml")
-	local contentxml    = ReadFromZip(filename, "word/document.xml")
+	local zip = OpenZip(filename)
+	local function parse(member)
+		local reader = zip:reader(member)
+		return reader and ParseXML(reader)
+	end
+
+	local stylesxml = zip and parse("word/styles.xml")
+	local numberingxml = stylesxml and parse("word/numbering.xml")
+	local relationsxml = stylesxml and parse("word/_rels/document.xml.rels")
+	local contentxml = stylesxml and zip:reader("word/document.xml")
 	if not stylesxml or not contentxml then
+		if zip then
+			zip:close()
+		end
 		ModalMessage(nil, "The import failed, probably because the file could not be found.")
 		QueueRedraw()
 		return false
 	end
 		
-	stylesxml      = ParseXML(stylesxml)
-	contentxml     = ParseXML(contentxml)
-	if (numberingxml) then
-		numberingxml = ParseXML(numberingxml) 
-	end
-
 	if relationsxml then
-		relationsxml = ParseXML(relationsxml) 
 		get_relations(relationsxml)
 	end
 
@@ -535,74 +539,92 @@ function Cmd.ImportDOCXFile(filename)
 		collect_lists(lists, numberingxml)
 	end
 
-	-- Actually import the content.
+	-- Actually import the content. document.xml is by far the biggest part
+	-- of the file, so rather than parse the whole thing it's handled one
+	-- paragraph (or table) at a time.
 	
 	local document = CreateDocument()
 	local importer = CreateImporter(document)
 	importer:reset()
 
-	for _, element in ipairs(contentxml) do
-		if (element._name == W .. " body") then
+	local function import_body(element)
+		-- get paragraph
+		if (element._name == W .. " p") or (element._name == W .. " tbl")then
+			import_paragraphs(styles, lists, importer, element, "P")
+		end
+		
+		-- get page properties
+		if (element._name == W .. " sectPr") then
+			local settings = DocumentSet.addons.pageconfig
 			for _, element in ipairs(element) do
-				-- get paragraph
-				if (element._name == W .. " p") or (element._name == W .. " tbl")then
-					import_paragraphs(styles, lists, importer, element, "P")
-				end
-				
-				-- get page properties
-				if (element._name == W .. " sectPr") then
-					local settings = DocumentSet.addons.pageconfig
-					for _, element in ipairs(element) do
-						if (element._name == W .. " pgSz") then
-							local w = element[W .. " w"] or 11906
-							local h = element[W .. " h"] or 16838
-
-							w = tonumber(w)
-							h = tonumber(h)
-							
-							local x = 0
-							local y = 0
-							
-							if w > h then
-								settings.landscape = true
-								x = h
-								y = w
-							else
-								settings.landscape = false
-								x = w
-								y = h
-							end
+				if (element._name == W .. " pgSz") then
+					local w = element[W .. " w"] or 11906
+					local h = element[W .. " h"] or 16838
 
-							settings.pagesize = "A4"
-							if x == 8391 and y == 11906 then
-								settings.pagesize = "A5"
-							end
-							
-							if x == 12240 and y == 15840 then
-								settings.pagesize = "letter"
-							end
+					w = tonumber(w)
+					h = tonumber(h)
+					
+					local x = 0
+					local y = 0
+					
+					if w > h then
+						settings.landscape = true
+						x = h
+						y = w
+					else
+						settings.landscape = false
+						x = w
+						y = h
+					end
 
-							Cmd.SetTextWidth()
-						end
-						
-						if (element._name == W .. " pgMar") then
-							local left   = element[W .. " left"]   or 1134
-							local right  = element[W .. " right"]  or 1134
-							local top    = element[W .. " top"]    or 1134
-							local bottom = element[W .. " bottom"] or 1134
-							
-							settings.left   = left   / 567
-							settings.right  = right  / 567
-							settings.top    = top    / 567
-							settings.bottom = bottom / 567
-							
-							Cmd.SetTextWidth()
-						end
+					settings.pagesize = "A4"
+					if x == 8391 and y == 11906 then
+						settings.pagesize = "A5"
+					end
+					
+					if x == 12240 and y == 15840 then
+						settings.pagesize = "letter"
 					end
+
+					Cmd.SetTextWidth()
+				end
+				
+				if (element._name == W .. " pgMar") then
+					local left   = element[W .. " left"]   or 1134
+					local right  = element[W .. " right"]  or 1134
+					local top    = element[W .. " top"]    or 1134
+					local bottom = element[W .. " bottom"] or 1134
+					
+					settings.left   = left   / 567
+					settings.right  = right  / 567
+					settings.top    = top    / 567
+					settings.bottom = bottom / 567
+					
+					Cmd.SetTextWidth()
 				end
 			end
-		end 
+		end
+	end
+
+	images = {}
+	ParseXMLElements(contentxml,
+		{
+			[W .. " document"] =
+			{
+				[W .. " body"] =
+				{
+					[W .. " p"] = import_body,
+					[W .. " tbl"] = import_body,
+					[W .. " sectPr"] = import_body,
+				}
+			}
+		}
+	)
+
+	for _, image in ipairs(images) do
+		zip:unzip(image[1], image[2])
 	end
+	zip:close()
 
 	-- All the importers produce a blank line at the beginning of the
 	-- document (the default content made by CreateDocument()). Remove it.
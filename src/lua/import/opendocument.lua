@@ -14,8 +14,7 @@ local UNDERLINE = wg.UNDERLINE
 local BOLD = wg.BOLD
 local ParseWord = wg.parseword
 local WriteU8 = wg.writeu8
-local ReadFromZip = wg.readfromzip
-local UnzipFile = wg.unzipfile
+local OpenZip = wg.openzip
 local bitand = bit32.band
 local bitor = bit32.bor
 local bitxor = bit32.bxor
@@ -34,7 +33,9 @@ local TABLE_NS  = "urn:oasis:names:tc:opendocument:xmlns:table:1.0"
 local DRAW_NS   = "urn:oasis:names:tc:opendocument:xmlns:drawing:1.0"
 local XLINK_NS  = "http://www.w3.org/1999/xlink"
 
-local zipfile
+-- Images are unzipped once the body has been read, as only one member of
+-- the zip can be open at a time.
+local images
 -----------------------------------------------------------------------------
 -- The importer itself.
 
@@ -425,7 +426,7 @@ local function import_paragraphs(styles, importer, xml, defaultstyle)
 							local image = element[XLINK_NS .. " href"]
 							if image then
 								local tmpname = os.tmpname()
-								UnzipFile(zipfile, image, tmpname)
+								images[#images+1] = {image, tmpname}
 								-- add image to WG
 								importer:style_off(BOLD)
 								importer:style_off(ITALIC)
@@ -475,47 +476,78 @@ function Cmd.ImportODTFile(filename)
 	
 	ImmediateMessage("Importing...")	
 
-	-- Load the styles and content subdocuments.
+	-- Load the styles and content subdocuments. Each is parsed as it's
+	-- decompressed, a chunk at a time, rather than being read whole first.
 	
-	zipfile = filename
-
-	local stylesxml = ReadFromZip(filename, "styles.xml")
-	local contentxml = ReadFromZip(filename, "content.xml")
+	local zip = OpenZip(filename)
+	local stylesxml = zip and zip:reader("styles.xml")
+	if stylesxml then
+		stylesxml = ParseXML(stylesxml)
+	end
+	local contentxml = stylesxml and zip:reader("content.xml")
 	if not stylesxml or not contentxml then
+		if zip then
+			zip:close()
+		end
 		ModalMessage(nil, "The import failed, probably because the file could not be found.")
 		QueueRedraw()
 		return false
 	end
-		
-	stylesxml = ParseXML(stylesxml)
-	contentxml = ParseXML(contentxml)
 
 	-- Find out what text styles the document creates (so we can identify
-	-- italic and underlined text).
+	-- italic and underlined text). content.xml has some more, which come
+	-- before its body.
 	
 	local styles = {}
 	collect_styles(styles, stylesxml)
-	collect_styles(styles, contentxml)
 	get_page_properties(stylesxml)
-	resolve_parent_styles(styles)
 
-	-- Actually import the content.
+	local function content_styles(element)
+		collect_styles(styles, {element})
+	end
+
+	-- Actually import the content. content.xml is by far the biggest part
+	-- of the file, so rather than parse the whole thing it's handled one
+	-- paragraph (or table, or list) at a time.
 	
 	local document = CreateDocument()
 	local importer = CreateImporter(document)
 	importer:reset()
 
-	local BODY = OFFICE_NS .. " body"
-	local TEXT = OFFICE_NS .. " text"
-	for _, element in ipairs(contentxml) do
-		if (element._name == BODY) then
-			for _, element in ipairs(element) do
-				if (element._name == TEXT) then
-					import_paragraphs(styles, importer, element, "P")
-				end
-			end
-		end 
+	local resolved = false
+	local function import_text(element)
+		if not resolved then
+			resolve_parent_styles(styles)
+			resolved = true
+		end
+		import_paragraphs(styles, importer, {element}, "P")
+	end
+
+	images = {}
+	ParseXMLElements(contentxml,
+		{
+			[OFFICE_NS .. " document-content"] =
+			{
+				[OFFICE_NS .. " styles"] = content_styles,
+				[OFFICE_NS .. " automatic-styles"] = content_styles,
+				[OFFICE_NS .. " body"] =
+				{
+					[OFFICE_NS .. " text"] =
+					{
+						[TABLE_NS .. " table"] = import_text,
+						[TEXT_NS .. " p"] = import_text,
+						[TEXT_NS .. " h"] = import_text,
+						[TEXT_NS .. " list"] = import_text,
+					}
+				}
+			}
+		}
+	)
+
+	for _, image in ipairs(images) do
+		zip:unzip(image[1], image[2])
 	end
+	zip:close()
 
 	-- All the importers produce a blank line at the beginning of the
 	-- document (the default content made by CreateDocument()). Remove it.
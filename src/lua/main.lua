@@ -19,6 +19,8 @@ local SetReverse = wg.setreverse
 local GetStringWidth = wg.getstringwidth
 local GetCwd = wg.getcwd
 local Stat = wg.stat
+local GetChar = wg.getchar
+local GetTime = wg.time
 
 local redrawpending = true
 
@@ -184,7 +186,10 @@ function WordProcessor(filename)
             RedrawScreen()
         end,
 
-        ["KEY_REDRAW"] = RedrawScreen,
+        ["KEY_REDRAW"] = function()
+            InvalidateScreen()
+            RedrawScreen()
+        end,
 
         [" "] = { Cmd.Checkpoint, Cmd.TypeWhileSelected,
             Cmd.SplitCurrentWord },
@@ -193,26 +198,48 @@ function WordProcessor(filename)
         ["KEY_ESCAPE"] = Cmd.ActivateMenu,
     }
 
+    local lastredraw = 0
+
+    -- Returns the next key if one is already waiting, or nil.
+    local function pollkey()
+        local c, text = GetChar(0)
+        if (c ~= "KEY_TIMEOUT") then
+            return c, text
+        end
+    end
+
     local function eventloop()
         local nl = string.char(13)
         while true do
-            if DocumentSet.justchanged then
-                FireEvent(Event.Changed)
-                DocumentSet.justchanged = false
+            -- If there's more input already waiting (from a held-down key,
+            -- or a paste), handle that before redrawing; but don't go more
+            -- than a frame without updating the screen.
+            local c, text
+            if redrawpending and ((GetTime() - lastredraw) < (1 / MAX_FPS)) then
+                c, text = pollkey()
             end
 
-            FlushAsyncEvents()
-            FireEvent(Event.WaitingForUser)
-            local c = "KEY_TIMEOUT"
-            while (c == "KEY_TIMEOUT") do
-                if redrawpending then
-                    RedrawScreen()
-                    redrawpending = false
+            if not c then
+                if DocumentSet.justchanged then
+                    FireEvent(Event.Changed)
+                    DocumentSet.justchanged = false
                 end
 
-                c = GetCharWithBlinkingCursor(IDLE_TIME)
-                if (c == "KEY_TIMEOUT") then
-                    FireEvent(Event.Idle)
+                FlushAsyncEvents()
+                FireEvent(Event.WaitingForUser)
+                c = "KEY_TIMEOUT"
+                while (c == "KEY_TIMEOUT") do
+                    if redrawpending then
+                        RedrawScreen()
+                        redrawpending = false
+                        lastredraw = GetTime()
+                    end
+
+                    c, text = GetCharWithBlinkingCursor(IDLE_TIME)
+                    if (c == "KEY_TIMEOUT") then
+                        FireEvent(Event.Idle)
+                        FlushAsyncEvents()
+                    end
                 end
             end
             if c ~= "KEY_RESIZE" then
@@ -223,6 +250,10 @@ function WordProcessor(filename)
             local f = masterkeymap[c]
             if f then
                 RunMenuAction(f)
+            elseif (c == "KEY_PASTE") then
+                -- Pasted text is inserted verbatim, as a single change.
+                Cmd.Checkpoint()
+                Cmd.InsertBlock(text)
             else
                 -- It's not in masterkeymap. If it's printable, insert it; if it's
                 -- not, look it up in the menu hierarchy.
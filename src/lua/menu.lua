@@ -117,6 +117,7 @@ local ExportMenu = CreateMenu("Export current document",
 local DocumentSettingsMenu = CreateMenu("Document settings",
 {
   {"FSautosave",     "A", "Autosave...",           nil,         Cmd.ConfigureAutosave},
+  {"FSFileFormat",   "F", "File format...",        nil,         Cmd.ConfigureFileFormat},
   {"FSscrapbook",    "S", "Scrapbook...",          nil,         Cmd.ConfigureScrapbook},
   {"FSHTMLExport",   "H", "HTML export...",        nil,         Cmd.ConfigureHTMLExport},
 	{"FSPageCount",    "P", "Page count...",         nil,         Cmd.ConfigurePageCount},
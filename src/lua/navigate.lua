@@ -184,10 +184,7 @@ function Cmd.InsertStringIntoWord(c)
 		return false
 	end
 
-	Document[cp] = CreateParagraph(paragraph.style,
-		paragraph:sub(1, cw-1),
-		s,
-		paragraph:sub(cw+1))
+	Document:replaceWordsAt(cp, cw, 1, s)
 	Document.co = co
 
 	DocumentSet:touch()
@@ -244,11 +241,7 @@ function Cmd.SplitCurrentWord()
 	local left = DeleteFromWord(word, co, #word+1)
 	local right = DeleteFromWord(word, 1, co)
 
-	Document[cp] = CreateParagraph(paragraph.style,
-		paragraph:sub(1, cw-1),
-		left,
-		styleprime..right,
-		paragraph:sub(cw+1))
+	Document:replaceWordsAt(cp, cw, 1, left, styleprime..right)
 
 	Document.cw = cw + 1
 	Document.co = 1 + styleprimelen -- yes, this means that co has a minimum of 2
@@ -264,9 +257,9 @@ function Cmd.JoinWithNextParagraph()
 		return false
 	end
 
-	Document[cp] = CreateParagraph(Document[cp].style,
+	Document:replaceParagraphAt(cp, CreateParagraph(Document[cp].style,
 		Document[cp],
-		Document[cp+1])
+		Document[cp+1]))
 	Document:deleteParagraphAt(cp+1)
 
 	DocumentSet:touch()
@@ -287,10 +280,7 @@ function Cmd.JoinWithNextWord()
 
 	local word, co, _ = InsertIntoWord(paragraph[cw+1], paragraph[cw], 1, 0)
 	Document.co = co
-	Document[cp] = CreateParagraph(paragraph.style,
-		paragraph:sub(1, cw-1),
-		word,
-		paragraph:sub(cw+2))
+	Document:replaceWordsAt(cp, cw, 2, word)
 
 	DocumentSet:touch()
 	QueueRedraw()
@@ -318,10 +308,7 @@ function Cmd.DeleteNextChar()
 		return Cmd.JoinWithNextWord()
 	end
 
-	Document[cp] = CreateParagraph(paragraph.style,
-		paragraph:sub(1, cw-1),
-		DeleteFromWord(word, co, nextco),
-		paragraph:sub(cw+1))
+	Document:replaceWordsAt(cp, cw, 1, DeleteFromWord(word, co, nextco))
 
 	DocumentSet:touch()
 	QueueRedraw()
@@ -343,10 +330,7 @@ function Cmd.DeleteWordLeftOfCursor()
 	local paragraph = Document[cp]
 	local word = paragraph[cw]
 
-	Document[cp] = CreateParagraph(paragraph.style,
-		paragraph:sub(1, cw-1),
-		DeleteFromWord(word, 1, co),
-		paragraph:sub(cw+1))
+	Document:replaceWordsAt(cp, cw, 1, DeleteFromWord(word, 1, co))
 	Document.co = 1
 
 	DocumentSet:touch()
@@ -389,7 +373,7 @@ function Cmd.SplitCurrentParagraph()
 	local p1 = CreateParagraph(paragraph.style, paragraph:sub(1, cw-1))
 	local p2 = CreateParagraph(paragraph.style, paragraph:sub(cw))
 
-	Document[cp] = p2
+	Document:replaceParagraphAt(cp, p2)
 	Document:insertParagraphBefore(p1, cp)
 	Document.cp = Document.cp + 1
 	Document.cw = 1
@@ -503,26 +487,38 @@ function Cmd.GotoEndOfLine()
 	return Cmd.GotoXPosition(ScreenWidth)
 end
 
-function Cmd.GotoPreviousPage()
-	if Document.topp and Document.topw then
-		local x, _, _ = getpos()
-		Document.cp = Document.topp
-		Document.cw = Document.topw
-		Document.co = 1
-		return Cmd.GotoXPosition(x)
+-- Moves the cursor up or down by a number of screen lines, using the
+-- document's line index, and keeps it in the same column.
+
+local function gotoscreenline(delta)
+	local x, ln, _ = getpos()
+	local line = Document:getLineOfParagraph(Document.cp) + ln - 1 + delta
+	if (line < 0) then
+		line = 0
 	end
-	return false
+
+	local pn
+	pn, ln = Document:getParagraphOfLine(line)
+	local lines = Document[pn]:wrapForStyle(nil, Document[pn-1] or false)
+	if (ln > #lines) then
+		ln = #lines
+	end
+
+	Document.cp = pn
+	Document.cw = lines[ln].wn
+	Document.co = 1
+	return Cmd.GotoXPosition(x)
+end
+
+-- The cursor is always drawn halfway down the screen, so a page is the
+-- distance to the top or bottom of it.
+
+function Cmd.GotoPreviousPage()
+	return gotoscreenline(1 - int(ScreenHeight / 2))
 end
 
 function Cmd.GotoNextPage()
-	if Document.botp and Document.botw then
-		local x, _, _ = getpos()
-		Document.cp = Document.botp
-		Document.cw = Document.botw
-		Document.co = 1
-		return Cmd.GotoXPosition(x)
-	end
-	return false
+	return gotoscreenline(ScreenHeight - int(ScreenHeight / 2))
 end
 
 local style_tab =
@@ -578,10 +574,10 @@ function Cmd.ApplyStyleToSelection(s)
 			words[#words+1] = word
 		end
 
-		Document[p] = CreateParagraph(paragraph.style,
+		Document:replaceParagraphAt(p, CreateParagraph(paragraph.style,
 			paragraph:sub(1, firstword-1),
 			words,
-			paragraph:sub(lastword+1))
+			paragraph:sub(lastword+1)))
 	end
 
 	Cmd.UnsetMark()
@@ -681,7 +677,7 @@ function Cmd.ChangeParagraphStyle(style)
 	end
 
 	for p = first, last do
-		Document[p] = CreateParagraph(style, Document[p])
+		Document:replaceParagraphAt(p, CreateParagraph(style, Document[p]))
 	end
 
 	DocumentSet:touch()
@@ -843,11 +839,10 @@ function Cmd.Copy(keepselection)
 	end
 end
 
-function Cmd.Paste()
-	local buffer = DocumentSet:getClipboard()
-	if not buffer then
-		return false
-	end
+-- Inserts the contents of another document at the cursor, replacing the
+-- selection if there is one.
+
+local function insertdocument(buffer)
 	if Document.mp then
 		if not Cmd.Delete() then
 			return false
@@ -860,10 +855,10 @@ function Cmd.Paste()
 	Cmd.SplitCurrentWord()
 	local paragraph = Document[Document.cp]
 
-	Document[Document.cp] = CreateParagraph(paragraph.style,
+	Document:replaceParagraphAt(Document.cp, CreateParagraph(paragraph.style,
 		paragraph:sub(1, cw),
 		buffer[1],
-		paragraph:sub(cw+1))
+		paragraph:sub(cw+1)))
 	Document.cw = Document.cw + #buffer[1]
 	Document.co = 1
 
@@ -883,26 +878,75 @@ function Cmd.Paste()
 
 		Cmd.SplitCurrentParagraph()
 
-		local p = 2
+		local paragraphs = {}
 		for p = 2, #buffer do
 			local paragraph = buffer[p]
-			Document:insertParagraphBefore(
-				CreateParagraph(paragraph.style, paragraph),
-				Document.cp)
-
-			Document.cp = Document.cp + 1
-			Document.cw = 1
-			Document.co = 1
+			paragraphs[p-1] = CreateParagraph(paragraph.style, paragraph)
 		end
+		Document:insertParagraphsBefore(paragraphs, Document.cp)
+
+		Document.cp = Document.cp + #paragraphs
+		Document.cw = 1
+		Document.co = 1
 	end
 
 	-- Splice the last word of the section just pasted.
 
-	NonmodalMessage("Clipboard copied to cursor position.")
 	return Cmd.GotoBeginningOfWord() and Cmd.GotoPreviousCharW()
 		and Cmd.JoinWithNextWord()
 end
 
+function Cmd.Paste()
+	local buffer = DocumentSet:getClipboard()
+	if not buffer then
+		return false
+	end
+
+	NonmodalMessage("Clipboard copied to cursor position.")
+	return insertdocument(buffer)
+end
+
+-- Inserts a block of plain text, such as a paste from the terminal, at the
+-- cursor in one operation. Each line becomes a paragraph in the current
+-- paragraph's style.
+
+function Cmd.InsertBlock(text)
+	if Document.mp then
+		if not Cmd.Delete() then
+			return false
+		end
+	end
+
+	text = text:gsub("[%z\1-\8\11\12\14-\31\127]", "")
+	text = text:gsub("\r\n?", "\n")
+
+	local lines = {}
+	for line in (text.."\n"):gmatch("([^\n]*)\n") do
+		lines[#lines+1] = line
+	end
+
+	local style = Document[Document.cp].style
+	local buffer = {}
+	for i, line in ipairs(lines) do
+		-- Whitespace at the very beginning or end means that the text
+		-- mustn't be joined on to the word either side of the cursor. (At
+		-- the start of a word there's nothing to join on to.)
+
+		local words = ParseStringIntoWords(line)
+		if (words[1] ~= "") then
+			if (i == 1) and (Document.co > 1) and line:find("^[ \t]") then
+				table.insert(words, 1, "")
+			end
+			if (i == #lines) and line:find("[ \t]$") then
+				words[#words+1] = ""
+			end
+		end
+		buffer[i] = CreateParagraph(style, words)
+	end
+
+	return insertdocument(buffer)
+end
+
 function Cmd.Delete()
 	if not Document.mp then
 		return false
@@ -931,9 +975,7 @@ function Cmd.Delete()
 	-- We now have a whole number of paragraphs containing the area to delete.
 	-- Delete them.
 
-	for i = 1, (mp2 - mp1 + 1) do
-		Document:deleteParagraphAt(Document.cp)
-	end
+	Document:deleteParagraphsAt(Document.cp, mp2 - mp1 + 1)
 
 	-- And merge the two areas together again.
 
@@ -15,6 +15,8 @@ local Write = wg.write
 local WriteRow = wg.writerow
 local GotoXY = wg.gotoxy
 local ClearArea = wg.cleararea
+local ClearScreen = wg.clearscreen
+local GetDrawCount = wg.getdrawcount
 local SetNormal = wg.setnormal
 local SetBold = wg.setbold
 local SetBright = wg.setbright
@@ -32,6 +34,97 @@ local BLINK_TIME = 0.8
 local messages = {}
 local leftpadding = 0
 
+-- The document is drawn a row at a time, and only rows whose contents have
+-- changed since the last redraw are actually drawn. Laying out the screen
+-- queues up the drawing operations for each row; a row is redrawn only if
+-- its operations (the function and all its arguments) differ from last
+-- time. Wrapped lines are thrown away whenever a paragraph is rewrapped, so
+-- an unchanged line table means unchanged text.
+--
+-- Anything else which draws on the screen (menus, dialogues, messages)
+-- bumps the screen's draw count, which makes the next redraw start from
+-- scratch.
+
+local OPSIZE = 6
+local OVERWRITTEN = { n = -1 }
+
+local oldrows = nil
+local newrows = nil
+local drawcount = nil
+
+function InvalidateScreen()
+	oldrows = nil
+end
+
+local function queue(y, f, a, b, c, d, e)
+	if (y < 0) or (y >= ScreenHeight) then
+		return
+	end
+
+	local row = newrows[y]
+	if not row then
+		row = { n = 0 }
+		newrows[y] = row
+	end
+
+	local n = row.n
+	row[n+1] = f
+	row[n+2] = a
+	row[n+3] = b
+	row[n+4] = c
+	row[n+5] = d
+	row[n+6] = e
+	row.n = n + OPSIZE
+end
+
+local function samerow(old, new)
+	if not old or not new then
+		return old == new
+	end
+
+	local n = new.n
+	if (old.n ~= n) then
+		return false
+	end
+	for i = 1, n do
+		if (old[i] ~= new[i]) then
+			return false
+		end
+	end
+	return true
+end
+
+local function drawrow(y, row)
+	for i = 1, row.n, OPSIZE do
+		row[i](y, row[i+1], row[i+2], row[i+3], row[i+4], row[i+5])
+	end
+end
+
+local function writeplain(y, x, s)
+	Write(x, y, s)
+end
+
+local function writebright(y, x, s)
+	SetBright()
+	Write(x, y, s)
+	SetNormal()
+end
+
+local function writeimagerow(y, x, row)
+	WriteRow(x, y, row)
+end
+
+-- mark is a token unique to each redraw if there's a selection, so that
+-- marked lines are always redrawn.
+
+local function drawtext(y, paragraph, line, x, pn, mark)
+	if not mark then
+		paragraph:renderLine(line, x, y)
+	else
+		paragraph:renderMarkedLine(line, x, y, nil, pn)
+	end
+end
+
 function NonmodalMessage(s)
 	messages[#messages+1] = s
 	QueueRedraw()
@@ -42,6 +135,7 @@ function ResetNonmodalMessages()
 end
 
 function ResizeScreen()
+	InvalidateScreen()
 	ScreenWidth, ScreenHeight = wg.getscreensize()
 	local w = GetMaximumAllowedWidth(ScreenWidth)
 	local rw = w - Document.margin - 1
@@ -119,6 +213,7 @@ local function redrawstatus()
 		RAlignInField(0, ScreenHeight-1, ScreenWidth, s)
 		SetNormal()
 
+		oldrows[y] = OVERWRITTEN
 		y = y - 1
 	end
 
@@ -128,6 +223,7 @@ local function redrawstatus()
 		for i = #messages, 1, -1 do
 			ClearArea(0, y, ScreenWidth-1, y)
 			Write(0, y, messages[i])
+			oldrows[y] = OVERWRITTEN
 			y = y - 1
 		end
 
@@ -144,14 +240,10 @@ local topmarkerwidth = GetStringWidth(topmarker[1])
 local function drawtopmarker(y)
 	local x = int((ScreenWidth - topmarkerwidth)/2)
 
-	SetBright()
 	for i = #topmarker, 1, -1 do
-		if (y >= 0) then
-			Write(x, y, topmarker[i])
-		end
+		queue(y, writebright, x, topmarker[i])
 		y = y - 1
 	end
-	SetNormal()
 end
 
 local bottommarker = {
@@ -163,18 +255,14 @@ local bottommarkerwidth = GetStringWidth(bottommarker[1])
 local function drawbottommarker(y)
 	local x = int((ScreenWidth - bottommarkerwidth)/2)
 
-	SetBright()
 	for i = 1, #bottommarker do
-		if (y <= ScreenHeight) then
-			Write(x, y, bottommarker[i])
-		end
+		queue(y, writebright, x, bottommarker[i])
 		y = y + 1
 	end
-	SetNormal()
 end
 
 function RedrawScreen()
-	wg.clearscreen()
+	newrows = {}
 	local cp, cw, co = Document.cp, Document.cw, Document.co
 	local cy = int(ScreenHeight / 2)
 	local margin = Document.margin
@@ -202,8 +290,7 @@ function RedrawScreen()
 	-- Cache values for mark drawing.
 
 	local mp = Document.mp
-	local mw = Document.mw
-	local mo = Document.mo
+	local mark = mp and {}
 
 	-- borders for table
 	local border = string.rep("─", Document.wrapwidth)
@@ -228,48 +315,32 @@ function RedrawScreen()
 			paragraph.style == "TRB" or 
 			paragraph.style == "IMG"
 		then
-			Write(pstart-1,y+1, "└")
-			Write(pstart + Document.wrapwidth, y+1, "┘")
-			Write(pstart, y+1, border)
+			queue(y+1, writeplain, pstart-1, "└")
+			queue(y+1, writeplain, pstart + Document.wrapwidth, "┘")
+			queue(y+1, writeplain, pstart, border)
 		end
 		
-		local lines
-		if 
-			paragraph.style == "TR"  or
-			paragraph.style == "TRB" 
-		then
-			lines = paragraph:wrapTableRow()
-		elseif paragraph.style == "IMG" then
-			lines = paragraph:wrapImage()
-		elseif paragraph.style == "BOTH" then
-			lines = paragraph:wrapBoth()
-		elseif paragraph.style == "CENTER" then
-			lines = paragraph:wrapCenter()
-		elseif paragraph.style == "RIGHT" then
-			lines = paragraph:wrapRight()
-		else
-			lines = paragraph:wrap()
-		end
+		local lines = paragraph:wrapForStyle()
 		
 		for ln = #lines, 1, -1 do
 			if 
 				paragraph.style == "TRB" or
 				paragraph.style == "IMG"
 			then
-				Write(pstart-1, y, "│")
-				Write(pstart + Document.wrapwidth, y, "│")
+				queue(y, writeplain, pstart-1, "│")
+				queue(y, writeplain, pstart + Document.wrapwidth, "│")
 				local i
 				local w = 0
 				if paragraph.style == "TRB" then
 					for i=1,paragraph.cn-1,1 do
 						w = w + paragraph.cellWidth[i]
-						Write(pstart-1 + w, y, "│")
+						queue(y, writeplain, pstart-1 + w, "│")
 					end
 				end
 				if paragraph.style == "IMG" then
 					local row = paragraph.imagedata[ln]
 					if row then
-						WriteRow(pstart, y, row)
+						queue(y, writeimagerow, pstart, row)
 					end
 				end
 			end
@@ -278,16 +349,11 @@ function RedrawScreen()
 						
 			local l = lines[ln]
 
-			if not mp then
-				paragraph:renderLine(l,
-					leftpadding + margin + x, y)
-			else
-				paragraph:renderMarkedLine(l,
-					leftpadding + margin + x, y, nil, pn)
-			end
+			queue(y, drawtext, paragraph, l, leftpadding + margin + x,
+				mark and pn, mark)
 
 			if (ln == 1) then
-				drawmargin(y, pn, paragraph)
+				queue(y, drawmargin, pn, paragraph, paragraph.number)
 			end
 
 			Document.topp = pn
@@ -303,9 +369,9 @@ function RedrawScreen()
 			paragraph.style == "TRB" or
 			paragraph.style == "IMG"
 		then
-			Write(pstart-1, y, "┌")
-			Write(pstart + Document.wrapwidth, y, "┐")
-			Write(pstart, y, border)
+			queue(y, writeplain, pstart-1, "┌")
+			queue(y, writeplain, pstart + Document.wrapwidth, "┐")
+			queue(y, writeplain, pstart, border)
 		end
 		
 		y = y - Document:spaceAbove(pn)
@@ -326,7 +392,7 @@ function RedrawScreen()
 			break
 		end
 
-		drawmargin(y, pn, paragraph)
+		queue(y, drawmargin, pn, paragraph, paragraph.number)
 
 		local pstart = paragraph:getIndentOfLine(0) +
 			leftpadding + margin
@@ -334,40 +400,24 @@ function RedrawScreen()
 		if 
 			paragraph.style == "TRB"
 		then
-			Write(pstart-1 ,y-1, "┌")
-			Write(pstart + Document.wrapwidth, y-1, "┐")
-			Write(pstart, y-1, border)
+			queue(y-1, writeplain, pstart-1, "┌")
+			queue(y-1, writeplain, pstart + Document.wrapwidth, "┐")
+			queue(y-1, writeplain, pstart, border)
 		end
 
 		if 
 			paragraph.style == "IMG"
 		then
-			Write(pstart-1 ,y+1, "┌")
-			Write(pstart + Document.wrapwidth, y+1, "┐")
-			Write(pstart, y+1, border)
-			Write(pstart-1 ,y-1, "┌")
-			Write(pstart + Document.wrapwidth, y-1, "┐")
-			Write(pstart, y-1, border)
+			queue(y+1, writeplain, pstart-1, "┌")
+			queue(y+1, writeplain, pstart + Document.wrapwidth, "┐")
+			queue(y+1, writeplain, pstart, border)
+			queue(y-1, writeplain, pstart-1, "┌")
+			queue(y-1, writeplain, pstart + Document.wrapwidth, "┐")
+			queue(y-1, writeplain, pstart, border)
 		end
 
 
-		local lines
-		if 
-			paragraph.style == "TR"  or 
-			paragraph.style == "TRB" 
-		then
-			lines = paragraph:wrapTableRow()
-		elseif paragraph.style == "IMG" then
-			lines = paragraph:wrapImage()
-		elseif paragraph.style == "BOTH" then
-			lines = paragraph:wrapBoth()
-		elseif paragraph.style == "CENTER" then
-			lines = paragraph:wrapCenter()
-		elseif paragraph.style == "RIGHT" then
-			lines = paragraph:wrapRight()
-		else
-			lines = paragraph:wrap()
-		end
+		local lines = paragraph:wrapForStyle()
 		
 		--for ln, l in ipairs(paragraph:wrap()) do
 		for ln, l in ipairs(lines) do
@@ -376,33 +426,28 @@ function RedrawScreen()
 				paragraph.style == "TRB" or 
 				paragraph.style == "IMG"
 			then
-				Write(pstart-1, y, "│")
-				Write(pstart + Document.wrapwidth, y, "│")
+				queue(y, writeplain, pstart-1, "│")
+				queue(y, writeplain, pstart + Document.wrapwidth, "│")
 				if paragraph.style == "TRB" then
 					local i
 					local w = 0
 					for i=1,paragraph.cn-1,1 do
 						w = w + paragraph.cellWidth[i]
-						Write(pstart-1 + w, y, "│")
+						queue(y, writeplain, pstart-1 + w, "│")
 					end
 				end
 				if paragraph.style == "IMG" then
 					local row = paragraph.imagedata[ln]
 					if row then
-						WriteRow(pstart, y, row)
+						queue(y, writeimagerow, pstart, row)
 					end
 				end
 			end
 			
 			local x = paragraph:getIndentOfLine(ln)
 			
-			if not mp then
-				paragraph:renderLine(l,
-					leftpadding + margin + x, y)
-			else
-				paragraph:renderMarkedLine(l,
-					leftpadding + margin + x, y, nil, pn)
-			end
+			queue(y, drawtext, paragraph, l, leftpadding + margin + x,
+				mark and pn, mark)
 
 			-- If the top of the page hasn't already been set, then the
 			-- current paragraph extends off the top of the screen.
@@ -425,9 +470,9 @@ function RedrawScreen()
 			paragraph.style == "TRB" or
 			paragraph.style == "IMG" 
 		then
-			Write(pstart-1,y, "└")
-			Write(pstart + Document.wrapwidth, y, "┘")
-			Write(pstart,  y, border)
+			queue(y, writeplain, pstart-1, "└")
+			queue(y, writeplain, pstart + Document.wrapwidth, "┘")
+			queue(y, writeplain, pstart, border)
 		end
 
 		y = y + Document:spaceBelow(pn)
@@ -446,9 +491,34 @@ function RedrawScreen()
 		drawbottommarker(y)
 	end
 
+	-- Now actually draw whatever's changed.
+
+	if (GetDrawCount() ~= drawcount) then
+		oldrows = nil
+	end
+	if not oldrows then
+		ClearScreen()
+		for y, row in pairs(newrows) do
+			drawrow(y, row)
+		end
+	else
+		for y = 0, ScreenHeight-1 do
+			local row = newrows[y]
+			if not samerow(oldrows[y], row) then
+				ClearArea(0, y, ScreenWidth-1, y)
+				if row then
+					drawrow(y, row)
+				end
+			end
+		end
+	end
+	oldrows = newrows
+	newrows = nil
+
 	redrawstatus()
 
 	FireEvent(Event.Redraw)
+	drawcount = GetDrawCount()
 end
 
 function GetCharWithBlinkingCursor(timeout)
@@ -459,10 +529,10 @@ function GetCharWithBlinkingCursor(timeout)
 	while timeout > 0 do
 		local t = shown and BLINK_ON_TIME or BLINK_OFF_TIME
 		t = min(t, timeout)
-		local c = wg.getchar(t)
+		local c, text = wg.getchar(t)
 		if (c ~= "KEY_TIMEOUT") then
 			ShowCursor();
-			return c
+			return c, text
 		end
 
 		shown = not shown
@@ -0,0 +1,33 @@
+require("tests/testsuite")
+
+local filename = os.tmpname()
+local pattern = Leafname(filename)..".autosave.wg"
+local autosavename = Dirname(filename).."/"..pattern
+
+Cmd.InsertStringIntoParagraph("The quick brown fox")
+DocumentSet.name = filename
+DocumentSet.addons.autosave.enabled = true
+DocumentSet.addons.autosave.pattern = pattern
+DocumentSet.addons.autosave.lastsaved = 0
+DocumentSet:touch()
+
+local autosaved = false
+AddEventListener(Event.Autosaved, function() autosaved = true end)
+
+-- The save happens in the background; keep idling until it's done. Edits
+-- made meanwhile don't end up in the autosave.
+
+FireEvent(Event.Idle)
+Cmd.InsertStringIntoParagraph(" jumps")
+
+local deadline = os.time() + 10
+while not autosaved and (os.time() < deadline) do
+	FireEvent(Event.Idle)
+	FlushAsyncEvents()
+end
+AssertEquals(true, autosaved)
+
+DocumentSet:clean()
+AssertEquals(true, Cmd.LoadDocumentSet(autosavename))
+AssertEquals("The quick brown fox", table.concat(Document[1], " "))
+os.remove(autosavename)
@@ -0,0 +1,58 @@
+require("tests/testsuite")
+
+local function words(document)
+	local t = {}
+	for _, p in ipairs(document) do
+		t[#t+1] = p[1]
+	end
+	return t
+end
+
+local function P(word)
+	return CreateParagraph("P", {word})
+end
+
+Document:replaceParagraphAt(1, P("a"))
+Document:appendParagraph(P("d"))
+Document:appendParagraph(P("e"))
+
+Document:insertParagraphsBefore({P("b"), P("c")}, 2)
+AssertTableEquals({"a", "b", "c", "d", "e"}, words(Document))
+
+Document:insertParagraphsBefore({P("f")}, 6)
+AssertTableEquals({"a", "b", "c", "d", "e", "f"}, words(Document))
+
+Document:deleteParagraphsAt(2, 3)
+AssertTableEquals({"a", "e", "f"}, words(Document))
+
+Document:deleteParagraphsAt(2, 2)
+AssertTableEquals({"a"}, words(Document))
+
+-- Pasting lots of paragraphs and then undoing it.
+
+for i = 1, 50 do
+	Document:appendParagraph(P("x"..i))
+end
+
+Document.cp = 1
+Document.cw = 1
+Document.co = 1
+Cmd.SetMark()
+Document.cp = #Document
+Document.cw = 1
+Document.co = 3
+Cmd.Copy()
+
+Document.cp = 2
+Document.cw = 1
+Document.co = 1
+Cmd.Checkpoint()
+local before = words(Document)
+Cmd.Paste()
+AssertEquals(51 + 50, #Document)
+
+Cmd.Undo()
+AssertTableEquals(before, words(Document))
+
+Cmd.Redo()
+AssertEquals(51 + 50, #Document)
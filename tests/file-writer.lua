@@ -0,0 +1,36 @@
+require("tests/testsuite")
+
+local filename = os.tmpname()
+
+local function readfile()
+	local fp = io.open(filename, "rb")
+	local s = fp:read("*a")
+	fp:close()
+	return s
+end
+
+local w = wg.openwriter(filename)
+AssertEquals(w, w:write("one", " ", "two"))
+w:write("\n", 3)
+AssertEquals(true, w:close())
+AssertEquals("one two\n3", readfile())
+
+-- Writes bigger than the buffer, and lots of small writes which overflow
+-- it.
+
+local big = string.rep("x", 100000)
+w = wg.openwriter(filename)
+w:write(big)
+for i = 1, 50000 do
+	w:write("ab")
+end
+AssertEquals(true, w:close())
+AssertEquals(big..string.rep("ab", 50000), readfile())
+
+AssertEquals(false, pcall(w.write, w, "closed"))
+
+local r, e = wg.openwriter(filename.."/does/not/exist")
+AssertNull(r)
+AssertNotNull(e)
+
+os.remove(filename)
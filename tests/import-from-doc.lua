@@ -0,0 +1,44 @@
+require("tests/testsuite")
+
+-- testdoc.doc is a small hand-made Word 97 file. Its text is split into
+-- three pieces which are stored out of order in the WordDocument stream:
+-- 8-bit, then UTF-16 (part of the first paragraph, which ends there), then
+-- 8-bit again (the other two paragraphs). Character formatting is spread
+-- over three CHPX pages, with the plain runs having no Chpx at all, and the
+-- second paragraph is centred.
+--
+-- testdoc-fragmented.doc holds the same streams in a different container:
+-- the WordDocument sectors are chained out of order, 1Table is small enough
+-- to live in the mini stream and its mini sectors are out of order too, and
+-- there are 240 FAT sectors so the DIFAT needs a chain of two sectors. It
+-- must import identically.
+
+local expected = [[
+<html xmlns="http://www.w3.org/1999/xhtml"><head>
+<meta http-equiv="Content-Type" content="text/html;charset=utf-8"/>
+<meta name="generator" content="WordGrinder 0.8"/>
+<title></title>
+</head><body>
+
+<p style="text-align:left;">This is <b>bold </b>and <i>italic </i>and <b>naïve</b>.</p>
+<p style="text-align:center;">A centred paragraph with <i><b>bold </b></i><i><b>italic </b></i>words.</p>
+<p style="text-align:left;">The end.</p>
+</body>
+</html>
+]]
+
+for _, name in ipairs({"testdoc.doc", "testdoc-fragmented.doc"}) do
+	Cmd.ImportDOCFile("testdocs/"..name)
+	DocumentSet:setCurrent(name)
+	local output = Cmd.ExportToHTMLString():gsub("<title>.-</title>", "<title></title>")
+	AssertEquals(expected, output)
+end
+
+-- The section is A4 with 2cm margins.
+local settings = DocumentSet.addons.pageconfig
+AssertEquals("A4", settings.pagesize)
+AssertEquals(false, settings.landscape)
+AssertEquals(2, settings.left)
+AssertEquals(2, settings.right)
+AssertEquals(2, settings.top)
+AssertEquals(2, settings.bottom)
@@ -0,0 +1,40 @@
+require("tests/testsuite")
+
+local filename = os.tmpname()
+local fp = io.open(filename, "wb")
+fp:write([[
+{\rtf1\ansi\deff0
+{\fonttbl{\f0\froman Times New Roman;}{\f1\fswiss Arial;}}
+{\colortbl;\red0\green0\blue0;}
+{\stylesheet{\s0 Normal;}{\s1 H1;}}
+{\*\generator Some Other Word Processor;}
+{\info{\title Ignored}{\author Nobody}}
+\pard\plain\s1 A heading\par
+\pard\plain This is normal paragraph text with {\b bold} and {\i italic} and {\ul underline}. And {\b\i\ul all three!}\par
+\pard\plain Escaped \{braces\} and a back\\slash, split
+ across lines, with a {\*\unknown skipped destination}gap.\par
+\pard\plain\qc Centred text.\par
+}
+]])
+fp:close()
+
+Cmd.ImportRTFFile(filename)
+os.remove(filename)
+
+local expected = [[
+<html xmlns="http://www.w3.org/1999/xhtml"><head>
+<meta http-equiv="Content-Type" content="text/html;charset=utf-8"/>
+<meta name="generator" content="WordGrinder 0.8"/>
+<title></title>
+</head><body>
+
+<h1>A heading</h1>
+<p style="text-align:left;">This is normal paragraph text with <b>bold </b>and <i>italic </i>and <u>underline</u>. And <i><b><u>all </u></b></i><i><b><u>three!</u></b></i></p>
+<p style="text-align:left;">Escaped {braces} and a back\slash, split across lines, with a gap.</p>
+<p style="text-align:center;">Centred text.</p>
+</body>
+</html>
+]]
+
+local output = Cmd.ExportToHTMLString():gsub("<title>.-</title>", "<title></title>")
+AssertEquals(expected, output)
@@ -0,0 +1,66 @@
+require("tests/testsuite")
+
+-- Compares the incrementally maintained word count and list numbers with
+-- ones calculated from scratch, after lots of random edits.
+
+local styles = {"P", "LN", "LN", "LN", "LB", "L"}
+
+local function P()
+	local words = {}
+	for i = 1, math.random(0, 5) do
+		words[i] = "x"
+	end
+	return CreateParagraph(styles[math.random(#styles)], words)
+end
+
+local function check()
+	Document:renumber()
+
+	local wc = 0
+	local n = 1
+	for _, p in ipairs(Document) do
+		wc = wc + #p
+		local style = DocumentStyles[p.style]
+		if style.numbered then
+			AssertEquals(n, p.number)
+			n = n + 1
+		elseif not style.list then
+			n = 1
+		end
+	end
+	AssertEquals(wc, Document.wordcount)
+end
+
+math.randomseed(0)
+for i = 1, 20 do
+	Document:appendParagraph(P())
+end
+check()
+
+for i = 1, 2000 do
+	local op = math.random(6)
+	local pn = math.random(#Document)
+	if (op == 1) then
+		Document:insertParagraphBefore(P(), math.random(#Document+1))
+	elseif (op == 2) and (#Document > 1) then
+		Document:deleteParagraphAt(pn)
+	elseif (op == 3) then
+		local ps = {}
+		for j = 1, math.random(3) do
+			ps[j] = P()
+		end
+		Document:insertParagraphsBefore(ps, math.random(#Document+1))
+	elseif (op == 4) and (#Document > 4) then
+		Document:deleteParagraphsAt(pn, math.min(math.random(3), #Document-pn))
+	elseif (op == 5) then
+		Document:replaceParagraphAt(pn, P())
+	elseif (#Document[pn] > 0) then
+		Document:replaceWordsAt(pn, 1, 1, "y", "z")
+	end
+
+	-- Sometimes let several changes pile up before renumbering.
+	if (math.random(3) == 1) then
+		check()
+	end
+end
+check()
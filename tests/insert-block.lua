@@ -0,0 +1,45 @@
+require "tests/testsuite"
+
+Cmd.InsertStringIntoParagraph("The quick dog")
+Cmd.GotoPreviousWordW()
+Cmd.GotoNextCharW()
+
+Cmd.Checkpoint()
+Cmd.InsertBlock("brown fox\r\njumps over\n\n the lazy\1\tcat, not the ")
+
+-- (Like Cmd.Paste, this leaves an empty word where the paragraph was split.)
+
+AssertEquals(4, #Document)
+AssertTableEquals({"The", "quick", "dbrown", "fox", ""}, Document[1])
+AssertTableEquals({"jumps", "over"}, Document[2])
+AssertTableEquals({""}, Document[3])
+AssertTableEquals({"the", "lazy", "cat,", "not", "the", "og"}, Document[4])
+AssertEquals(4, Document.cp)
+AssertEquals(6, Document.cw)
+AssertEquals(1, Document.co)
+
+-- A single undo takes the whole block away again.
+
+Cmd.Undo()
+AssertEquals(1, #Document)
+AssertTableEquals({"The", "quick", "dog"}, Document[1])
+
+-- Terminals send bare carriage returns; and pasting over a selection
+-- replaces it.
+
+Cmd.GotoBeginningOfDocument()
+Cmd.SetMark()
+Cmd.GotoEndOfWord()
+Cmd.InsertBlock("A\rslow")
+
+AssertEquals(2, #Document)
+AssertTableEquals({"A"}, Document[1])
+AssertTableEquals({"slow", "quick", "dog"}, Document[2])
+
+-- Whitespace either side of a single line keeps it apart from its
+-- neighbours.
+
+Cmd.GotoEndOfDocument()
+Cmd.GotoPreviousWordW()
+Cmd.InsertBlock(" big ")
+AssertTableEquals({"slow", "quick", "big", "dog"}, Document[2])
@@ -0,0 +1,168 @@
+require("tests/testsuite")
+
+-- Compares the document's incrementally maintained line index with line
+-- positions calculated from scratch, after lots of random edits.
+
+local styles = {"P", "P", "P", "H1", "Q", "CENTER", "RIGHT", "LB"}
+
+local function P()
+	local words = {}
+	for i = 1, math.random(1, 30) do
+		words[i] = string.rep("x", math.random(1, 8))
+	end
+	return CreateParagraph(styles[math.random(#styles)], words)
+end
+
+local function check()
+	local line = 0
+	for pn, p in ipairs(Document) do
+		line = line + Document:spaceAbove(pn)
+		AssertEquals(line, Document:getLineOfParagraph(pn))
+
+		local lines = #p:wrapForStyle()
+		for ln = 1, lines do
+			local gotpn, gotln = Document:getParagraphOfLine(line)
+			AssertEquals(pn, gotpn)
+			AssertEquals(ln, gotln)
+			line = line + 1
+		end
+	end
+	AssertEquals(line, Document:getLineCount())
+
+	local pn, ln = Document:getParagraphOfLine(line + 10)
+	AssertEquals(#Document, pn)
+	AssertEquals(#Document[pn]:wrapForStyle(), ln)
+end
+
+math.randomseed(0)
+Document:wrap(40)
+for i = 1, 20 do
+	Document:appendParagraph(P())
+end
+check()
+
+for i = 1, 1000 do
+	local op = math.random(6)
+	local pn = math.random(#Document)
+	if (op == 1) then
+		Document:insertParagraphBefore(P(), math.random(#Document+1))
+	elseif (op == 2) and (#Document > 1) then
+		Document:deleteParagraphAt(pn)
+	elseif (op == 3) then
+		local ps = {}
+		for j = 1, math.random(3) do
+			ps[j] = P()
+		end
+		Document:insertParagraphsBefore(ps, math.random(#Document+1))
+	elseif (op == 4) and (#Document > 4) then
+		Document:deleteParagraphsAt(pn, math.min(math.random(3), #Document-pn))
+	elseif (op == 5) then
+		Document:replaceParagraphAt(pn, P())
+	else
+		Document:replaceWordsAt(pn, 1, 1, string.rep("y", 30), "z")
+	end
+
+	-- Sometimes let several changes pile up before looking.
+	if (math.random(3) == 1) then
+		check()
+	end
+end
+check()
+
+-- Changing the width relays out everything.
+
+Document:wrap(25)
+check()
+
+-- Paging moves by half a screen, and stops at the ends of the document.
+
+ScreenHeight = 20
+Document:deleteParagraphsAt(1, #Document-1)
+Document:replaceParagraphAt(1, CreateParagraph("P", {"0"}))
+for i = 1, 99 do
+	Document:appendParagraph(CreateParagraph("P", {tostring(i)}))
+end
+Document.cp = 1
+Document.cw = 1
+Document.co = 1
+
+Cmd.GotoNextPage()
+AssertEquals(11, Document.cp)
+Cmd.GotoNextPage()
+AssertEquals(21, Document.cp)
+Cmd.GotoPreviousPage()
+AssertEquals(12, Document.cp)
+
+for i = 1, 20 do
+	Cmd.GotoNextPage()
+end
+AssertEquals(100, Document.cp)
+for i = 1, 20 do
+	Cmd.GotoPreviousPage()
+end
+AssertEquals(1, Document.cp)
+
+-- Changing the paragraph styles relays out documents other than the current
+-- one, too.
+
+GlobalSettings.lookandfeel.denseparagraphs = true
+UpdateDocumentStyles()
+
+local first = Document.name
+DocumentSet:addDocument(CreateDocument(), "other")
+DocumentSet:setCurrent("other")
+for i = 1, 20 do
+	Document:appendParagraph(P())
+end
+check()
+
+DocumentSet:setCurrent(first)
+GlobalSettings.lookandfeel.denseparagraphs = false
+UpdateDocumentStyles()
+DocumentSet:setCurrent("other")
+check()
+
+-- Table rows take their cell widths from the row before them, which must be
+-- found in the document being indexed rather than the current one.
+
+local function TR()
+	local words = {}
+	for i = 1, math.random(1, 12) do
+		words[#words+1] = string.rep("x", math.random(1, 8))
+		if (math.random(3) == 1) then
+			words[#words+1] = ";"
+		end
+	end
+	return CreateParagraph("TR", words)
+end
+
+DocumentSet:addDocument(CreateDocument(), "table")
+DocumentSet:setCurrent("table")
+for i = 1, 40 do
+	Document:appendParagraph((math.random(2) == 1) and TR() or P())
+end
+check()
+
+local tabledoc = Document
+DocumentSet:setCurrent("other")
+tabledoc:invalidateLayout()
+local count = tabledoc:getLineCount()
+DocumentSet:setCurrent("table")
+AssertEquals(count, Document:getLineCount())
+check()
+
+-- Editing a table row changes the cell widths of the rows below it, so
+-- their heights have to be recalculated too.
+
+DocumentSet:addDocument(CreateDocument(), "rows")
+DocumentSet:setCurrent("rows")
+Document:wrap(40)
+Document:appendParagraph(CreateParagraph("TR", {"a", ";", "b"}))
+Document:appendParagraph(CreateParagraph("TR",
+	{"cc", "dd", "ee", "ff", "gg", "hh", ";", "z"}))
+check()
+Document:replaceWordsAt(#Document-1, 1, 1, "aaaaaaaaaaaaaaaaaaaaaaaaaa")
+check()
+count = Document:getLineCount()
+Document:invalidateLayout()
+AssertEquals(Document:getLineCount(), count)
@@ -0,0 +1,46 @@
+require("tests/testsuite")
+
+Cmd.InsertStringIntoParagraph("The quick brown fox jumps over the lazy dog.")
+
+DocumentStyles["P"].indent = 0
+DocumentStyles["P"].firstindent = nil
+
+local para = Document[1]
+local lines = para:wrap(20)
+AssertEquals(3, #lines)
+
+-- Wrapping again with nothing changed reuses the cached layout.
+
+AssertEquals(lines, para:wrap(20))
+
+-- Anything which affects the layout causes a rewrap.
+
+local lines2 = para:wrap(30)
+AssertEquals(2, #lines2)
+AssertEquals(lines2, para:wrap(30))
+
+DocumentStyles["P"].indent = 4
+local lines3 = para:wrap(30)
+AssertEquals(false, lines2 == lines3)
+AssertEquals(lines3, para:wrap(30))
+
+DocumentStyles["P"].indent = 0
+Document:invalidateLayout()
+local lines4 = para:wrap(30)
+AssertEquals(false, lines3 == lines4)
+AssertTableEquals(lines2[1], lines4[1])
+
+-- Saving doesn't throw the layout away.
+
+DocumentSet:purge()
+AssertEquals(lines4, para:wrap(30))
+
+-- Invalidating a document other than the current one reaches its
+-- paragraphs, too.
+
+local other = CreateDocument()
+other:replaceParagraphAt(1, para:copy())
+local lines5 = other[1]:wrap(30)
+AssertEquals(lines5, other[1]:wrap(30))
+other:invalidateLayout()
+AssertEquals(false, lines5 == other[1]:wrap(30))
@@ -0,0 +1,48 @@
+require("tests/testsuite")
+
+Cmd.InsertStringIntoParagraph("The quick brown fox jumps over the lazy dog.")
+
+DocumentStyles["BOTH"].indent = nil
+DocumentStyles["BOTH"].firstindent = 0
+
+local para = CreateParagraph("BOTH", Document[1])
+local lines = para:wrapBoth(20)
+AssertEquals(3, #lines)
+
+AssertTableEquals({1, 2, 3}, lines[1])
+AssertTableEquals({4, 5, 6, 7}, lines[2])
+AssertTableEquals({8, 9}, lines[3])
+
+AssertTableEquals({0, 6, 13, 0, 5, 11, 16, 0, 5}, para.xs)
+
+local para = CreateParagraph("RIGHT", Document[1])
+local lines = para:wrapRight(20)
+AssertEquals(3, #lines)
+
+AssertTableEquals({1, 2, 3}, lines[1])
+AssertTableEquals({4, 5, 6, 7}, lines[2])
+AssertTableEquals({8, 9}, lines[3])
+
+AssertTableEquals({4, 8, 14, 1, 5, 11, 16, 10, 15}, para.xs)
+
+local para = CreateParagraph("CENTER", Document[1])
+local lines = para:wrapCenter(20)
+AssertEquals(3, #lines)
+
+AssertTableEquals({2, 6, 12, 0.5, 4.5, 10.5, 15.5, 5, 10}, para.xs)
+
+-- The line breaker can also be called directly.
+
+local lines, xs, sentences = wg.wrapparagraph({"One.", "two", "three."}, 80,
+	0, 0, "left", false)
+AssertEquals(1, #lines)
+AssertTableEquals({1, 2, 3}, lines[1])
+AssertEquals(1, lines[1].wn)
+AssertTableEquals({0, 5, 9}, xs)
+AssertEquals(true, sentences[1])
+AssertEquals(true, sentences[2])
+AssertEquals(true, sentences[3])
+
+local lines, xs = wg.wrapparagraph({"One.", "two", "three."}, 80,
+	0, 0, "left", true)
+AssertTableEquals({0, 6, 10}, xs)
@@ -0,0 +1,66 @@
+require("tests/testsuite")
+
+local function readmagic(filename)
+	local fp = io.open(filename, "rb")
+	local magic = fp:read("*l")
+	fp:close()
+	return magic
+end
+
+local function paragraphs(document)
+	local t = {}
+	for _, p in ipairs(document) do
+		t[#t+1] = p.style.." "..table.concat(p, " ")
+	end
+	return t
+end
+
+Cmd.InsertStringIntoParagraph("The quick brown fox")
+Cmd.SplitCurrentParagraph()
+Cmd.ChangeParagraphStyle("H1")
+Cmd.InsertStringIntoParagraph("jumps \016over\017 the")
+Cmd.SplitCurrentParagraph()
+Cmd.SplitCurrentParagraph()
+Cmd.ChangeParagraphStyle("LN")
+Cmd.InsertStringIntoParagraph("lazy dog.")
+Cmd.AddBlankDocument("other")
+Cmd.InsertStringIntoParagraph("fnord")
+
+Cmd.ChangeDocument("main")
+local want = paragraphs(Document)
+
+-- New document sets are saved in the binary format.
+
+local filename = os.tmpname()
+AssertEquals(false, WantTextFileFormat())
+AssertEquals(true, Cmd.SaveCurrentDocumentAs(filename))
+AssertEquals("WordGrinder dumpfile v4: this is not a text file!",
+	readmagic(filename))
+
+AssertEquals(true, Cmd.LoadDocumentSet(filename))
+Cmd.ChangeDocument("main")
+AssertTableEquals(want, paragraphs(Document))
+AssertEquals(ParagraphClass, GetClass(Document[1]))
+AssertNotNull(Document[1].getLineOfWord)
+Cmd.ChangeDocument("other")
+AssertTableEquals({"fnord"}, Document[1])
+
+-- The text format can still be selected, and files loaded from it stay in
+-- it.
+
+DocumentSet.addons.fileformat.textformat = true
+AssertEquals(true, Cmd.SaveCurrentDocumentAs(filename))
+AssertEquals("WordGrinder dumpfile v3: this is a text file; diff me!",
+	readmagic(filename))
+
+DocumentSet.addons.fileformat = nil
+AssertEquals(true, Cmd.LoadDocumentSet(filename))
+AssertEquals(true, WantTextFileFormat())
+Cmd.ChangeDocument("main")
+AssertTableEquals(want, paragraphs(Document))
+
+-- Garbage is rejected cleanly.
+
+AssertEquals(true, pcall(wg.decodeparagraphs, wg.encodeparagraphs(Document), 1,
+	{}, {}))
+AssertEquals(false, pcall(wg.decodeparagraphs, "\255\255\255\255", 1, {}, {}))
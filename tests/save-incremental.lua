@@ -0,0 +1,70 @@
+require("tests/testsuite")
+
+local function readfile(filename)
+	local fp = io.open(filename, "rb")
+	local data = fp:read("*a")
+	fp:close()
+	return data
+end
+
+local function writefile(filename, data)
+	local fp = io.open(filename, "wb")
+	fp:write(data)
+	fp:close()
+end
+
+Cmd.InsertStringIntoParagraph("The quick brown fox")
+Cmd.SplitCurrentParagraph()
+Cmd.InsertStringIntoParagraph("jumps over the lazy dog.")
+Cmd.AddBlankDocument("other")
+Cmd.InsertStringIntoParagraph("fnord")
+Cmd.ChangeDocument("main")
+
+local filename = os.tmpname()
+AssertEquals(true, Cmd.SaveCurrentDocumentAs(filename))
+AssertNotNull(DocumentSet._savedfile)
+AssertNotNull(DocumentSet.documents[2]._saved)
+
+-- Saving doesn't throw away the layout.
+
+Document[1]:wrap(40)
+AssertNotNull(Document[1].lines)
+AssertEquals(true, Cmd.SaveCurrentDocument())
+AssertNotNull(Document[1].lines)
+
+-- Editing a document means it has to be encoded again.
+
+Cmd.GotoBeginningOfDocument()
+Cmd.InsertStringIntoParagraph("Very ")
+AssertNull(Document._saved)
+
+-- Unchanged documents are copied out of the old file rather than being
+-- encoded again, but only if they're still what was saved: changing the
+-- file behind WordGrinder's back (without changing its size) means
+-- everything is saved again.
+
+local data = readfile(filename)
+writefile(filename, (data:gsub("fnord", "fnarg")))
+AssertEquals(true, Cmd.SaveCurrentDocument())
+
+AssertEquals(true, Cmd.LoadDocumentSet(filename))
+Cmd.ChangeDocument("other")
+AssertTableEquals({"fnord"}, Document[1])
+Cmd.ChangeDocument("main")
+AssertEquals("VeryThe quick brown fox", table.concat(Document[1], " "))
+
+-- Loading remembers where each document is, so saving straight away reuses
+-- everything.
+
+AssertNotNull(Document._saved)
+local before = readfile(filename)
+AssertEquals(true, Cmd.SaveCurrentDocument())
+AssertEquals(before, readfile(filename))
+
+-- If the file has changed size, nothing is reused.
+
+writefile(filename, (readfile(filename):gsub("fnord", "fnarg")).."x")
+AssertEquals(true, Cmd.SaveCurrentDocument())
+AssertEquals(true, Cmd.LoadDocumentSet(filename))
+Cmd.ChangeDocument("other")
+AssertTableEquals({"fnord"}, Document[1])
@@ -0,0 +1,99 @@
+require("tests/testsuite")
+
+Cmd.InsertStringIntoParagraph("one")
+Cmd.SplitCurrentParagraph()
+Cmd.InsertStringIntoParagraph("two")
+Cmd.SplitCurrentParagraph()
+Cmd.InsertStringIntoParagraph("three")
+
+local p1, p2, p3 = Document[1], Document[2], Document[3]
+
+-- Checkpointing with nothing changed doesn't create a new undo entry.
+
+Cmd.Checkpoint()
+Cmd.Checkpoint()
+AssertEquals(1, #Document._undostack)
+
+-- Delete a range spanning several paragraphs.
+
+Cmd.GotoBeginningOfDocument()
+Cmd.GotoEndOfLine()
+Cmd.SetMark()
+Cmd.GotoEndOfDocument()
+Cmd.GotoBeginningOfLine()
+Cmd.Delete()
+
+AssertEquals(1, #Document)
+local deleted = Document[1]
+
+-- Undoing restores the original paragraph objects, not copies.
+
+Cmd.Undo()
+AssertEquals(3, #Document)
+AssertEquals(p1, Document[1])
+AssertEquals(p2, Document[2])
+AssertEquals(p3, Document[3])
+AssertEquals(0, #Document._undostack)
+AssertEquals(1, #Document._redostack)
+
+Cmd.Redo()
+AssertEquals(1, #Document)
+AssertEquals(deleted, Document[1])
+AssertEquals(1, #Document._undostack)
+AssertEquals(0, #Document._redostack)
+
+-- Editing without a checkpoint after an undo still produces something
+-- which can be undone, and discards the redo history.
+
+Cmd.Undo()
+Cmd.GotoBeginningOfDocument()
+Cmd.InsertStringIntoParagraph("zero ")
+AssertEquals(1, #Document._undostack)
+AssertEquals(0, #Document._redostack)
+AssertEquals(3, #Document)
+
+Cmd.Undo()
+AssertEquals(p1, Document[1])
+
+-- Typing edits the paragraph in place, even with a checkpoint before every
+-- key; each record only keeps the words which were changed.
+
+local typed = Document[1]
+Cmd.GotoBeginningOfDocument()
+for _, f in ipairs({
+		function() Cmd.InsertStringIntoWord("x") end,
+		function() Cmd.InsertStringIntoWord("y") end,
+		Cmd.SplitCurrentWord,
+		function() Cmd.InsertStringIntoWord("z") end,
+		Cmd.DeletePreviousChar,
+		Cmd.DeletePreviousChar
+	}) do
+	Cmd.Checkpoint()
+	f()
+	AssertEquals(typed, Document[1])
+	local change = Document._undostack[#Document._undostack][1]
+	AssertEquals(change[2], change[3])
+end
+AssertEquals("xyone", Document[1][1])
+AssertEquals("two", Document[2][1])
+
+Cmd.Undo()
+AssertEquals("xy", Document[1][1])
+AssertEquals("one", Document[1][2])
+Cmd.Undo()
+AssertEquals("zone", Document[1][2])
+Cmd.Undo()
+Cmd.Undo()
+AssertEquals("xyone", Document[1][1])
+Cmd.Undo()
+AssertEquals("xone", Document[1][1])
+Cmd.Undo()
+AssertEquals(typed, Document[1])
+AssertEquals("one", Document[1][1])
+AssertEquals(1, #Document[1])
+
+Cmd.Redo()
+Cmd.Redo()
+Cmd.Redo()
+AssertEquals("xy", Document[1][1])
+AssertEquals(2, #Document[1])
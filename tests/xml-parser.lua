@@ -0,0 +1,74 @@
+require("tests/testsuite")
+
+local xml = [[<?xml version="1.0"?>
+<doc xmlns="D" xmlns:w="W">
+	<w:p w:style="a">one &amp; two&#33;</w:p>
+	<skip><w:p>not me</w:p></skip>
+	<w:p>three <w:b/> four</w:p>
+</doc>]]
+
+local tokens = {}
+for t in TokeniseXML(xml) do
+	tokens[#tokens+1] = t.event .. " " .. (t.name or t.text or "")
+end
+AssertTableEquals(
+	{
+		"processing xml",
+		"opentag doc",
+		"opentag p",
+		"text one ",
+		"text &",
+		"text  two",
+		"text !",
+		"closetag p",
+		"opentag skip",
+		"opentag p",
+		"text not me",
+		"closetag p",
+		"closetag skip",
+		"opentag p",
+		"text three ",
+		"opentag b",
+		"closetag b",
+		"text  four",
+		"closetag p",
+		"closetag doc",
+	}, tokens)
+
+local tree = ParseXML(xml)
+AssertEquals("D doc", tree._name)
+AssertEquals("W p", tree[1]._name)
+AssertEquals("a", tree[1]["W style"])
+AssertEquals("one & two!", table.concat(tree[1]))
+
+-- Only the elements with handlers get parsed.
+
+local seen = {}
+ParseXMLElements(xml,
+	{
+		["D doc"] =
+		{
+			["W p"] = function(element)
+				seen[#seen+1] = element
+			end
+		}
+	})
+AssertEquals(2, #seen)
+AssertEquals("a", seen[1]["W style"])
+AssertEquals("three ", seen[2][1])
+AssertEquals("W b", seen[2][2]._name)
+
+-- Nesting is not limited.
+
+local deep = string.rep("<a>", 500) .. "x" .. string.rep("</a>", 500)
+local e = ParseXML(deep)
+for i = 1, 499 do
+	e = e[1]
+end
+AssertEquals("x", e[1])
+
+-- Numeric entities can be any length; huge ones are clamped.
+
+local tokens = TokeniseXML("<a>&#" .. string.rep("9", 1000000) .. ";</a>")
+tokens()
+AssertEquals(wg.writeu8(0x7fffffff), tokens().text)
@@ -0,0 +1,74 @@
+require("tests/testsuite")
+
+local zipname = os.tmpname()
+
+local big = {}
+for i = 1, 20000 do
+	big[i] = "<p>" .. i .. "</p>"
+end
+big = "<doc xmlns=\"D\">" .. table.concat(big) .. "</doc>"
+
+AssertEquals(true, wg.writezip(zipname,
+	{
+		["small.txt"] = "small",
+		["dir/big.xml"] = big,
+	}))
+
+-- Members can be read whole, by name or through an open zip.
+
+AssertEquals("small", wg.readfromzip(zipname, "small.txt"))
+AssertEquals(nil, wg.readfromzip(zipname, "missing.txt"))
+AssertEquals(nil, wg.openzip(zipname .. ".missing"))
+
+local zip = wg.openzip(zipname)
+AssertEquals("small", zip:read("small.txt"))
+AssertEquals(big, zip:read("dir/big.xml"))
+AssertEquals(nil, zip:read("missing.txt"))
+AssertEquals(nil, zip:reader("missing.txt"))
+
+-- ...or a chunk at a time.
+
+local chunks = {}
+for chunk in zip:reader("dir/big.xml") do
+	chunks[#chunks+1] = chunk
+end
+AssertEquals(true, #chunks > 1)
+AssertEquals(big, table.concat(chunks))
+
+chunks = {}
+for chunk in wg.zipreader(zipname, "small.txt") do
+	chunks[#chunks+1] = chunk
+end
+AssertTableEquals({"small"}, chunks)
+
+-- Readers can be parsed directly.
+
+local count = 0
+ParseXMLElements(zip:reader("dir/big.xml"),
+	{
+		["D doc"] =
+		{
+			["D p"] = function(element)
+				count = count + 1
+				AssertEquals(tostring(count), element[1])
+			end
+		}
+	})
+AssertEquals(20000, count)
+
+-- Opening another member stops the previous reader.
+
+local reader = zip:reader("dir/big.xml")
+reader()
+AssertEquals("small", zip:read("small.txt"))
+AssertEquals(false, pcall(reader))
+
+local filename = os.tmpname()
+AssertEquals(true, zip:unzip("small.txt", filename))
+local fp = io.open(filename, "rb")
+AssertEquals("small", fp:read("*a"))
+fp:close()
+os.remove(filename)
+
+zip:close()
+os.remove(zipname)